@@ -0,0 +1,90 @@
+#include "Microbenchmarks.h"
+
+#include <benchmark/benchmark.h>
+#include <glm/glm.hpp>
+#include <iostream>
+#include <optional>
+
+#include "ShaderProgram.h"
+#include "UniformBlocks.h"
+#include "camera.h"
+
+namespace {
+// the uniforms of one mesh draw, as Mesh::setUniforms sets them
+const glm::mat4 cModelTr(1.0f);
+const glm::vec3 cPositionOffset(0.0f);
+const glm::vec3 cPositionScale(1.0f);
+
+std::optional<ShaderProgram>& sShaderProgram() {
+    static auto shaderProgram = ShaderProgram::createShaderProgram("shaders/shader.vs", "shaders/shader.fs");
+    return shaderProgram;
+}
+
+void sSetUniformsByLocation(benchmark::State& state) {
+    auto& shader = *sShaderProgram();
+    shader.use();
+    const auto& uniforms = shader.meshUniforms();
+    for (auto _ : state) {
+        shader.setUniform(uniforms.instanced, false);
+        shader.setUniform(uniforms.modelTr, cModelTr);
+        shader.setUniform(uniforms.localTr, cModelTr);
+        shader.setUniform(uniforms.compactVertices, true);
+        shader.setUniform(uniforms.positionOffset, cPositionOffset);
+        shader.setUniform(uniforms.positionScale, cPositionScale);
+        shader.setUniform(uniforms.materialIndex, 0);
+    }
+}
+
+void sSetUniformsByName(benchmark::State& state) {
+    auto& shader = *sShaderProgram();
+    shader.use();
+    for (auto _ : state) {
+        shader.setUniform("instanced", false);
+        shader.setUniform("modelTr", cModelTr);
+        shader.setUniform("localTr", cModelTr);
+        shader.setUniform("compactVertices", true);
+        shader.setUniform("positionOffset", cPositionOffset);
+        shader.setUniform("positionScale", cPositionScale);
+        shader.setUniform("materialIndex", 0);
+    }
+}
+
+// the light structs went to a uniform block, their upload replaced the struct overloads of setUniform
+void sSetLights(benchmark::State& state) {
+    UniformBlocks uniformBlocks;
+    GlobalLight globalLight;
+    for (auto _ : state) {
+        uniformBlocks.setLights(globalLight);
+    }
+}
+
+void sSetFrame(benchmark::State& state) {
+    UniformBlocks uniformBlocks;
+    Camera camera;
+    for (auto _ : state) {
+        uniformBlocks.setFrame(camera.viewMatrix(), cModelTr, camera.position(), 0.0f);
+    }
+}
+
+void sViewMatrix(benchmark::State& state) {
+    Camera camera;
+    for (auto _ : state) {
+        // a small turn per frame, as the mouse does
+        camera.processMouse(0.5, 0.25);
+        auto viewTr = camera.viewMatrix();
+        benchmark::DoNotOptimize(viewTr);
+    }
+}
+}  // namespace
+
+void registerDrawBenchmarks() {
+    if (!sShaderProgram()) {
+        std::cout << "Shaders failed to compile, the setUniform cases are skipped" << std::endl;
+    } else {
+        benchmark::RegisterBenchmark("ShaderProgram::setUniform/location", sSetUniformsByLocation);
+        benchmark::RegisterBenchmark("ShaderProgram::setUniform/name", sSetUniformsByName);
+    }
+    benchmark::RegisterBenchmark("UniformBlocks::setLights", sSetLights);
+    benchmark::RegisterBenchmark("UniformBlocks::setFrame", sSetFrame);
+    benchmark::RegisterBenchmark("Camera::viewMatrix", sViewMatrix);
+}
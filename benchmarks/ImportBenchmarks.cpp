@@ -0,0 +1,90 @@
+#include "Microbenchmarks.h"
+
+#include <benchmark/benchmark.h>
+#include <glad/glad.h>
+#include <string>
+
+#include "Model.h"
+#include "Utils.h"
+
+// the private import steps of a model that is already loaded
+struct ModelBenchmarkAccess {
+    // vertices converted
+    static size_t loadFromAiMesh(Model& model, const aiScene& scene) {
+        std::vector<Model::MeshData> meshesData;
+        model.loadFromAiMesh_(scene.mMeshes[0], &scene, 0, meshesData);
+        benchmark::DoNotOptimize(meshesData.data());
+        return meshesData.front().vertices.size();
+    }
+    static void clearTextures(Model& model) { model.textures_.clear(); }
+    static void createTexturesAndSetMaterial(Model& model) { model.createTexturesAndSetMaterial_(); }
+};
+
+namespace {
+// the meshes of the synthetic models are tiny, nothing is cached, so that the textures are decoded every time
+ModelLoadOptions sModelOptions() {
+    return ModelLoadOptions{.useMeshCache = false, .optimizeMeshes = false, .generateLods = false};
+}
+
+void sLoadFromAiMesh(benchmark::State& state) {
+    auto scene = makeGridScene(static_cast<int>(state.range(0)));
+    Model model(writeSyntheticModel(256), sModelOptions());
+    size_t verticesCount = 0;
+    for (auto _ : state) {
+        verticesCount = ModelBenchmarkAccess::loadFromAiMesh(model, *scene);
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * verticesCount));
+    state.counters["vertices"] = static_cast<double>(verticesCount);
+}
+
+void sCreateTexturesAndSetMaterial(benchmark::State& state) {
+    auto imageSize = static_cast<int>(state.range(0));
+    Model model(writeSyntheticModel(imageSize), sModelOptions());
+    for (auto _ : state) {
+        state.PauseTiming();
+        ModelBenchmarkAccess::clearTextures(model);
+        glFinish();
+        state.ResumeTiming();
+        ModelBenchmarkAccess::createTexturesAndSetMaterial(model);
+        // uploads are finished inside the measured time
+        glFinish();
+    }
+}
+
+// range(1) is the workers count, 1 converts on the calling thread
+void sCreateTextureFromImages(benchmark::State& state) {
+    auto images = writeSyntheticImages(static_cast<int>(state.range(0)));
+    auto workersCount = static_cast<size_t>(state.range(1));
+    for (auto _ : state) {
+        auto textureSet = Utils::createTextureFromImages(images, workersCount);
+        glFinish();
+        state.PauseTiming();
+        for (const auto& array : textureSet.arrays) {
+            glDeleteTextures(1, &array.id);
+        }
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * images.size()));
+}
+}  // namespace
+
+void registerImportBenchmarks(const MicrobenchmarkSizes& sizes) {
+    auto* loadFromAiMesh = benchmark::RegisterBenchmark("Model::loadFromAiMesh_", sLoadFromAiMesh);
+    for (auto verticesCount : sizes.meshVerticesCounts) {
+        loadFromAiMesh->Arg(verticesCount);
+    }
+    auto* createTextures =
+        benchmark::RegisterBenchmark("Model::createTexturesAndSetMaterial_", sCreateTexturesAndSetMaterial);
+    auto* createTextureFromImages =
+        benchmark::RegisterBenchmark("Utils::createTextureFromImages", sCreateTextureFromImages);
+    for (auto imageSize : sizes.imageSizes) {
+        createTextures->Arg(imageSize);
+        createTextureFromImages->Args({imageSize, 1})->Args({imageSize, 0});
+    }
+    loadFromAiMesh->Unit(benchmark::kMicrosecond);
+    createTextures->Unit(benchmark::kMillisecond);
+    createTextureFromImages->Unit(benchmark::kMillisecond);
+    // decoding happens on workers, the wall time is what a load waits for
+    createTextureFromImages->UseRealTime();
+    createTextures->UseRealTime();
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+#include <assimp/scene.h>
+
+// sizes of the synthetic inputs, set with --mesh-vertices and --image-sizes
+struct MicrobenchmarkSizes {
+    std::vector<int> meshVerticesCounts = {1 << 12, 1 << 16, 1 << 20};
+    std::vector<int> imageSizes = {256, 1024, 2048};
+};
+
+// the cases need the GL context created by main
+void registerImportBenchmarks(const MicrobenchmarkSizes& sizes);
+void registerDrawBenchmarks();
+
+// synthetic inputs are written once to <temp dir>/NACad/benchmarks and reused by later runs
+std::filesystem::path syntheticDirectory();
+// a grid of about verticesCount vertices with normals and texture coordinates, its material (index 1, Assimp
+// keeps 0 for the default one) has a diffuse and a specular image
+std::unique_ptr<aiScene> makeGridScene(int verticesCount);
+// PNGs of 1, 3 and 4 channels, half of them 3/4 of size, so that they are converted and resized to the
+// arrays of their class
+std::unordered_set<std::filesystem::path> writeSyntheticImages(int size);
+// OBJ file of a few quads, each with its own material textured by the images
+std::filesystem::path writeSyntheticModel(int imageSize);
@@ -0,0 +1,141 @@
+#include "Microbenchmarks.h"
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <fstream>
+#include <string>
+
+namespace fs = std::filesystem;
+
+namespace {
+// channels of the synthetic images, the 3 and 1 channel ones go to arrays of their own
+constexpr int cImageChannels[] = {4, 3, 1, 4, 3, 1};
+constexpr int cModelMaterialsCount{3};
+
+std::string sImageName(int size, size_t imageIdx) {
+    return "image_" + std::to_string(size) + "_" + std::to_string(imageIdx) + ".png";
+}
+
+// a gradient with a hashed noise, so that PNG decoding isn't trivial
+void sWriteImage(const fs::path& path, int width, int height, int channels) {
+    std::vector<unsigned char> pixels(static_cast<size_t>(width * height * channels));
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            for (int channel = 0; channel < channels; ++channel) {
+                auto noise = static_cast<unsigned int>(x * 73856093 ^ y * 19349663 ^ channel * 83492791);
+                auto value = (x * 255 / width + y * 255 / height) / 2 + static_cast<int>(noise % 32);
+                pixels[static_cast<size_t>((y * width + x) * channels + channel)] =
+                    static_cast<unsigned char>(std::min(value, 255));
+            }
+        }
+    }
+    stbi_write_png(path.string().c_str(), width, height, channels, pixels.data(), width * channels);
+}
+}  // namespace
+
+fs::path syntheticDirectory() {
+    std::error_code error;
+    auto tempDirectory = fs::temp_directory_path(error);
+    auto directory = (error ? fs::path(".") : tempDirectory) / "NACad" / "benchmarks";
+    fs::create_directories(directory, error);
+    return directory;
+}
+
+std::unique_ptr<aiScene> makeGridScene(int verticesCount) {
+    auto side = static_cast<unsigned int>(std::ceil(std::sqrt(static_cast<double>(verticesCount))));
+    side = std::max(side, 2u);
+    auto* mesh = new aiMesh();
+    mesh->mMaterialIndex = 1;
+    mesh->mPrimitiveTypes = aiPrimitiveType_TRIANGLE;
+    mesh->mNumVertices = side * side;
+    mesh->mVertices = new aiVector3D[mesh->mNumVertices];
+    mesh->mNormals = new aiVector3D[mesh->mNumVertices];
+    mesh->mTextureCoords[0] = new aiVector3D[mesh->mNumVertices];
+    mesh->mNumUVComponents[0] = 2;
+    for (unsigned int y = 0; y < side; ++y) {
+        for (unsigned int x = 0; x < side; ++x) {
+            auto u = static_cast<float>(x) / static_cast<float>(side - 1);
+            auto v = static_cast<float>(y) / static_cast<float>(side - 1);
+            // a gentle wave keeps the normals from being all the same
+            auto height = 0.1f * std::sin(6.0f * u) * std::cos(6.0f * v);
+            mesh->mVertices[y * side + x] = aiVector3D(u, height, v);
+            mesh->mNormals[y * side + x] = aiVector3D(0.0f, 1.0f, 0.0f);
+            mesh->mTextureCoords[0][y * side + x] = aiVector3D(u, v, 0.0f);
+        }
+    }
+    mesh->mNumFaces = 2 * (side - 1) * (side - 1);
+    mesh->mFaces = new aiFace[mesh->mNumFaces];
+    unsigned int faceIdx = 0;
+    for (unsigned int y = 0; y + 1 < side; ++y) {
+        for (unsigned int x = 0; x + 1 < side; ++x) {
+            auto corner = y * side + x;
+            for (auto triangle : {std::array{corner, corner + side, corner + 1},
+                                  std::array{corner + 1, corner + side, corner + side + 1}}) {
+                auto& face = mesh->mFaces[faceIdx++];
+                face.mNumIndices = 3;
+                face.mIndices = new unsigned int[3]{triangle[0], triangle[1], triangle[2]};
+            }
+        }
+    }
+
+    auto scene = std::make_unique<aiScene>();
+    scene->mNumMeshes = 1;
+    scene->mMeshes = new aiMesh*[1]{mesh};
+    scene->mNumMaterials = 2;
+    scene->mMaterials = new aiMaterial*[2]{new aiMaterial(), new aiMaterial()};
+    aiString diffuseImage(sImageName(256, 0));
+    aiString specularImage(sImageName(256, 1));
+    scene->mMaterials[1]->AddProperty(&diffuseImage, AI_MATKEY_TEXTURE_DIFFUSE(0));
+    scene->mMaterials[1]->AddProperty(&specularImage, AI_MATKEY_TEXTURE_SPECULAR(0));
+    scene->mRootNode = new aiNode();
+    scene->mRootNode->mNumMeshes = 1;
+    scene->mRootNode->mMeshes = new unsigned int[1]{0};
+    return scene;
+}
+
+std::unordered_set<fs::path> writeSyntheticImages(int size) {
+    auto directory = syntheticDirectory();
+    std::unordered_set<fs::path> images;
+    for (size_t imageIdx = 0; imageIdx < std::size(cImageChannels); ++imageIdx) {
+        auto path = directory / sImageName(size, imageIdx);
+        if (!fs::exists(path)) {
+            auto imageSize = imageIdx % 2 == 0 ? size : size * 3 / 4;
+            sWriteImage(path, imageSize, imageSize, cImageChannels[imageIdx]);
+        }
+        images.insert(path);
+    }
+    return images;
+}
+
+fs::path writeSyntheticModel(int imageSize) {
+    writeSyntheticImages(imageSize);
+    auto directory = syntheticDirectory();
+    auto modelName = "model_" + std::to_string(imageSize);
+    auto modelPath = directory / (modelName + ".obj");
+    if (fs::exists(modelPath)) {
+        return modelPath;
+    }
+    std::ofstream materials(directory / (modelName + ".mtl"), std::ios::trunc);
+    std::ofstream model(modelPath, std::ios::trunc);
+    model << "mtllib " << modelName << ".mtl\n";
+    for (int materialIdx = 0; materialIdx < cModelMaterialsCount; ++materialIdx) {
+        // the images of a material follow each other, so every material mixes channel counts
+        materials << "newmtl material" << materialIdx << "\n"
+                  << "map_Kd " << sImageName(imageSize, 2 * materialIdx) << "\n"
+                  << "map_Ks " << sImageName(imageSize, 2 * materialIdx + 1) << "\n";
+        auto x = static_cast<float>(materialIdx);
+        model << "v " << x << " 0 0\nv " << x + 1.0f << " 0 0\nv " << x + 1.0f << " 1 0\nv " << x << " 1 0\n"
+              << "vt 0 0\nvt 1 0\nvt 1 1\nvt 0 1\nvn 0 0 1\n"
+              << "usemtl material" << materialIdx << "\n";
+        auto first = 4 * materialIdx + 1;
+        model << "f";
+        for (int corner = 0; corner < 4; ++corner) {
+            model << " " << first + corner << "/" << first + corner << "/" << materialIdx + 1;
+        }
+        model << "\n";
+    }
+    return modelPath;
+}
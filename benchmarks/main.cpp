@@ -0,0 +1,105 @@
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+#include <glad/glad.h>
+#include <benchmark/benchmark.h>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Microbenchmarks.h"
+
+namespace {
+std::vector<int> sParseSizes(const std::string& list) {
+    std::vector<int> sizes;
+    std::stringstream stream(list);
+    std::string size;
+    while (std::getline(stream, size, ',')) {
+        if (auto value = std::atoi(size.c_str()); value > 0) {
+            sizes.push_back(value);
+        }
+    }
+    return sizes;
+}
+
+// the GLFW null platform with a surfaceless EGL or OSMesa context, e.g. Mesa llvmpipe on CI. With a display a
+// hidden window is enough
+GLFWwindow* sCreateContext(bool isHeadless) {
+    if (isHeadless) {
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+    }
+    if (!glfwInit()) {
+        return nullptr;
+    }
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    if (isHeadless) {
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+    }
+    auto* window = glfwCreateWindow(64, 64, "NACadBenchmarks", nullptr, nullptr);
+    if (!window && isHeadless) {
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+        window = glfwCreateWindow(64, 64, "NACadBenchmarks", nullptr, nullptr);
+    }
+    if (window) {
+        glfwMakeContextCurrent(window);
+    }
+    return window;
+}
+}  // namespace
+
+// NACadBenchmarks [--mesh-vertices N,N,...] [--image-sizes N,N,...] [--window] [Google Benchmark flags].
+// Results go to microbenchmarks.json unless --benchmark_out is given
+int main(int argc, char* argv[]) {
+    MicrobenchmarkSizes sizes;
+    auto isHeadless = true;
+    auto hasOutput = false;
+    std::vector<char*> benchmarkArgs{argv[0]};
+    for (int argIdx = 1; argIdx < argc; ++argIdx) {
+        std::string arg = argv[argIdx];
+        auto hasValue = argIdx + 1 < argc;
+        if (arg == "--mesh-vertices" && hasValue) {
+            sizes.meshVerticesCounts = sParseSizes(argv[++argIdx]);
+        } else if (arg == "--image-sizes" && hasValue) {
+            sizes.imageSizes = sParseSizes(argv[++argIdx]);
+        } else if (arg == "--window") {
+            isHeadless = false;
+        } else {
+            hasOutput = hasOutput || arg.starts_with("--benchmark_out=");
+            benchmarkArgs.push_back(argv[argIdx]);
+        }
+    }
+    std::string outputArg = "--benchmark_out=microbenchmarks.json";
+    std::string formatArg = "--benchmark_out_format=json";
+    if (!hasOutput) {
+        benchmarkArgs.push_back(outputArg.data());
+        benchmarkArgs.push_back(formatArg.data());
+    }
+
+    if (!sCreateContext(isHeadless)) {
+        std::cout << "Failed to create GL context" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+        std::cout << "Failed to initialize GLAD" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+
+    auto benchmarkArgc = static_cast<int>(benchmarkArgs.size());
+    benchmark::Initialize(&benchmarkArgc, benchmarkArgs.data());
+    if (benchmark::ReportUnrecognizedArguments(benchmarkArgc, benchmarkArgs.data())) {
+        glfwTerminate();
+        return -1;
+    }
+    registerImportBenchmarks(sizes);
+    registerDrawBenchmarks();
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    glfwTerminate();
+    return 0;
+}
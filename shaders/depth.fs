@@ -0,0 +1,5 @@
+#version 330 core
+
+// depth pre-pass, only the depth of the fragments is written, see RenderQueue::setDepthPrepass
+void main(){
+}
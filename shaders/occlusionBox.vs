@@ -0,0 +1,19 @@
+#version 330 core
+
+// corners of the unit cube, stretched to the world bounds of the tested mesh, see OcclusionCuller
+layout(location = 0) in vec3 aPos;
+
+uniform vec3 boxMin;
+uniform vec3 boxMax;
+
+// filled once per frame by UniformBlocks, the same declaration is in shader.vs
+layout(std140) uniform FrameData {
+    mat4 viewTr;
+    mat4 projectionTr;
+    vec3 viewPosition;
+    float time;
+};
+
+void main() {
+    gl_Position = projectionTr * viewTr * vec4(mix(boxMin, boxMax, aPos), 1.0);
+}
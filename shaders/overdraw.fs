@@ -0,0 +1,9 @@
+#version 330 core
+
+out vec4 FragColor;
+
+// every shaded fragment adds this with additive blending: red saturates at 8 layers, green at 16 and blue at
+// 32, so the image goes from dark red through orange and yellow to white with the overdraw
+void main(){
+    FragColor = vec4(0.125, 0.0625, 0.03125, 1.0);
+}
@@ -1,115 +1,175 @@
 #version 330 core
 
+// a record of the material table, see MaterialTable
 struct MaterialData {
     vec3 color;
-    int diffuseLayersIndices[256];
-    int specularLayersIndices[256];
-    int emissionLayersIndices[256];
+    float shininess;
     int diffuseLayersCount;
     int specularLayersCount;
     int emissionLayersCount;
-    float shininess;
+    // diffuse, specular and emission layers follow each other in materialLayers from here
+    int firstLayer;
 };
 
+// members are ordered so that every vec3 is followed by a float and the std140 layout has no holes, see
+// the mirrors in UniformBlocks.h
 struct GlobalLight{
     vec3 color;
+    float ambientIntence;
     // position is a synonim to -direction
     vec3 position;
-
-    float ambientIntence;
     float diffuseIntence;
     float specularIntence;
 };
 
-struct PointLight{
+// a point or a spot light of LightClusters
+struct Light{
     vec3 color;
-    vec3 position;
-
-    float constant;
-    float linear;
-    float quadratic;
-
     float ambientIntence;
-    float diffuseIntence;
-    float specularIntence;
-};
-
-struct SpotLight{
-    vec3 color;
     vec3 position;
+    float diffuseIntence;
     vec3 direction;
-
-    float cutOff;
-    float outerCutOff;
+    float specularIntence;
 
     float constant;
     float linear;
     float quadratic;
+    // the light fades out to nothing here
+    float range;
 
-    float ambientIntence;
-    float diffuseIntence;
-    float specularIntence;
+    float cutOff;
+    float outerCutOff;
+    bool isSpot;
 };
 
-#define NR_POINT_LIGHTS 4
+#define MAX_TEXTURE_ARRAYS 8
+
+// features of a variant, ShaderVariants defines them above. Without them the layer counts come from the
+// material record and all lights are evaluated, which handles every material
+#ifndef DIFFUSE_LAYERS
+#define DIFFUSE_LAYERS material.diffuseLayersCount
+#endif
+#ifndef SPECULAR_LAYERS
+#define SPECULAR_LAYERS material.specularLayersCount
+#endif
+#ifndef EMISSION_LAYERS
+#define EMISSION_LAYERS material.emissionLayersCount
+#endif
+#ifndef GLOBAL_LIGHT
+#define GLOBAL_LIGHT 1
+#endif
+#ifndef LOCAL_LIGHTS
+#define LOCAL_LIGHTS 1
+#endif
 
 in vec2 TexCoord;
 in vec3 FragPosition;
 in vec3 Normal;
+// index in the material table, the mesh or the instance one
+flat in int FragMaterial;
+
+// two texels per material: color and shininess as float bits, then layers counts and the first layer
+uniform isamplerBuffer materialRecords;
+// packed layer refs, see sampleLayer
+uniform isamplerBuffer materialLayers;
+uniform sampler2DArray textureArrays[MAX_TEXTURE_ARRAYS];
+// five texels per light, see loadLight
+uniform samplerBuffer lightRecords;
+// offset in clusterLights and count of the lights of every cluster, see LightClusters
+uniform isamplerBuffer clusterLists;
+uniform isamplerBuffer clusterLights;
 
-uniform MaterialData material;
-uniform sampler2DArray textureArray;
-uniform GlobalLight globalLight;
-uniform PointLight pointlights[NR_POINT_LIGHTS];
-uniform SpotLight spotLight;
-uniform vec3 viewPosition;
-uniform float time;
+MaterialData material;
+
+// filled once per frame by UniformBlocks, the same declaration is in shader.vs
+layout(std140) uniform FrameData {
+    mat4 viewTr;
+    mat4 projectionTr;
+    vec3 viewPosition;
+    float time;
+};
+
+layout(std140) uniform LightsData {
+    GlobalLight globalLight;
+};
+
+// the view frustum split into tiles of clusterTileSize pixels and exponential depth slices, a fragment is in
+// slice log(depth) * sliceScale + sliceBias
+layout(std140) uniform ClusterData {
+    vec2 clusterTileSize;
+    float sliceScale;
+    float sliceBias;
+    ivec3 clustersCount;
+    int lightsCount;
+    // otherwise every fragment evaluates all lights
+    int clusteredLighting;
+};
 
 out vec4 FragColor;
 
 vec3 calcGlobalLight(GlobalLight light, vec3 normal, vec3 viewDir, vec3 diffuseTextureSum, vec3 specularTextureSum);
-vec3 calcPointLight(PointLight light, vec3 fragPosition, vec3 normal, vec3 viewDir, vec3 diffuseTextureSum, vec3 specularTextureSum);
-vec3 calcSpotLight(SpotLight light, vec3 fragPosition, vec3 normal, vec3 viewDir, vec3 diffuseTextureSum, vec3 specularTextureSum);
+vec3 calcLight(Light light, vec3 fragPosition, vec3 normal, vec3 viewDir, vec3 diffuseTextureSum, vec3 specularTextureSum);
+Light loadLight(int index);
+vec3 sampleLayer(int layerRef, vec2 texCoord);
+MaterialData loadMaterial(int index);
 
 void main(){  
+    material = loadMaterial(FragMaterial);
+    int specularFirstLayer = material.firstLayer + material.diffuseLayersCount;
+    int emissionFirstLayer = specularFirstLayer + material.specularLayersCount;
 
     // textures blending. Not sure if we realy need to blend them or sum is enough   
+    // with the constant counts of a variant the loops unroll and the empty ones disappear
     vec3 diffuseTextureSum = vec3(0.0,0.0,0.0);
-    if(material.diffuseLayersCount > 0){
-        for(int i = 0; i < material.diffuseLayersCount; ++i){
-            int layerIndex = material.diffuseLayersIndices[i];
-            diffuseTextureSum += texture(textureArray, vec3(TexCoord, float(layerIndex))).rgb;
+    if(DIFFUSE_LAYERS > 0){
+        for(int i = 0; i < DIFFUSE_LAYERS; ++i){
+            int layerIndex = texelFetch(materialLayers, material.firstLayer + i).x;
+            diffuseTextureSum += sampleLayer(layerIndex, TexCoord);
         }
-        diffuseTextureSum /= float(material.diffuseLayersCount);
+        diffuseTextureSum /= float(DIFFUSE_LAYERS);
     }
 
     vec3 specularTextureSum = vec3(0.0,0.0,0.0);
-    if(material.specularLayersCount > 0){
-        for(int i = 0; i < material.specularLayersCount; ++i){
-            int layerIndex = material.specularLayersIndices[i];
-            specularTextureSum += texture(textureArray, vec3(TexCoord, float(layerIndex))).rgb;
+    if(SPECULAR_LAYERS > 0){
+        for(int i = 0; i < SPECULAR_LAYERS; ++i){
+            int layerIndex = texelFetch(materialLayers, specularFirstLayer + i).x;
+            specularTextureSum += sampleLayer(layerIndex, TexCoord);
         }
-        specularTextureSum /= float(material.specularLayersCount);
+        specularTextureSum /= float(SPECULAR_LAYERS);
     }
 
     vec3 emissionTextureSum = vec3(0.0,0.0,0.0);
-    if(material.emissionLayersCount > 0){
-        for(int i = 0; i < material.emissionLayersCount; ++i){
-            int layerIndex = material.emissionLayersIndices[i];
-            emissionTextureSum += texture(textureArray, vec3(TexCoord + vec2(0.0, time), float(layerIndex))).rgb;
+    if(EMISSION_LAYERS > 0){
+        for(int i = 0; i < EMISSION_LAYERS; ++i){
+            int layerIndex = texelFetch(materialLayers, emissionFirstLayer + i).x;
+            emissionTextureSum += sampleLayer(layerIndex, TexCoord + vec2(0.0, time));
         }
-        emissionTextureSum /= float(material.emissionLayersCount);  
+        emissionTextureSum /= float(EMISSION_LAYERS);  
     }
 
     vec3 normal = normalize(Normal);
     vec3 viewDirection = normalize(viewPosition - FragPosition);
     
     vec3 result = vec3(0.0,0.0,0.0);
+#if GLOBAL_LIGHT
     result += calcGlobalLight(globalLight, normal, viewDirection, diffuseTextureSum, specularTextureSum);
-    for(int i = 0; i < NR_POINT_LIGHTS; ++i){
-       result += calcPointLight(pointlights[i], FragPosition, normal, viewDirection, diffuseTextureSum, specularTextureSum);
+#endif
+#if LOCAL_LIGHTS
+    if(clusteredLighting != 0){
+        float viewDepth = -(viewTr * vec4(FragPosition, 1.0)).z;
+        ivec3 cluster = ivec3(ivec2(gl_FragCoord.xy / clusterTileSize), int(floor(log(viewDepth) * sliceScale + sliceBias)));
+        cluster = clamp(cluster, ivec3(0), clustersCount - 1);
+        ivec2 list = texelFetch(clusterLists, (cluster.z * clustersCount.y + cluster.y) * clustersCount.x + cluster.x).xy;
+        for(int i = 0; i < list.y; ++i){
+            Light light = loadLight(texelFetch(clusterLights, list.x + i).x);
+            result += calcLight(light, FragPosition, normal, viewDirection, diffuseTextureSum, specularTextureSum);
+        }
+    } else {
+        for(int i = 0; i < lightsCount; ++i){
+            result += calcLight(loadLight(i), FragPosition, normal, viewDirection, diffuseTextureSum, specularTextureSum);
+        }
     }
-    result += calcSpotLight(spotLight, FragPosition, normal, viewDirection, diffuseTextureSum, specularTextureSum);
+#endif
 
     // emission
     vec3 emission = emissionTextureSum * floor(vec3(1.0) - specularTextureSum);
@@ -120,6 +180,59 @@ void main(){
     FragColor = vec4(result, 1.0);
 }
 
+MaterialData loadMaterial(int index){
+    ivec4 colorTexel = texelFetch(materialRecords, 2 * index);
+    ivec4 layersTexel = texelFetch(materialRecords, 2 * index + 1);
+    MaterialData data;
+    data.color = intBitsToFloat(colorTexel.xyz);
+    data.shininess = intBitsToFloat(colorTexel.w);
+    data.diffuseLayersCount = layersTexel.x;
+    data.specularLayersCount = layersTexel.y;
+    data.emissionLayersCount = layersTexel.z;
+    data.firstLayer = layersTexel.w;
+    return data;
+}
+
+Light loadLight(int index){
+    vec4 colorTexel = texelFetch(lightRecords, 5 * index);
+    vec4 positionTexel = texelFetch(lightRecords, 5 * index + 1);
+    vec4 directionTexel = texelFetch(lightRecords, 5 * index + 2);
+    vec4 attenuationTexel = texelFetch(lightRecords, 5 * index + 3);
+    vec4 coneTexel = texelFetch(lightRecords, 5 * index + 4);
+    Light light;
+    light.color = colorTexel.rgb;
+    light.ambientIntence = colorTexel.a;
+    light.position = positionTexel.xyz;
+    light.diffuseIntence = positionTexel.w;
+    light.direction = directionTexel.xyz;
+    light.specularIntence = directionTexel.w;
+    light.constant = attenuationTexel.x;
+    light.linear = attenuationTexel.y;
+    light.quadratic = attenuationTexel.z;
+    light.range = attenuationTexel.w;
+    light.cutOff = coneTexel.x;
+    light.outerCutOff = coneTexel.y;
+    light.isSpot = coneTexel.z != 0.0;
+    return light;
+}
+
+// layerRef keeps texture array slot in the high 16 bits and layer in the low 16 bits
+vec3 sampleLayer(int layerRef, vec2 texCoord){
+    vec3 coord = vec3(texCoord, float(layerRef & 0xFFFF));
+    // arrays of samplers can be indexed only by constant expressions in GLSL 3.30
+    switch(layerRef >> 16){
+        case 0: return texture(textureArrays[0], coord).rgb;
+        case 1: return texture(textureArrays[1], coord).rgb;
+        case 2: return texture(textureArrays[2], coord).rgb;
+        case 3: return texture(textureArrays[3], coord).rgb;
+        case 4: return texture(textureArrays[4], coord).rgb;
+        case 5: return texture(textureArrays[5], coord).rgb;
+        case 6: return texture(textureArrays[6], coord).rgb;
+        case 7: return texture(textureArrays[7], coord).rgb;
+    }
+    return vec3(0.0);
+}
+
 vec3 calcGlobalLight(GlobalLight light, vec3 normal, vec3 viewDir, vec3 diffuseTextureSum, vec3 specularTextureSum){
     vec3 position = normalize(light.position);
     
@@ -136,7 +249,7 @@ vec3 calcGlobalLight(GlobalLight light, vec3 normal, vec3 viewDir, vec3 diffuseT
     return ambient + diffuse + specular;
 }
 
-vec3 calcPointLight(PointLight light, vec3 fragPosition, vec3 normal, vec3 viewDir, vec3 diffuseTextureSum, vec3 specularTextureSum){
+vec3 calcLight(Light light, vec3 fragPosition, vec3 normal, vec3 viewDir, vec3 diffuseTextureSum, vec3 specularTextureSum){
     vec3 lightDirection = normalize(light.position - fragPosition);
 
     // ambient
@@ -147,30 +260,17 @@ vec3 calcPointLight(PointLight light, vec3 fragPosition, vec3 normal, vec3 viewD
     vec3 reflectDirection = reflect(-lightDirection, normal);
     float specularIntence = pow(max(dot(viewDir, reflectDirection), 0.0), material.shininess);
     vec3 specular = specularIntence * light.specularIntence * light.color * specularTextureSum;
-    // attenuation 
-    float distance = length(light.position - fragPosition);
-    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));   
-
-    return (ambient + diffuse + specular)*attenuation;
-}
-
-vec3 calcSpotLight(SpotLight light, vec3 fragPosition, vec3 normal, vec3 viewDir, vec3 diffuseTextureSum, vec3 specularTextureSum){
-    vec3 toFragDir = normalize(light.position - fragPosition);
-    
-    // ambient
-    vec3 ambient = light.ambientIntence * light.color * diffuseTextureSum;
-    // diffuse
-    vec3 diffuse = max(dot(normal,toFragDir), 0.0) * (light.diffuseIntence * light.color) * diffuseTextureSum;
-    // specular
-    vec3 reflectDirection = reflect(-toFragDir, normal);
-    float specularIntence = pow(max(dot(viewDir, reflectDirection), 0.0), material.shininess);
-    vec3 specular = specularIntence * light.specularIntence * light.color * specularTextureSum;
-    // attenuation
+    // attenuation, faded out towards the range so that the light ends smoothly at the clusters it reaches
     float distance = length(light.position - fragPosition);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));   
+    float fade = clamp(1.0 - pow(distance / light.range, 4.0), 0.0, 1.0);
+    attenuation *= fade * fade;
     // intensity
-    float theta = dot(toFragDir, normalize(-light.direction));
-    float epsilon = light.cutOff - light.outerCutOff;
-    float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
-    return (ambient+diffuse+specular)*attenuation*intensity;
-}
\ No newline at end of file
+    float intensity = 1.0;
+    if(light.isSpot){
+        float theta = dot(lightDirection, normalize(-light.direction));
+        float epsilon = light.cutOff - light.outerCutOff;
+        intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
+    }
+    return (ambient + diffuse + specular)*attenuation*intensity;
+}
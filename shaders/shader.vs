@@ -1,21 +1,57 @@
 #version 330 core
 
+// compact vertices: aPos is normalized to the mesh bounds, aNormal.xy holds the octahedral encoded normal
 layout(location = 0) in vec3 aPos;
 layout(location = 1) in vec3 aNormal;
 layout(location = 2) in vec2 aTextureCoords;
+// per instance attributes of instanced draws, see InstanceBuffer. The transform takes locations 3 to 6
+layout(location = 3) in mat4 aInstanceModelTr;
+layout(location = 7) in int aInstanceMaterial;
 
 uniform mat4 localTr;
 uniform mat4 modelTr;
-uniform mat4 viewTr;
-uniform mat4 projectionTr;
+uniform int materialIndex;
+uniform bool instanced;
+
+// filled once per frame by UniformBlocks, the same declaration is in shader.fs
+layout(std140) uniform FrameData {
+    mat4 viewTr;
+    mat4 projectionTr;
+    vec3 viewPosition;
+    float time;
+};
+
+uniform bool compactVertices;
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+// the depth pre-pass and the shading pass compute the same depth, see RenderQueue::setDepthPrepass
+invariant gl_Position;
 
 out vec3 Normal;
 out vec2 TexCoord;
 out vec3 FragPosition;
+flat out int FragMaterial;
+
+vec3 decodeOctahedral(vec2 encoded) {
+    vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    if (normal.z < 0.0) {
+        normal.xy = (1.0 - abs(normal.yx)) * vec2(normal.x >= 0.0 ? 1.0 : -1.0, normal.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(normal);
+}
 
 void main() {
-    gl_Position = projectionTr * viewTr * modelTr * localTr * vec4(aPos, 1.0f);
-    FragPosition = vec3(modelTr * localTr * vec4(aPos, 1.0f));
-    Normal = mat3(transpose(inverse(modelTr * localTr))) * aNormal;
+    vec3 position = aPos;
+    vec3 normal = aNormal;
+    if (compactVertices) {
+        position = positionOffset + aPos * positionScale;
+        normal = decodeOctahedral(aNormal.xy);
+    }
+    mat4 worldTr = (instanced ? aInstanceModelTr : modelTr) * localTr;
+    gl_Position = projectionTr * viewTr * worldTr * vec4(position, 1.0f);
+    FragPosition = vec3(worldTr * vec4(position, 1.0f));
+    Normal = mat3(transpose(inverse(worldTr))) * normal;
+    FragMaterial = instanced ? aInstanceMaterial : materialIndex;
     TexCoord = aTextureCoords;
-}
\ No newline at end of file
+}
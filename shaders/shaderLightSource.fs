@@ -1,11 +1,14 @@
 #version 330 core
 
 in vec2 TexCoord;
+// the material color is the light color, see MaterialTable
+flat in int FragMaterial;
 
-uniform vec3 sourceColor;
+uniform isamplerBuffer materialRecords;
 
 out vec4 FragColor;
 
 void main(){  
+    vec3 sourceColor = intBitsToFloat(texelFetch(materialRecords, 2 * FragMaterial).xyz);
     FragColor = vec4(sourceColor, 1.0);
-}
\ No newline at end of file
+}
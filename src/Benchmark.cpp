@@ -0,0 +1,251 @@
+#include "Benchmark.h"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include "GeometryArena.h"
+#include "LightClusters.h"
+#include "MaterialTable.h"
+#include "Model.h"
+#include "ProgramCache.h"
+#include "RenderQueue.h"
+#include "ShaderVariants.h"
+#include "UniformBlocks.h"
+#include "camera.h"
+
+namespace {
+// the camera stays this many bounding radii away from the center of the model
+constexpr float cOrbitDistance{2.5f};
+// clip planes in bounding radii, the model is between cOrbitDistance - 1 and about 1.1 * cOrbitDistance + 1
+// radii from the camera as it bobs
+constexpr float cNearPlaneRadii{0.5f * (cOrbitDistance - 1.0f)};
+constexpr float cFarPlaneRadii{2.0f * cOrbitDistance};
+
+struct FrameRecord {
+    double frameMs;
+    RenderQueue::Stats renderStats;
+};
+
+// nearest rank, values are sorted
+double sPercentile(const std::vector<double>& values, double percent) {
+    auto rank = static_cast<size_t>(std::ceil(percent / 100.0 * static_cast<double>(values.size())));
+    return values[std::clamp(rank, size_t{1}, values.size()) - 1];
+}
+
+std::string sJsonString(const std::string& value) {
+    std::string result = "\"";
+    for (auto symbol : value) {
+        if (symbol == '"' || symbol == '\\') {
+            result += '\\';
+        }
+        result += symbol;
+    }
+    return result + "\"";
+}
+
+// offscreen color and depth targets, the same size whatever the window is
+class OffscreenTarget {
+   public:
+    OffscreenTarget(int width, int height) {
+        glGenFramebuffers(1, &framebuffer_);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+        glGenRenderbuffers(2, renderbuffers_);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers_[0]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers_[0]);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers_[1]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER,
+                                  renderbuffers_[1]);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        isComplete_ = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    }
+    ~OffscreenTarget() {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &framebuffer_);
+        glDeleteRenderbuffers(2, renderbuffers_);
+    }
+    OffscreenTarget(const OffscreenTarget&) = delete;
+    OffscreenTarget& operator=(const OffscreenTarget&) = delete;
+
+    bool isComplete() const { return isComplete_; }
+
+   private:
+    unsigned int framebuffer_;
+    unsigned int renderbuffers_[2];
+    bool isComplete_;
+};
+
+bool sWriteReport(const BenchmarkOptions& options, const std::vector<FrameRecord>& frames) {
+    std::vector<double> frameTimes;
+    for (const auto& frame : frames) {
+        frameTimes.push_back(frame.frameMs);
+    }
+    std::ranges::sort(frameTimes);
+    auto mean = [&](auto field) {
+        double sum = 0.0;
+        for (const auto& frame : frames) {
+            sum += static_cast<double>(field(frame));
+        }
+        return sum / static_cast<double>(frames.size());
+    };
+    auto meanMs = std::accumulate(frameTimes.begin(), frameTimes.end(), 0.0) / frameTimes.size();
+    auto* renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+    auto pixelsCount = static_cast<double>(options.width) * static_cast<double>(options.height);
+
+    std::ofstream file(options.outputPath, std::ios::trunc);
+    file << "{\n"
+         << "  \"model\": " << sJsonString(options.modelPath.string()) << ",\n"
+         << "  \"renderer\": " << sJsonString(renderer ? renderer : "") << ",\n"
+         << "  \"width\": " << options.width << ",\n"
+         << "  \"height\": " << options.height << ",\n"
+         << "  \"depthPrepass\": " << (options.depthPrepass ? "true" : "false") << ",\n"
+         << "  \"occlusionCulling\": " << (options.occlusionCulling ? "true" : "false") << ",\n"
+         << "  \"frames\": " << frames.size() << ",\n"
+         << "  \"frameMs\": {\"mean\": " << meanMs << ", \"p50\": " << sPercentile(frameTimes, 50.0)
+         << ", \"p95\": " << sPercentile(frameTimes, 95.0) << ", \"p99\": " << sPercentile(frameTimes, 99.0)
+         << ", \"min\": " << frameTimes.front() << ", \"max\": " << frameTimes.back() << "},\n"
+         << "  \"drawsPerFrame\": "
+         << mean([](const FrameRecord& frame) { return frame.renderStats.drawsCount; }) << ",\n"
+         << "  \"drawCallsPerFrame\": "
+         << mean([](const FrameRecord& frame) { return frame.renderStats.drawCallsCount; }) << ",\n"
+         << "  \"trianglesPerFrame\": "
+         << mean([](const FrameRecord& frame) { return frame.renderStats.trianglesCount; }) << ",\n"
+         << "  \"culledMeshesPerFrame\": "
+         << mean([](const FrameRecord& frame) { return frame.renderStats.culledMeshesCount; }) << ",\n"
+         << "  \"occludedMeshesPerFrame\": "
+         << mean([](const FrameRecord& frame) { return frame.renderStats.occludedMeshesCount; }) << ",\n"
+         << "  \"shadedFragmentsPerPixel\": "
+         << mean([](const FrameRecord& frame) { return frame.renderStats.shadedSamplesCount; }) / pixelsCount
+         << "\n"
+         << "}\n";
+    if (!file) {
+        std::cout << "Can't write benchmark report: " << options.outputPath << std::endl;
+        return false;
+    }
+    std::cout << frames.size() << " frames of " << options.modelPath << ", " << options.width << "x"
+              << options.height << ": mean " << meanMs << " ms, p50 " << sPercentile(frameTimes, 50.0)
+              << " ms, p95 " << sPercentile(frameTimes, 95.0) << " ms, p99 " << sPercentile(frameTimes, 99.0)
+              << " ms. Report: " << options.outputPath << std::endl;
+    return true;
+}
+}  // namespace
+
+bool runBenchmark(const BenchmarkOptions& options) {
+    if (options.framesCount <= 0 || options.width <= 0 || options.height <= 0) {
+        std::cout << "Benchmark needs a positive frames count and size" << std::endl;
+        return false;
+    }
+    OffscreenTarget target(options.width, options.height);
+    if (!target.isComplete()) {
+        std::cout << "Can't create the benchmark framebuffer" << std::endl;
+        return false;
+    }
+    glViewport(0, 0, options.width, options.height);
+    glEnable(GL_DEPTH_TEST);
+
+    ProgramCache programCache;
+    auto sceneShaders = ShaderVariants::createShaderVariants("shaders/shader.vs", "shaders/shader.fs",
+                                                             &programCache);
+    auto depthProgram =
+        ShaderProgram::createShaderProgram("shaders/shader.vs", "shaders/depth.fs", {}, &programCache);
+    auto occlusionBoxProgram =
+        ShaderProgram::createShaderProgram("shaders/occlusionBox.vs", "shaders/depth.fs", {}, &programCache);
+    if (!sceneShaders || !depthProgram || !occlusionBoxProgram) {
+        return false;
+    }
+    UniformBlocks uniformBlocks;
+    LightClusters lightClusters;
+    MaterialTable sceneMaterials;
+    GeometryArena sceneGeometry;
+    // loaded synchronously, every frame draws the whole model
+    Model model(options.modelPath, {.async = false,
+                                    .compressTextures = true,
+                                    .geometryArena = &sceneGeometry,
+                                    .materialTable = &sceneMaterials});
+    if (model.loadState() != ModelLoadState::Ready) {
+        std::cout << "Can't load the benchmark model: " << options.modelPath << std::endl;
+        return false;
+    }
+    model.update(0.0);
+
+    auto bounds = model.worldBounds();
+    auto center = (bounds.min + bounds.max) * 0.5f;
+    auto radius = std::max(glm::length(bounds.max - bounds.min) * 0.5f, 0.01f);
+
+    // lights of the viewer scene, moved to the model
+    GlobalLight globalLight;
+    globalLight.color = glm::vec3(1.0f, 0.925f, 0.5568f);
+    globalLight.position = glm::vec3(10.0f);
+    std::vector<PointLight> pointLights(4);
+    for (size_t lightIdx = 0; lightIdx < pointLights.size(); ++lightIdx) {
+        auto angle = glm::radians(90.0f * static_cast<float>(lightIdx));
+        pointLights[lightIdx].color = globalLight.color;
+        pointLights[lightIdx].position = center + radius * glm::vec3(std::cos(angle), 0.5f, std::sin(angle));
+    }
+    SpotLight spotLight;
+
+    Camera camera;
+    RenderQueue renderQueue;
+    OcclusionCuller occlusionCuller(*occlusionBoxProgram);
+    auto fieldOfView = glm::radians(camera.fieldOfView());
+    auto aspectRatio = static_cast<float>(options.width) / static_cast<float>(options.height);
+    // planes follow the size of the model, so that large models are not clipped away
+    auto nearPlane = cNearPlaneRadii * radius;
+    auto farPlane = cFarPlaneRadii * radius;
+    auto projectionTr = glm::perspective(fieldOfView, aspectRatio, nearPlane, farPlane);
+    auto pixelsPerUnit = static_cast<float>(options.height) / (2.0f * std::tan(fieldOfView / 2.0f));
+
+    std::vector<FrameRecord> frames;
+    frames.reserve(static_cast<size_t>(options.framesCount));
+    for (int frame = -options.warmupFramesCount; frame < options.framesCount; ++frame) {
+        auto startTime = std::chrono::steady_clock::now();
+        // one turn around the model while the camera bobs up and down twice
+        auto angle = 2.0f * glm::pi<float>() * static_cast<float>(frame) / options.framesCount;
+        auto offset = glm::vec3(std::cos(angle), 0.4f * std::sin(2.0f * angle), std::sin(angle));
+        camera.lookAt(center + cOrbitDistance * radius * offset, center);
+
+        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        spotLight.position = camera.position();
+        spotLight.direction = camera.front();
+        uniformBlocks.setLights(globalLight);
+        uniformBlocks.setFrame(camera.viewMatrix(), projectionTr, camera.position(), 0.0f);
+        lightClusters.update({.viewTr = camera.viewMatrix(),
+                              .fieldOfView = fieldOfView,
+                              .aspectRatio = aspectRatio,
+                              .near = nearPlane,
+                              .far = farPlane,
+                              .viewportSize = glm::vec2(options.width, options.height)},
+                             pointLights, std::span(&spotLight, 1));
+        sceneShaders->setLights(true, lightClusters.stats().lightsCount > 0);
+
+        model.update(0.0);
+        renderQueue.setFrustum(Frustum(projectionTr * camera.viewMatrix()));
+        renderQueue.setLodSelection(
+            {.viewPosition = camera.position(), .pixelsPerUnit = pixelsPerUnit, .maxScreenError = 1.0f});
+        renderQueue.setDepthPrepass(options.depthPrepass ? &*depthProgram : nullptr);
+        occlusionCuller.setView(camera.position(), nearPlane);
+        renderQueue.setOcclusionCuller(options.occlusionCulling ? &occlusionCuller : nullptr);
+        model.submit(renderQueue, *sceneShaders);
+        renderQueue.flush();
+        // the frame is measured until the GPU is done with it, there is no swap to pace it
+        glFinish();
+
+        auto frameTime = std::chrono::steady_clock::now() - startTime;
+        if (frame >= 0) {
+            frames.push_back(
+                {std::chrono::duration<double, std::milli>(frameTime).count(), renderQueue.stats()});
+        }
+    }
+    return sWriteReport(options, frames);
+}
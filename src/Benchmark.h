@@ -0,0 +1,26 @@
+#pragma once
+
+#include <filesystem>
+
+struct BenchmarkOptions {
+    std::filesystem::path modelPath = "samples/backpack/backpack.obj";
+    int framesCount = 600;
+    // drawn before measuring, they fill the caches and let clocks settle
+    int warmupFramesCount = 30;
+    int width = 1280;
+    int height = 720;
+    std::filesystem::path outputPath = "benchmark.json";
+    // see RenderQueue::setDepthPrepass
+    bool depthPrepass = false;
+    // see OcclusionCuller
+    bool occlusionCulling = false;
+    // the context is surfaceless (EGL or OSMesa of the GLFW null platform) instead of a hidden window, see
+    // main. Works on Mesa llvmpipe without a GPU
+    bool headless = false;
+};
+
+// renders the model into an offscreen framebuffer from a camera orbiting it once over framesCount frames, and
+// writes frame time statistics (mean, p50, p95, p99), draw and triangle counts to outputPath as JSON. The
+// path depends only on the frame index, so runs are comparable. Needs a current GL context, returns false if
+// the model fails to load or the output can't be written
+bool runBenchmark(const BenchmarkOptions& options);
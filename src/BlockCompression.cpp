@@ -0,0 +1,504 @@
+#include "BlockCompression.h"
+#include "Utils.h"
+
+#include <glad/glad.h>
+#include <stb_dxt.h>
+#include <stb_image_resize2.h>
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+namespace {
+namespace fs = std::filesystem;
+
+constexpr size_t cDdsHeaderSize{128};
+constexpr size_t cDdsDx10HeaderSize{20};
+constexpr std::array<unsigned char, 12> cKtx2Identifier{0xAB, 'K',  'T',  'X',  ' ',  '2',
+                                                        '0',  0xBB, '\r', '\n', 0x1A, '\n'};
+constexpr size_t cKtx2HeaderSize{80};
+constexpr size_t cKtx2LevelIndexEntrySize{24};
+// enough to parse DDS and KTX2 headers including the KTX2 index of a full mip chain
+constexpr size_t cProbeSize{cKtx2HeaderSize + 16 * cKtx2LevelIndexEntrySize};
+
+constexpr uint32_t sFourCC(const char (&code)[5]) {
+    return static_cast<uint32_t>(code[0]) | static_cast<uint32_t>(code[1]) << 8 |
+           static_cast<uint32_t>(code[2]) << 16 | static_cast<uint32_t>(code[3]) << 24;
+}
+
+// DXGI_FORMAT values of the DDS DX10 header
+enum DxgiFormat : uint32_t {
+    cDxgiBC1 = 71,
+    cDxgiBC3 = 77,
+    cDxgiBC4 = 80,
+    cDxgiBC5 = 83,
+    cDxgiBC7 = 98,
+};
+
+// VkFormat values of KTX2
+enum VkFormat : uint32_t {
+    cVkBC1Rgb = 131,
+    cVkBC1Rgba = 133,
+    cVkBC3 = 137,
+    cVkBC4 = 139,
+    cVkBC5 = 141,
+    cVkBC7 = 145,
+};
+
+template <typename T>
+T sRead(const std::vector<unsigned char>& bytes, size_t offset) {
+    T value;
+    std::memcpy(&value, bytes.data() + offset, sizeof(T));
+    return value;
+}
+
+template <typename T>
+void sWrite(std::vector<unsigned char>& bytes, size_t offset, T value) {
+    std::memcpy(bytes.data() + offset, &value, sizeof(T));
+}
+
+std::optional<std::vector<unsigned char>> sReadFile(const fs::path& path, size_t maxSize) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return {};
+    }
+    std::error_code error;
+    auto fileSize = fs::file_size(path, error);
+    if (error) {
+        return {};
+    }
+    std::vector<unsigned char> bytes(std::min<uintmax_t>(fileSize, maxSize));
+    file.read(reinterpret_cast<char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    if (!file) {
+        return {};
+    }
+    return bytes;
+}
+
+int sLevelDimension(int dimension, int level) { return std::max(1, dimension >> level); }
+
+int sBlockBytes(BlockFormat format) {
+    return format == BlockFormat::BC1 || format == BlockFormat::BC4 ? 8 : 16;
+}
+
+// header and offset of the first level
+std::optional<std::pair<CompressedImageHeader, size_t>> sParseDds(const std::vector<unsigned char>& bytes) {
+    if (bytes.size() < cDdsHeaderSize || std::memcmp(bytes.data(), "DDS ", 4) != 0) {
+        return {};
+    }
+    CompressedImageHeader header;
+    header.height = static_cast<int>(sRead<uint32_t>(bytes, 12));
+    header.width = static_cast<int>(sRead<uint32_t>(bytes, 16));
+    header.levelsCount = std::max(1, static_cast<int>(sRead<uint32_t>(bytes, 28)));
+    auto fourCC = sRead<uint32_t>(bytes, 84);
+    size_t dataOffset = cDdsHeaderSize;
+    if (fourCC == sFourCC("DX10")) {
+        if (bytes.size() < cDdsHeaderSize + cDdsDx10HeaderSize || sRead<uint32_t>(bytes, 140) > 1) {
+            return {};
+        }
+        dataOffset += cDdsDx10HeaderSize;
+        switch (sRead<uint32_t>(bytes, 128)) {
+            case cDxgiBC1:
+                header.format = BlockFormat::BC1;
+                break;
+            case cDxgiBC3:
+                header.format = BlockFormat::BC3;
+                break;
+            case cDxgiBC4:
+                header.format = BlockFormat::BC4;
+                break;
+            case cDxgiBC5:
+                header.format = BlockFormat::BC5;
+                break;
+            case cDxgiBC7:
+                header.format = BlockFormat::BC7;
+                break;
+            default:
+                return {};
+        }
+    } else if (fourCC == sFourCC("DXT1")) {
+        header.format = BlockFormat::BC1;
+    } else if (fourCC == sFourCC("DXT5")) {
+        header.format = BlockFormat::BC3;
+    } else if (fourCC == sFourCC("ATI1") || fourCC == sFourCC("BC4U")) {
+        header.format = BlockFormat::BC4;
+    } else if (fourCC == sFourCC("ATI2") || fourCC == sFourCC("BC5U")) {
+        header.format = BlockFormat::BC5;
+    } else {
+        return {};
+    }
+    return std::make_pair(header, dataOffset);
+}
+
+// header and (offset, size) of every level
+std::optional<std::pair<CompressedImageHeader, std::vector<std::pair<uint64_t, uint64_t>>>> sParseKtx2(
+    const std::vector<unsigned char>& bytes) {
+    if (bytes.size() < cKtx2HeaderSize ||
+        std::memcmp(bytes.data(), cKtx2Identifier.data(), cKtx2Identifier.size()) != 0) {
+        return {};
+    }
+    auto pixelDepth = sRead<uint32_t>(bytes, 28);
+    auto layerCount = sRead<uint32_t>(bytes, 32);
+    auto faceCount = sRead<uint32_t>(bytes, 36);
+    auto supercompressionScheme = sRead<uint32_t>(bytes, 44);
+    // plain 2D images only, supercompressed (Basis, zstd) data would need a transcoder
+    if (pixelDepth > 1 || layerCount > 1 || faceCount != 1 || supercompressionScheme != 0) {
+        return {};
+    }
+    CompressedImageHeader header;
+    header.width = static_cast<int>(sRead<uint32_t>(bytes, 20));
+    header.height = static_cast<int>(sRead<uint32_t>(bytes, 24));
+    header.levelsCount = std::max(1, static_cast<int>(sRead<uint32_t>(bytes, 40)));
+    switch (sRead<uint32_t>(bytes, 12)) {
+        case cVkBC1Rgb:
+        case cVkBC1Rgba:
+            header.format = BlockFormat::BC1;
+            break;
+        case cVkBC3:
+            header.format = BlockFormat::BC3;
+            break;
+        case cVkBC4:
+            header.format = BlockFormat::BC4;
+            break;
+        case cVkBC5:
+            header.format = BlockFormat::BC5;
+            break;
+        case cVkBC7:
+            header.format = BlockFormat::BC7;
+            break;
+        default:
+            return {};
+    }
+    if (bytes.size() < cKtx2HeaderSize + header.levelsCount * cKtx2LevelIndexEntrySize) {
+        return {};
+    }
+    std::vector<std::pair<uint64_t, uint64_t>> levels;
+    for (int level = 0; level < header.levelsCount; ++level) {
+        auto entryOffset = cKtx2HeaderSize + level * cKtx2LevelIndexEntrySize;
+        levels.emplace_back(sRead<uint64_t>(bytes, entryOffset), sRead<uint64_t>(bytes, entryOffset + 8));
+    }
+    return std::make_pair(header, std::move(levels));
+}
+
+std::optional<CompressedImageHeader> sParseHeader(const fs::path& path,
+                                                  const std::vector<unsigned char>& bytes) {
+    if (path.extension() == ".ktx2") {
+        if (auto ktx2 = sParseKtx2(bytes)) {
+            return ktx2->first;
+        }
+    } else if (auto dds = sParseDds(bytes)) {
+        return dds->first;
+    }
+    return {};
+}
+
+void sCompressLevel(const unsigned char* pixels, int width, int height, int channels, BlockFormat format,
+                    unsigned char* destination) {
+    const auto blockBytes = sBlockBytes(format);
+    std::array<unsigned char, 16 * 4> block;
+    for (int blockY = 0; blockY < (height + 3) / 4; ++blockY) {
+        for (int blockX = 0; blockX < (width + 3) / 4; ++blockX) {
+            // pixels outside of the image repeat the edge
+            for (int pos = 0; pos < 16; ++pos) {
+                int x = std::min(blockX * 4 + pos % 4, width - 1);
+                int y = std::min(blockY * 4 + pos / 4, height - 1);
+                const auto* pixel = pixels + (static_cast<size_t>(y) * width + x) * channels;
+                switch (format) {
+                    case BlockFormat::BC4:
+                        block[pos] = pixel[0];
+                        break;
+                    case BlockFormat::BC5:
+                        block[pos * 2] = pixel[0];
+                        block[pos * 2 + 1] = pixel[1];
+                        break;
+                    default:
+                        block[pos * 4] = pixel[0];
+                        block[pos * 4 + 1] = pixel[1];
+                        block[pos * 4 + 2] = pixel[2];
+                        block[pos * 4 + 3] = channels == 4 ? pixel[3] : 255;
+                        break;
+                }
+            }
+            switch (format) {
+                case BlockFormat::BC4:
+                    stb_compress_bc4_block(destination, block.data());
+                    break;
+                case BlockFormat::BC5:
+                    stb_compress_bc5_block(destination, block.data());
+                    break;
+                default:
+                    stb_compress_dxt_block(destination, block.data(), format == BlockFormat::BC3 ? 1 : 0,
+                                           STB_DXT_HIGHQUAL);
+                    break;
+            }
+            destination += blockBytes;
+        }
+    }
+}
+
+fs::path sCacheEntryPath(const fs::path& sourcePath, const CompressedImageHeader& header) {
+    auto key = fs::absolute(sourcePath).lexically_normal().string();
+    auto hash = Utils::hashBytes(key.data(), key.size());
+    const int headerKey[] = {static_cast<int>(header.format), header.width, header.height,
+                             header.levelsCount};
+    hash = Utils::hashBytes(headerKey, sizeof(headerKey), hash);
+    std::stringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << hash << ".dds";
+    return BlockCompression::cacheDirectory() / name.str();
+}
+
+}  // namespace
+
+namespace BlockCompression {
+
+bool isCompressedImageFile(const fs::path& path) {
+    auto extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    return extension == ".dds" || extension == ".ktx2";
+}
+
+std::optional<CompressedImageHeader> probeCompressedImage(const fs::path& path) {
+    auto bytes = sReadFile(path, cProbeSize);
+    if (!bytes) {
+        return {};
+    }
+    return sParseHeader(path, *bytes);
+}
+
+std::optional<CompressedImage> loadCompressedImage(const fs::path& path) {
+    auto bytes = sReadFile(path, SIZE_MAX);
+    if (!bytes) {
+        return {};
+    }
+    auto header = sParseHeader(path, *bytes);
+    if (!header) {
+        return {};
+    }
+
+    CompressedImage image{*header, {}};
+    image.data.reserve(imageSize(*header));
+    std::vector<std::pair<uint64_t, uint64_t>> levels;
+    if (path.extension() == ".ktx2") {
+        levels = sParseKtx2(*bytes)->second;
+    } else {
+        // DDS levels follow the header without gaps
+        uint64_t offset = sParseDds(*bytes)->second;
+        for (int level = 0; level < header->levelsCount; ++level) {
+            auto size = levelSize(header->format, sLevelDimension(header->width, level),
+                                  sLevelDimension(header->height, level));
+            levels.emplace_back(offset, size);
+            offset += size;
+        }
+    }
+    for (int level = 0; level < header->levelsCount; ++level) {
+        const auto [offset, size] = levels[level];
+        auto expectedSize = levelSize(header->format, sLevelDimension(header->width, level),
+                                      sLevelDimension(header->height, level));
+        if (size != expectedSize || offset > bytes->size() || size > bytes->size() - offset) {
+            return {};
+        }
+        image.data.insert(image.data.end(), bytes->begin() + offset, bytes->begin() + offset + size);
+    }
+    return image;
+}
+
+bool saveDds(const fs::path& path, const CompressedImage& image) {
+    const auto& header = image.header;
+    uint32_t dxgiFormat = 0;
+    switch (header.format) {
+        case BlockFormat::BC1:
+            dxgiFormat = cDxgiBC1;
+            break;
+        case BlockFormat::BC3:
+            dxgiFormat = cDxgiBC3;
+            break;
+        case BlockFormat::BC4:
+            dxgiFormat = cDxgiBC4;
+            break;
+        case BlockFormat::BC5:
+            dxgiFormat = cDxgiBC5;
+            break;
+        case BlockFormat::BC7:
+            dxgiFormat = cDxgiBC7;
+            break;
+        default:
+            return false;
+    }
+
+    std::vector<unsigned char> headers(cDdsHeaderSize + cDdsDx10HeaderSize, 0);
+    std::memcpy(headers.data(), "DDS ", 4);
+    sWrite<uint32_t>(headers, 4, 124);
+    // caps, height, width, pixel format, mip map count, linear size
+    sWrite<uint32_t>(headers, 8, 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000);
+    sWrite<uint32_t>(headers, 12, static_cast<uint32_t>(header.height));
+    sWrite<uint32_t>(headers, 16, static_cast<uint32_t>(header.width));
+    sWrite<uint32_t>(headers, 20,
+                     static_cast<uint32_t>(levelSize(header.format, header.width, header.height)));
+    sWrite<uint32_t>(headers, 28, static_cast<uint32_t>(header.levelsCount));
+    sWrite<uint32_t>(headers, 76, 32);
+    // four CC pixel format
+    sWrite<uint32_t>(headers, 80, 0x4);
+    sWrite<uint32_t>(headers, 84, sFourCC("DX10"));
+    // texture, mip map, complex
+    sWrite<uint32_t>(headers, 108, 0x1000 | 0x400000 | 0x8);
+    sWrite<uint32_t>(headers, 128, dxgiFormat);
+    // 2D texture of one element
+    sWrite<uint32_t>(headers, 132, 3);
+    sWrite<uint32_t>(headers, 140, 1);
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(headers.data()), static_cast<std::streamsize>(headers.size()));
+    file.write(reinterpret_cast<const char*>(image.data.data()),
+               static_cast<std::streamsize>(image.data.size()));
+    return static_cast<bool>(file);
+}
+
+BlockFormat formatForChannels(int channels) {
+    switch (channels) {
+        case 1:
+            return BlockFormat::BC4;
+        case 2:
+            return BlockFormat::BC5;
+        case 3:
+            return BlockFormat::BC1;
+        default:
+            return BlockFormat::BC3;
+    }
+}
+
+bool isSupported(BlockFormat format) {
+    switch (format) {
+        case BlockFormat::BC1:
+        case BlockFormat::BC3:
+            return GLAD_GL_EXT_texture_compression_s3tc;
+        case BlockFormat::BC4:
+        case BlockFormat::BC5:
+            // RGTC is a part of OpenGL 3.0
+            return true;
+        case BlockFormat::BC7:
+            return GLAD_GL_ARB_texture_compression_bptc || GLAD_GL_VERSION_4_2;
+        default:
+            return false;
+    }
+}
+
+unsigned int glInternalFormat(BlockFormat format) {
+    switch (format) {
+        case BlockFormat::BC1:
+            return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case BlockFormat::BC3:
+            return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case BlockFormat::BC4:
+            return GL_COMPRESSED_RED_RGTC1;
+        case BlockFormat::BC5:
+            return GL_COMPRESSED_RG_RGTC2;
+        case BlockFormat::BC7:
+            return GL_COMPRESSED_RGBA_BPTC_UNORM;
+        default:
+            return 0;
+    }
+}
+
+int mipLevelsCount(int width, int height) {
+    int levelsCount = 1;
+    while ((std::max(width, height) >> levelsCount) > 0) {
+        ++levelsCount;
+    }
+    return levelsCount;
+}
+
+size_t levelSize(BlockFormat format, int width, int height) {
+    return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * sBlockBytes(format);
+}
+
+size_t imageSize(const CompressedImageHeader& header) {
+    size_t size = 0;
+    for (int level = 0; level < header.levelsCount; ++level) {
+        size += levelSize(header.format, sLevelDimension(header.width, level),
+                          sLevelDimension(header.height, level));
+    }
+    return size;
+}
+
+CompressedImage compress(const std::vector<unsigned char>& pixels, int width, int height, int channels) {
+    CompressedImage image;
+    image.header = CompressedImageHeader{.format = formatForChannels(channels),
+                                         .width = width,
+                                         .height = height,
+                                         .levelsCount = mipLevelsCount(width, height)};
+    image.data.resize(imageSize(image.header));
+
+    // each level is downsampled from the previous one and encoded
+    std::vector<unsigned char> levelPixels;
+    const unsigned char* source = pixels.data();
+    size_t offset = 0;
+    for (int level = 0; level < image.header.levelsCount; ++level) {
+        auto levelWidth = sLevelDimension(width, level);
+        auto levelHeight = sLevelDimension(height, level);
+        if (level > 0) {
+            std::vector<unsigned char> downsampled(static_cast<size_t>(levelWidth) * levelHeight * channels);
+            stbir_resize_uint8_linear(source, sLevelDimension(width, level - 1),
+                                      sLevelDimension(height, level - 1), 0, downsampled.data(), levelWidth,
+                                      levelHeight, 0, static_cast<stbir_pixel_layout>(channels));
+            levelPixels = std::move(downsampled);
+            source = levelPixels.data();
+        }
+        sCompressLevel(source, levelWidth, levelHeight, channels, image.header.format,
+                       image.data.data() + offset);
+        offset += levelSize(image.header.format, levelWidth, levelHeight);
+    }
+    return image;
+}
+
+fs::path cacheDirectory() {
+    std::error_code error;
+    auto tempDirectory = fs::temp_directory_path(error);
+    return (error ? fs::path(".") : tempDirectory) / "NACad" / "texturecache";
+}
+
+std::optional<CompressedImage> loadFromCache(const fs::path& sourcePath,
+                                             const CompressedImageHeader& header) {
+    auto entryPath = sCacheEntryPath(sourcePath, header);
+    std::error_code error;
+    auto entryTime = fs::last_write_time(entryPath, error);
+    if (error) {
+        return {};
+    }
+    auto sourceTime = fs::last_write_time(sourcePath, error);
+    if (error || sourceTime > entryTime) {
+        return {};
+    }
+    auto image = loadCompressedImage(entryPath);
+    if (!image || image->header.format != header.format || image->header.width != header.width ||
+        image->header.height != header.height || image->header.levelsCount != header.levelsCount) {
+        return {};
+    }
+    return image;
+}
+
+void storeInCache(const fs::path& sourcePath, const CompressedImage& image) {
+    std::error_code error;
+    fs::create_directories(cacheDirectory(), error);
+    auto entryPath = sCacheEntryPath(sourcePath, image.header);
+    // several workers may encode the same image, each writes its own temporary file
+    auto tempPath = entryPath;
+    tempPath += "." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + ".tmp";
+    if (!saveDds(tempPath, image)) {
+        std::cout << "Can't write texture cache entry: " << tempPath << std::endl;
+        fs::remove(tempPath, error);
+        return;
+    }
+    fs::rename(tempPath, entryPath, error);
+    if (error) {
+        fs::remove(tempPath, error);
+    }
+}
+
+}  // namespace BlockCompression
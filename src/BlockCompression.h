@@ -0,0 +1,52 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+// GPU block compressed formats, every format encodes 4x4 pixel blocks
+enum class BlockFormat { None, BC1, BC3, BC4, BC5, BC7 };
+
+struct CompressedImageHeader {
+    BlockFormat format;
+    int width;
+    int height;
+    int levelsCount;
+};
+
+// compressed image with its mip chain, levels are stored one after another starting from the largest one
+struct CompressedImage {
+    CompressedImageHeader header;
+    std::vector<unsigned char> data;
+};
+
+namespace BlockCompression {
+
+// .dds and .ktx2 files are uploaded as they are, their rows are expected in OpenGL bottom-up order
+bool isCompressedImageFile(const std::filesystem::path& path);
+std::optional<CompressedImageHeader> probeCompressedImage(const std::filesystem::path& path);
+std::optional<CompressedImage> loadCompressedImage(const std::filesystem::path& path);
+// writes the image as DDS with DX10 header
+bool saveDds(const std::filesystem::path& path, const CompressedImage& image);
+
+// format for a decoded image: BC4 for grayscale, BC5 for two channels, BC1 for RGB and BC3 for RGBA
+BlockFormat formatForChannels(int channels);
+// true if the current GL context can sample the format, needs the context to be created
+bool isSupported(BlockFormat format);
+unsigned int glInternalFormat(BlockFormat format);
+int mipLevelsCount(int width, int height);
+size_t levelSize(BlockFormat format, int width, int height);
+size_t imageSize(const CompressedImageHeader& header);
+
+// encodes tightly packed pixels with a mip chain down to 1x1. BC7 has no encoder, formats are chosen with
+// formatForChannels
+CompressedImage compress(const std::vector<unsigned char>& pixels, int width, int height, int channels);
+
+// compressed version of the source image brought to the header size and format, empty if there is none in the
+// cache or the source is newer than it. cache functions are safe to call from any thread
+std::optional<CompressedImage> loadFromCache(const std::filesystem::path& sourcePath,
+                                             const CompressedImageHeader& header);
+void storeInCache(const std::filesystem::path& sourcePath, const CompressedImage& image);
+std::filesystem::path cacheDirectory();
+
+}  // namespace BlockCompression
@@ -0,0 +1,191 @@
+#include "FrameProfiler.h"
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <utility>
+
+namespace {
+constexpr size_t cNoScope{std::numeric_limits<size_t>::max()};
+
+double sMs(std::chrono::steady_clock::duration duration) {
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+}  // namespace
+
+FrameProfiler::Scope::Scope(FrameProfiler* profiler, const char* name)
+    : profiler_{profiler}, scopeIdx_{profiler->beginScope_(name)} {}
+
+FrameProfiler::Scope::~Scope() { profiler_->endScope_(scopeIdx_); }
+
+FrameProfiler::FrameProfiler() : creationTime_{Clock::now()} {
+    // timer queries are core since GL 3.3, some drivers still report no timestamp bits
+    int timestampBits = 0;
+    if (GLAD_GL_VERSION_3_3 || GLAD_GL_ARB_timer_query) {
+        glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &timestampBits);
+    }
+    hasTimerQueries_ = timestampBits > 0;
+}
+
+FrameProfiler::~FrameProfiler() {
+    for (auto& frame : pendingFrames_) {
+        if (!frame.queries.empty()) {
+            glDeleteQueries(static_cast<GLsizei>(frame.queries.size()), frame.queries.data());
+        }
+    }
+}
+
+void FrameProfiler::beginFrame() {
+    if (!isEnabled_) {
+        return;
+    }
+    auto& frame = currentFrame_();
+    if (frame.isPending) {
+        // the oldest frame in flight, GPU results still not there are dropped rather than waited for
+        resolve_(frame, true);
+    }
+    frame.frameIdx = frameIdx_;
+    frame.start = Clock::now();
+    frame.scopes.clear();
+    isInFrame_ = true;
+    depth_ = 0;
+    beginScope_("Frame");
+}
+
+void FrameProfiler::endFrame() {
+    if (!isInFrame_) {
+        return;
+    }
+    endScope_(0);
+    isInFrame_ = false;
+    currentFrame_().isPending = true;
+    ++frameIdx_;
+    resolvePending_();
+}
+
+FrameProfiler::Scope FrameProfiler::scope(const char* name) { return Scope(this, name); }
+
+void FrameProfiler::setEnabled(bool isEnabled) { isEnabled_ = isEnabled; }
+
+bool FrameProfiler::isEnabled() const { return isEnabled_; }
+
+const std::deque<FrameProfiler::FrameTiming>& FrameProfiler::frames() const { return frames_; }
+
+bool FrameProfiler::exportChromeTrace(const std::filesystem::path& path) const {
+    std::ofstream file(path, std::ios::trunc);
+    file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    for (auto [track, trackName] : {std::pair{1, "CPU"}, std::pair{2, "GPU"}}) {
+        file << (track > 1 ? ",\n" : "\n")
+             << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << track
+             << ", \"args\": {\"name\": \"" << trackName << "\"}}";
+    }
+    // scope names are string literals of the code, they need no escaping
+    auto writeEvent = [&](const char* name, int track, double startMs, double durationMs, uint64_t frameIdx) {
+        file << ",\n{\"name\": \"" << name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << track
+             << ", \"ts\": " << startMs * 1000.0 << ", \"dur\": " << durationMs * 1000.0
+             << ", \"args\": {\"frame\": " << frameIdx << "}}";
+    };
+    for (const auto& frame : frames_) {
+        for (const auto& scope : frame.scopes) {
+            writeEvent(scope.name, 1, frame.startMs + scope.cpuStartMs, scope.cpuMs, frame.frameIdx);
+            if (scope.gpuMs >= 0.0) {
+                writeEvent(scope.name, 2, frame.startMs + scope.gpuStartMs, scope.gpuMs, frame.frameIdx);
+            }
+        }
+    }
+    file << "\n]}\n";
+    if (!file) {
+        std::cout << "Can't write frame trace: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+FrameProfiler::PendingFrame& FrameProfiler::currentFrame_() {
+    return pendingFrames_[frameIdx_ % cFramesInFlight];
+}
+
+size_t FrameProfiler::beginScope_(const char* name) {
+    if (!isInFrame_) {
+        return cNoScope;
+    }
+    auto& frame = currentFrame_();
+    auto scopeIdx = frame.scopes.size();
+    frame.scopes.push_back({.name = name, .depth = depth_++, .cpuStart = Clock::now(), .cpuEnd = {}});
+    if (hasTimerQueries_) {
+        if (frame.queries.size() < 2 * frame.scopes.size()) {
+            // queries are kept from frame to frame, grown in steps
+            auto oldSize = frame.queries.size();
+            frame.queries.resize(oldSize + 32);
+            glGenQueries(32, frame.queries.data() + oldSize);
+        }
+        glQueryCounter(frame.queries[2 * scopeIdx], GL_TIMESTAMP);
+    }
+    return scopeIdx;
+}
+
+void FrameProfiler::endScope_(size_t scopeIdx) {
+    if (scopeIdx == cNoScope || !isInFrame_) {
+        return;
+    }
+    auto& frame = currentFrame_();
+    frame.scopes[scopeIdx].cpuEnd = Clock::now();
+    --depth_;
+    if (hasTimerQueries_) {
+        glQueryCounter(frame.queries[2 * scopeIdx + 1], GL_TIMESTAMP);
+    }
+}
+
+void FrameProfiler::resolvePending_() {
+    auto firstFrameIdx = frameIdx_ - std::min<uint64_t>(frameIdx_, cFramesInFlight);
+    for (auto idx = firstFrameIdx; idx < frameIdx_; ++idx) {
+        auto& frame = pendingFrames_[idx % cFramesInFlight];
+        if (!frame.isPending) {
+            continue;
+        }
+        resolve_(frame, false);
+        if (frame.isPending) {
+            return;
+        }
+    }
+}
+
+void FrameProfiler::resolve_(PendingFrame& frame, bool isLastChance) {
+    // the end of the frame scope is the last query of the frame
+    int isAvailable = 0;
+    if (hasTimerQueries_ && !frame.scopes.empty()) {
+        glGetQueryObjectiv(frame.queries[1], GL_QUERY_RESULT_AVAILABLE, &isAvailable);
+    }
+    if (hasTimerQueries_ && !isAvailable && !isLastChance) {
+        return;
+    }
+    frame.isPending = false;
+    FrameTiming timing{.frameIdx = frame.frameIdx, .startMs = sMs(frame.start - creationTime_), .scopes = {}};
+    uint64_t frameGpuStart = 0;
+    for (size_t scopeIdx = 0; scopeIdx < frame.scopes.size(); ++scopeIdx) {
+        const auto& scope = frame.scopes[scopeIdx];
+        ScopeTiming scopeTiming{.name = scope.name,
+                                .depth = scope.depth,
+                                .cpuStartMs = sMs(scope.cpuStart - frame.start),
+                                .cpuMs = sMs(scope.cpuEnd - scope.cpuStart),
+                                .gpuStartMs = 0.0,
+                                .gpuMs = -1.0};
+        if (isAvailable) {
+            GLuint64 gpuStart = 0;
+            GLuint64 gpuEnd = 0;
+            glGetQueryObjectui64v(frame.queries[2 * scopeIdx], GL_QUERY_RESULT, &gpuStart);
+            glGetQueryObjectui64v(frame.queries[2 * scopeIdx + 1], GL_QUERY_RESULT, &gpuEnd);
+            frameGpuStart = scopeIdx == 0 ? gpuStart : frameGpuStart;
+            // timestamps are in nanoseconds
+            scopeTiming.gpuStartMs = static_cast<double>(gpuStart - frameGpuStart) / 1.0e6;
+            scopeTiming.gpuMs = static_cast<double>(gpuEnd - gpuStart) / 1.0e6;
+        }
+        timing.scopes.push_back(scopeTiming);
+    }
+    frames_.push_back(std::move(timing));
+    if (frames_.size() > cHistoryFramesCount) {
+        frames_.pop_front();
+    }
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// CPU and GPU durations of nested named scopes of the frames. The GPU side brackets every scope with
+// timestamp queries; every frame in flight has a set of its own and results are read once available, so the
+// CPU never waits for them. Every frame is a root scope "Frame" opened by beginFrame and closed by endFrame.
+// Needs the GL context, GPU times stay empty if the queries aren't available
+class FrameProfiler {
+   public:
+    // a scope of a finished frame
+    struct ScopeTiming {
+        const char* name;
+        // 0 for the frame
+        int depth;
+        // since the start of the frame
+        double cpuStartMs;
+        double cpuMs;
+        double gpuStartMs;
+        // negative if the GPU result is missing
+        double gpuMs;
+    };
+    struct FrameTiming {
+        uint64_t frameIdx;
+        // since the profiler was created
+        double startMs;
+        std::vector<ScopeTiming> scopes;
+    };
+
+    // closes its scope on destruction
+    class Scope {
+       public:
+        Scope(FrameProfiler* profiler, const char* name);
+        ~Scope();
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+       private:
+        FrameProfiler* profiler_;
+        size_t scopeIdx_;
+    };
+
+    // frames kept for the graphs and the trace export
+    static constexpr size_t cHistoryFramesCount{300};
+
+    FrameProfiler();
+    ~FrameProfiler();
+    FrameProfiler(const FrameProfiler&) = delete;
+    FrameProfiler& operator=(const FrameProfiler&) = delete;
+
+    void beginFrame();
+    void endFrame();
+    // scopes opened outside of a frame or while the profiler is off are ignored
+    [[nodiscard]] Scope scope(const char* name);
+    void setEnabled(bool isEnabled);
+    bool isEnabled() const;
+
+    // oldest first, the last one is the most recent frame with GPU results
+    const std::deque<FrameTiming>& frames() const;
+    // writes the kept frames in the Chrome trace event format (chrome://tracing, Perfetto), CPU and GPU
+    // scopes on separate tracks. GPU scopes are aligned to the start of their frame on the CPU
+    bool exportChromeTrace(const std::filesystem::path& path) const;
+
+   private:
+    using Clock = std::chrono::steady_clock;
+    // drivers queue up to three frames ahead, more with vsync off, a set is reused only after that
+    static constexpr size_t cFramesInFlight{4};
+
+    struct OpenScope {
+        const char* name;
+        int depth;
+        Clock::time_point cpuStart;
+        Clock::time_point cpuEnd;
+    };
+    // the scopes of a frame waiting for their GPU results
+    struct PendingFrame {
+        uint64_t frameIdx;
+        Clock::time_point start;
+        std::vector<OpenScope> scopes;
+        // begin and end timestamp per scope
+        std::vector<unsigned int> queries;
+        bool isPending = false;
+    };
+
+    bool isEnabled_{true};
+    bool hasTimerQueries_{false};
+    Clock::time_point creationTime_;
+    uint64_t frameIdx_{0};
+    bool isInFrame_{false};
+    int depth_{0};
+    PendingFrame pendingFrames_[cFramesInFlight];
+    std::deque<FrameTiming> frames_;
+
+    PendingFrame& currentFrame_();
+    size_t beginScope_(const char* name);
+    void endScope_(size_t scopeIdx);
+    // moves the frame to frames_ once its GPU results are ready, never waits for them. On the last chance
+    // the frame is moved without them
+    void resolve_(PendingFrame& frame, bool isLastChance);
+    // resolves pending frames oldest first up to the first one still waiting, so frames_ stays in order
+    void resolvePending_();
+};
@@ -0,0 +1,118 @@
+#include "Frustum.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NACAD_FRUSTUM_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+constexpr int cPlanesCount{6};
+constexpr int cPaddedPlanesCount{8};
+
+#ifdef NACAD_FRUSTUM_SSE2
+// selects b where mask is set, a elsewhere
+__m128 sSelect(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, b), _mm_andnot_ps(mask, a));
+}
+#endif
+}  // namespace
+
+Frustum::Frustum() {
+    for (int planeIdx = 0; planeIdx < cPaddedPlanesCount; ++planeIdx) {
+        x_[planeIdx] = y_[planeIdx] = z_[planeIdx] = 0.0f;
+        w_[planeIdx] = 1.0f;
+    }
+}
+
+Frustum::Frustum(const glm::mat4& viewProjectionTr) : Frustum() {
+    // Gribb and Hartmann, "Fast Extraction of Viewing Frustum Planes from the World-View-Projection Matrix".
+    // glm matrices are column major, row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+    auto row = [&](int rowIdx) {
+        return glm::vec4(viewProjectionTr[0][rowIdx], viewProjectionTr[1][rowIdx],
+                         viewProjectionTr[2][rowIdx], viewProjectionTr[3][rowIdx]);
+    };
+    const glm::vec4 planes[cPlanesCount] = {
+        row(3) + row(0),  // left
+        row(3) - row(0),  // right
+        row(3) + row(1),  // bottom
+        row(3) - row(1),  // top
+        row(3) + row(2),  // near
+        row(3) - row(2),  // far
+    };
+    for (int planeIdx = 0; planeIdx < cPlanesCount; ++planeIdx) {
+        // normalized, so that plane distances can be compared with sphere radii
+        auto plane = planes[planeIdx];
+        auto normalLength = glm::length(glm::vec3(plane));
+        if (normalLength > 0.0f) {
+            plane /= normalLength;
+        }
+        x_[planeIdx] = plane.x;
+        y_[planeIdx] = plane.y;
+        z_[planeIdx] = plane.z;
+        w_[planeIdx] = plane.w;
+    }
+}
+
+bool Frustum::isVisible(const BoundingSphere& sphere) const {
+#ifdef NACAD_FRUSTUM_SSE2
+    const __m128 centerX = _mm_set1_ps(sphere.center.x);
+    const __m128 centerY = _mm_set1_ps(sphere.center.y);
+    const __m128 centerZ = _mm_set1_ps(sphere.center.z);
+    const __m128 negativeRadius = _mm_set1_ps(-sphere.radius);
+    int outsideMask = 0;
+    for (int planeIdx = 0; planeIdx < cPaddedPlanesCount; planeIdx += 4) {
+        __m128 distance = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(_mm_load_ps(x_ + planeIdx), centerX),
+                       _mm_mul_ps(_mm_load_ps(y_ + planeIdx), centerY)),
+            _mm_add_ps(_mm_mul_ps(_mm_load_ps(z_ + planeIdx), centerZ), _mm_load_ps(w_ + planeIdx)));
+        outsideMask |= _mm_movemask_ps(_mm_cmplt_ps(distance, negativeRadius));
+    }
+    return outsideMask == 0;
+#else
+    for (int planeIdx = 0; planeIdx < cPlanesCount; ++planeIdx) {
+        float distance = x_[planeIdx] * sphere.center.x + y_[planeIdx] * sphere.center.y +
+                         z_[planeIdx] * sphere.center.z + w_[planeIdx];
+        if (distance < -sphere.radius) {
+            return false;
+        }
+    }
+    return true;
+#endif
+}
+
+bool Frustum::isVisible(const BoundingBox& box) const {
+    // the box is outside when its corner furthest along the plane normal is behind the plane
+#ifdef NACAD_FRUSTUM_SSE2
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 minX = _mm_set1_ps(box.min.x);
+    const __m128 minY = _mm_set1_ps(box.min.y);
+    const __m128 minZ = _mm_set1_ps(box.min.z);
+    const __m128 maxX = _mm_set1_ps(box.max.x);
+    const __m128 maxY = _mm_set1_ps(box.max.y);
+    const __m128 maxZ = _mm_set1_ps(box.max.z);
+    int outsideMask = 0;
+    for (int planeIdx = 0; planeIdx < cPaddedPlanesCount; planeIdx += 4) {
+        __m128 x = _mm_load_ps(x_ + planeIdx);
+        __m128 y = _mm_load_ps(y_ + planeIdx);
+        __m128 z = _mm_load_ps(z_ + planeIdx);
+        __m128 cornerX = sSelect(_mm_cmpge_ps(x, zero), minX, maxX);
+        __m128 cornerY = sSelect(_mm_cmpge_ps(y, zero), minY, maxY);
+        __m128 cornerZ = sSelect(_mm_cmpge_ps(z, zero), minZ, maxZ);
+        __m128 distance =
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, cornerX), _mm_mul_ps(y, cornerY)),
+                       _mm_add_ps(_mm_mul_ps(z, cornerZ), _mm_load_ps(w_ + planeIdx)));
+        outsideMask |= _mm_movemask_ps(_mm_cmplt_ps(distance, zero));
+    }
+    return outsideMask == 0;
+#else
+    for (int planeIdx = 0; planeIdx < cPlanesCount; ++planeIdx) {
+        float distance = x_[planeIdx] * (x_[planeIdx] >= 0.0f ? box.max.x : box.min.x) +
+                         y_[planeIdx] * (y_[planeIdx] >= 0.0f ? box.max.y : box.min.y) +
+                         z_[planeIdx] * (z_[planeIdx] >= 0.0f ? box.max.z : box.min.z) + w_[planeIdx];
+        if (distance < 0.0f) {
+            return false;
+        }
+    }
+    return true;
+#endif
+}
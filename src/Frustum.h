@@ -0,0 +1,26 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+
+// view frustum planes in world space, extracted from a view-projection matrix. The planes are kept
+// component-wise (all x, then all y...) so that one SSE operation tests a volume against four of them
+class Frustum {
+   public:
+    // everything is visible
+    Frustum();
+    explicit Frustum(const glm::mat4& viewProjectionTr);
+
+    // conservative, a volume intersecting no plane but lying outside near a corner is reported visible
+    bool isVisible(const BoundingSphere& sphere) const;
+    bool isVisible(const BoundingBox& box) const;
+
+   private:
+    // six planes padded to eight with planes every point is in front of. A point p is inside when
+    // x * p.x + y * p.y + z * p.z + w >= 0 for every plane
+    alignas(16) float x_[8];
+    alignas(16) float y_[8];
+    alignas(16) float z_[8];
+    alignas(16) float w_[8];
+};
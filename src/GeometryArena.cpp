@@ -0,0 +1,401 @@
+#include "GeometryArena.h"
+#include "InstanceBuffer.h"
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+
+namespace {
+
+size_t sVertexSize(VertexFormat vertexFormat) {
+    return vertexFormat == VertexFormat::Full ? sizeof(Vertex) : sizeof(CompactVertex);
+}
+
+size_t sIndexSize(bool hasShortIndices) { return hasShortIndices ? sizeof(uint16_t) : sizeof(uint32_t); }
+
+// copies the first copySize bytes to a new buffer of newSize bytes and deletes the old one
+unsigned int sReallocateBuffer(unsigned int buffer, size_t copySize, size_t newSize) {
+    unsigned int newBuffer;
+    glGenBuffers(1, &newBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(newSize), nullptr, GL_STATIC_DRAW);
+    if (buffer != 0 && copySize > 0) {
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+                            static_cast<GLsizeiptr>(copySize));
+    }
+    if (buffer != 0) {
+        glDeleteBuffers(1, &buffer);
+    }
+    return newBuffer;
+}
+
+}  // namespace
+
+std::optional<size_t> GeometryArena::RangeAllocator::allocate(size_t count) {
+    if (count == 0) {
+        return 0;
+    }
+    for (auto it = freeRanges_.begin(); it != freeRanges_.end(); ++it) {
+        auto [offset, freeCount] = *it;
+        if (freeCount < count) {
+            continue;
+        }
+        freeRanges_.erase(it);
+        if (freeCount > count) {
+            freeRanges_.emplace(offset + count, freeCount - count);
+        }
+        used_ += count;
+        return offset;
+    }
+    return {};
+}
+
+void GeometryArena::RangeAllocator::free(size_t offset, size_t count) {
+    if (count == 0) {
+        return;
+    }
+    // a range overlapping a free one was freed already, adding it again would hand it out twice
+    auto next = freeRanges_.lower_bound(offset);
+    auto overlapsPrevious =
+        next != freeRanges_.begin() && std::prev(next)->first + std::prev(next)->second > offset;
+    auto overlapsNext = next != freeRanges_.end() && next->first < offset + count;
+    if (offset + count > capacity_ || overlapsPrevious || overlapsNext) {
+        assert(false && "freeing a range that is not allocated");
+        return;
+    }
+    used_ -= count;
+    if (next != freeRanges_.begin()) {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second == offset) {
+            offset = previous->first;
+            count += previous->second;
+            freeRanges_.erase(previous);
+        }
+    }
+    if (next != freeRanges_.end() && offset + count == next->first) {
+        count += next->second;
+        freeRanges_.erase(next);
+    }
+    freeRanges_.emplace(offset, count);
+}
+
+void GeometryArena::RangeAllocator::grow(size_t capacity) {
+    auto oldCapacity = capacity_;
+    capacity_ = capacity;
+    // the added tail is freed like a regular range, so it merges with a free range at the end
+    used_ += capacity - oldCapacity;
+    free(oldCapacity, capacity - oldCapacity);
+}
+
+void GeometryArena::RangeAllocator::reset(size_t capacity, size_t used) {
+    freeRanges_.clear();
+    capacity_ = capacity;
+    used_ = used;
+    if (capacity > used) {
+        freeRanges_.emplace(used, capacity - used);
+    }
+}
+
+size_t GeometryArena::RangeAllocator::capacity() const { return capacity_; }
+
+size_t GeometryArena::RangeAllocator::used() const { return used_; }
+
+GeometryArena::~GeometryArena() {
+    for (auto& pool : pools_) {
+        glDeleteVertexArrays(1, &pool.vao);
+        glDeleteBuffers(1, &pool.vertexBuffer);
+        glDeleteBuffers(1, &pool.indexBuffer);
+    }
+}
+
+GeometryArena::AllocationId GeometryArena::allocate(const MeshGeometry& geometry) {
+    auto poolIdx = poolIdx_(geometry.vertexFormat, geometry.hasShortIndices);
+    auto& pool = pools_[poolIdx];
+    Allocation allocation;
+    allocation.poolIdx = poolIdx;
+    allocation.verticesCount = geometry.vertexData.size() / sVertexSize(geometry.vertexFormat);
+    allocation.indicesCount = geometry.indicesCount;
+    allocation.isLive = true;
+
+    // buffers grow at least twice, so a model made of many small meshes is copied a few times only
+    auto firstVertex = pool.vertices.allocate(allocation.verticesCount);
+    if (!firstVertex) {
+        auto capacity = pool.vertices.capacity();
+        growVertices_(pool, std::max(capacity * 2, capacity + allocation.verticesCount));
+        firstVertex = pool.vertices.allocate(allocation.verticesCount);
+    }
+    auto firstIndex = pool.indices.allocate(allocation.indicesCount);
+    if (!firstIndex) {
+        auto capacity = pool.indices.capacity();
+        growIndices_(pool, std::max(capacity * 2, capacity + allocation.indicesCount));
+        firstIndex = pool.indices.allocate(allocation.indicesCount);
+    }
+    allocation.firstVertex = *firstVertex;
+    allocation.firstIndex = *firstIndex;
+
+    if (freeAllocationIds_.empty()) {
+        allocations_.push_back(allocation);
+        return allocations_.size() - 1;
+    }
+    auto allocationId = freeAllocationIds_.back();
+    freeAllocationIds_.pop_back();
+    allocations_[allocationId] = allocation;
+    return allocationId;
+}
+
+void GeometryArena::free(AllocationId allocationId) {
+    // double frees are ignored, the id may already be reused by another allocation
+    if (allocationId >= allocations_.size() || !allocations_[allocationId].isLive) {
+        assert(false && "freeing an allocation that is not live");
+        return;
+    }
+    auto& allocation = allocations_[allocationId];
+    auto& pool = pools_[allocation.poolIdx];
+    pool.vertices.free(allocation.firstVertex, allocation.verticesCount);
+    pool.indices.free(allocation.firstIndex, allocation.indicesCount);
+    allocation.isLive = false;
+    freeAllocationIds_.push_back(allocationId);
+}
+
+void GeometryArena::writeVertices(AllocationId allocationId, size_t byteOffset,
+                                  std::span<const unsigned char> data) {
+    const auto& allocation = allocations_[allocationId];
+    const auto& pool = pools_[allocation.poolIdx];
+    auto offset = allocation.firstVertex * sVertexSize(pool.vertexFormat) + byteOffset;
+    glBindBuffer(GL_ARRAY_BUFFER, pool.vertexBuffer);
+    glBufferSubData(GL_ARRAY_BUFFER, static_cast<GLintptr>(offset), static_cast<GLsizeiptr>(data.size()),
+                    data.data());
+}
+
+void GeometryArena::writeIndices(AllocationId allocationId, size_t byteOffset,
+                                 std::span<const unsigned char> data) {
+    const auto& allocation = allocations_[allocationId];
+    const auto& pool = pools_[allocation.poolIdx];
+    auto offset = allocation.firstIndex * sIndexSize(pool.hasShortIndices) + byteOffset;
+    // the copy target doesn't touch the element buffer binding of whatever VAO is bound
+    glBindBuffer(GL_COPY_WRITE_BUFFER, pool.indexBuffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(offset),
+                    static_cast<GLsizeiptr>(data.size()), data.data());
+}
+
+unsigned int GeometryArena::vertexArray(AllocationId allocationId) const {
+    return pools_[allocations_[allocationId].poolIdx].vao;
+}
+
+void GeometryArena::draw(const GeometryDrawRange& range) {
+    glBindVertexArray(vertexArray(range.allocation));
+    drawBound(range);
+    glBindVertexArray(0);
+}
+
+void GeometryArena::drawBound(const GeometryDrawRange& range) {
+    const auto& allocation = allocations_[range.allocation];
+    const auto& pool = pools_[allocation.poolIdx];
+    auto indexOffset = (allocation.firstIndex + range.firstIndex) * sIndexSize(pool.hasShortIndices);
+    glDrawElementsBaseVertex(GL_TRIANGLES, static_cast<GLsizei>(range.indicesCount),
+                             pool.hasShortIndices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT,
+                             reinterpret_cast<const void*>(indexOffset),
+                             static_cast<GLint>(allocation.firstVertex));
+}
+
+void GeometryArena::drawInstanced(const GeometryDrawRange& range, InstanceBuffer& instances) {
+    glBindVertexArray(vertexArray(range.allocation));
+    drawInstancedBound(range, instances);
+    glBindVertexArray(0);
+}
+
+void GeometryArena::drawInstancedBound(const GeometryDrawRange& range, InstanceBuffer& instances) {
+    const auto& allocation = allocations_[range.allocation];
+    const auto& pool = pools_[allocation.poolIdx];
+    auto indexOffset = (allocation.firstIndex + range.firstIndex) * sIndexSize(pool.hasShortIndices);
+    // the pool VAO is shared by all meshes, instance attributes are attached only for this draw
+    instances.bindAttributes();
+    glDrawElementsInstancedBaseVertex(GL_TRIANGLES, static_cast<GLsizei>(range.indicesCount),
+                                      pool.hasShortIndices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT,
+                                      reinterpret_cast<const void*>(indexOffset),
+                                      static_cast<GLsizei>(instances.size()),
+                                      static_cast<GLint>(allocation.firstVertex));
+    instances.unbindAttributes();
+}
+
+void GeometryArena::multiDraw(std::span<const GeometryDrawRange> ranges) {
+    collectMultiDraw_(ranges);
+    for (size_t poolIdx = 0; poolIdx < pools_.size(); ++poolIdx) {
+        if (drawCounts_[poolIdx].empty()) {
+            continue;
+        }
+        glBindVertexArray(pools_[poolIdx].vao);
+        issueMultiDraw_(poolIdx);
+    }
+    glBindVertexArray(0);
+}
+
+void GeometryArena::multiDrawBound(std::span<const GeometryDrawRange> ranges) {
+    collectMultiDraw_(ranges);
+    for (size_t poolIdx = 0; poolIdx < pools_.size(); ++poolIdx) {
+        if (!drawCounts_[poolIdx].empty()) {
+            issueMultiDraw_(poolIdx);
+        }
+    }
+}
+
+void GeometryArena::collectMultiDraw_(std::span<const GeometryDrawRange> ranges) {
+    drawCounts_.resize(pools_.size());
+    drawOffsets_.resize(pools_.size());
+    drawBaseVertices_.resize(pools_.size());
+    for (const auto& range : ranges) {
+        const auto& allocation = allocations_[range.allocation];
+        auto indexSize = sIndexSize(pools_[allocation.poolIdx].hasShortIndices);
+        drawCounts_[allocation.poolIdx].push_back(static_cast<int>(range.indicesCount));
+        drawOffsets_[allocation.poolIdx].push_back(
+            reinterpret_cast<const void*>((allocation.firstIndex + range.firstIndex) * indexSize));
+        drawBaseVertices_[allocation.poolIdx].push_back(static_cast<int>(allocation.firstVertex));
+    }
+}
+
+void GeometryArena::issueMultiDraw_(size_t poolIdx) {
+    auto& counts = drawCounts_[poolIdx];
+    glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts.data(),
+                                  pools_[poolIdx].hasShortIndices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT,
+                                  drawOffsets_[poolIdx].data(), static_cast<GLsizei>(counts.size()),
+                                  drawBaseVertices_[poolIdx].data());
+    counts.clear();
+    drawOffsets_[poolIdx].clear();
+    drawBaseVertices_[poolIdx].clear();
+}
+
+void GeometryArena::compact() {
+    for (size_t poolIdx = 0; poolIdx < pools_.size(); ++poolIdx) {
+        auto& pool = pools_[poolIdx];
+        std::vector<Allocation*> live;
+        for (auto& allocation : allocations_) {
+            if (allocation.isLive && allocation.poolIdx == poolIdx) {
+                live.push_back(&allocation);
+            }
+        }
+
+        // vertices and indices are packed separately, each in the order of their current offsets
+        auto vertexSize = sVertexSize(pool.vertexFormat);
+        std::ranges::sort(live, {}, &Allocation::firstVertex);
+        unsigned int vertexBuffer;
+        glGenBuffers(1, &vertexBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, vertexBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(pool.vertices.used() * vertexSize),
+                     nullptr, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_READ_BUFFER, pool.vertexBuffer);
+        size_t packedVertices = 0;
+        for (auto* allocation : live) {
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                                static_cast<GLintptr>(allocation->firstVertex * vertexSize),
+                                static_cast<GLintptr>(packedVertices * vertexSize),
+                                static_cast<GLsizeiptr>(allocation->verticesCount * vertexSize));
+            allocation->firstVertex = packedVertices;
+            packedVertices += allocation->verticesCount;
+        }
+
+        auto indexSize = sIndexSize(pool.hasShortIndices);
+        std::ranges::sort(live, {}, &Allocation::firstIndex);
+        unsigned int indexBuffer;
+        glGenBuffers(1, &indexBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, indexBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(pool.indices.used() * indexSize), nullptr,
+                     GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_READ_BUFFER, pool.indexBuffer);
+        size_t packedIndices = 0;
+        for (auto* allocation : live) {
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                                static_cast<GLintptr>(allocation->firstIndex * indexSize),
+                                static_cast<GLintptr>(packedIndices * indexSize),
+                                static_cast<GLsizeiptr>(allocation->indicesCount * indexSize));
+            allocation->firstIndex = packedIndices;
+            packedIndices += allocation->indicesCount;
+        }
+
+        glDeleteBuffers(1, &pool.vertexBuffer);
+        glDeleteBuffers(1, &pool.indexBuffer);
+        pool.vertexBuffer = vertexBuffer;
+        pool.indexBuffer = indexBuffer;
+        pool.vertices.reset(packedVertices, packedVertices);
+        pool.indices.reset(packedIndices, packedIndices);
+        setUpVertexArray_(pool);
+    }
+}
+
+GeometryArena::Stats GeometryArena::stats() const {
+    Stats stats;
+    stats.allocationsCount = allocations_.size() - freeAllocationIds_.size();
+    for (const auto& pool : pools_) {
+        auto vertexSize = sVertexSize(pool.vertexFormat);
+        auto indexSize = sIndexSize(pool.hasShortIndices);
+        stats.usedBytes += pool.vertices.used() * vertexSize + pool.indices.used() * indexSize;
+        stats.capacityBytes += pool.vertices.capacity() * vertexSize + pool.indices.capacity() * indexSize;
+    }
+    return stats;
+}
+
+size_t GeometryArena::poolIdx_(VertexFormat vertexFormat, bool hasShortIndices) {
+    auto it = std::ranges::find_if(pools_, [&](const Pool& pool) {
+        return pool.vertexFormat == vertexFormat && pool.hasShortIndices == hasShortIndices;
+    });
+    if (it != pools_.end()) {
+        return static_cast<size_t>(it - pools_.begin());
+    }
+    Pool pool{.vertexFormat = vertexFormat, .hasShortIndices = hasShortIndices};
+    glGenVertexArrays(1, &pool.vao);
+    glGenBuffers(1, &pool.vertexBuffer);
+    glGenBuffers(1, &pool.indexBuffer);
+    setUpVertexArray_(pool);
+    pools_.push_back(std::move(pool));
+    return pools_.size() - 1;
+}
+
+void GeometryArena::growVertices_(Pool& pool, size_t capacity) {
+    auto vertexSize = sVertexSize(pool.vertexFormat);
+    pool.vertexBuffer =
+        sReallocateBuffer(pool.vertexBuffer, pool.vertices.capacity() * vertexSize, capacity * vertexSize);
+    pool.vertices.grow(capacity);
+    // attribute pointers keep the buffer they were set with
+    setUpVertexArray_(pool);
+}
+
+void GeometryArena::growIndices_(Pool& pool, size_t capacity) {
+    auto indexSize = sIndexSize(pool.hasShortIndices);
+    pool.indexBuffer =
+        sReallocateBuffer(pool.indexBuffer, pool.indices.capacity() * indexSize, capacity * indexSize);
+    pool.indices.grow(capacity);
+    setUpVertexArray_(pool);
+}
+
+void GeometryArena::setUpVertexArray_(const Pool& pool) const {
+    glBindVertexArray(pool.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, pool.vertexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool.indexBuffer);
+
+    if (pool.vertexFormat == VertexFormat::Full) {
+        // vertex positions
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+        // vertex normals
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+        // vertex texture coords
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoord));
+    } else {
+        // positions in [0, 1] of the mesh bounds
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)0);
+        // octahedral normals in [-1, 1]
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(CompactVertex),
+                              (void*)offsetof(CompactVertex, normal));
+        // texture coords
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(CompactVertex),
+                              (void*)offsetof(CompactVertex, texCoord));
+    }
+
+    glBindVertexArray(0);
+}
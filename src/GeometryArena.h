@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "Mesh.h"
+
+class InstanceBuffer;
+
+// sub-allocates geometry of many meshes from a few large vertex and index buffers, one VAO per vertex
+// format and index type, so meshes sharing a material are drawn with one glMultiDrawElementsBaseVertex.
+// indices stay relative to the first vertex of their mesh, so ranges can move on growth and compaction
+class GeometryArena {
+   public:
+    using AllocationId = size_t;
+
+    struct Stats {
+        size_t allocationsCount = 0;
+        size_t usedBytes = 0;
+        size_t capacityBytes = 0;
+    };
+
+    GeometryArena() = default;
+    ~GeometryArena();
+    GeometryArena(const GeometryArena&) = delete;
+    GeometryArena& operator=(const GeometryArena&) = delete;
+
+    // reserves space for the geometry, the data is written by writeVertices and writeIndices
+    AllocationId allocate(const MeshGeometry& geometry);
+    void free(AllocationId allocation);
+    void writeVertices(AllocationId allocation, size_t byteOffset, std::span<const unsigned char> data);
+    void writeIndices(AllocationId allocation, size_t byteOffset, std::span<const unsigned char> data);
+    // allocations with the same vertex array can be drawn one after another without rebinding it
+    unsigned int vertexArray(AllocationId allocation) const;
+    // ranges select a level of detail of the allocation, see Mesh::drawRange
+    void draw(const GeometryDrawRange& range);
+    // draws the range once per instance of the buffer
+    void drawInstanced(const GeometryDrawRange& range, InstanceBuffer& instances);
+    // allocations of different pools are allowed, every pool takes one multi-draw call
+    void multiDraw(std::span<const GeometryDrawRange> ranges);
+    // the same draws for a caller that keeps track of the bound VAO, see RenderQueue. The vertex array of
+    // the allocations must be bound
+    void drawBound(const GeometryDrawRange& range);
+    void drawInstancedBound(const GeometryDrawRange& range, InstanceBuffer& instances);
+    void multiDrawBound(std::span<const GeometryDrawRange> ranges);
+    // moves live ranges to the beginning of the buffers and shrinks them to the used size
+    void compact();
+    Stats stats() const;
+
+   private:
+    // first fit over free ranges, in elements
+    class RangeAllocator {
+       public:
+        std::optional<size_t> allocate(size_t count);
+        void free(size_t offset, size_t count);
+        void grow(size_t capacity);
+        void reset(size_t capacity, size_t used);
+        size_t capacity() const;
+        size_t used() const;
+
+       private:
+        // offset -> count, neighbouring ranges are always merged
+        std::map<size_t, size_t> freeRanges_;
+        size_t capacity_ = 0;
+        size_t used_ = 0;
+    };
+
+    struct Pool {
+        VertexFormat vertexFormat;
+        bool hasShortIndices;
+        unsigned int vao = 0;
+        unsigned int vertexBuffer = 0;
+        unsigned int indexBuffer = 0;
+        RangeAllocator vertices;
+        RangeAllocator indices;
+    };
+
+    struct Allocation {
+        size_t poolIdx = 0;
+        size_t firstVertex = 0;
+        size_t verticesCount = 0;
+        size_t firstIndex = 0;
+        size_t indicesCount = 0;
+        bool isLive = false;
+    };
+
+    std::vector<Pool> pools_;
+    std::vector<Allocation> allocations_;
+    std::vector<AllocationId> freeAllocationIds_;
+    // per pool draw parameters reused by multiDraw
+    std::vector<std::vector<int>> drawCounts_;
+    std::vector<std::vector<const void*>> drawOffsets_;
+    std::vector<std::vector<int>> drawBaseVertices_;
+
+    size_t poolIdx_(VertexFormat vertexFormat, bool hasShortIndices);
+    void growVertices_(Pool& pool, size_t capacity);
+    void growIndices_(Pool& pool, size_t capacity);
+    void setUpVertexArray_(const Pool& pool) const;
+    void collectMultiDraw_(std::span<const GeometryDrawRange> ranges);
+    void issueMultiDraw_(size_t poolIdx);
+};
@@ -0,0 +1,109 @@
+#include "InstanceBuffer.h"
+
+#include <glad/glad.h>
+#include <algorithm>
+
+namespace {
+static_assert(sizeof(InstanceData) == 68, "the instance attributes are set up for a tightly packed layout");
+
+// dirty instances closer than this are sent with one glBufferSubData together with the clean ones between
+// them, a call costs more than re-sending a few kilobytes
+constexpr size_t cMaxDirtyGap{32};
+}  // namespace
+
+InstanceBuffer::InstanceBuffer() { glGenBuffers(1, &buffer_); }
+
+InstanceBuffer::~InstanceBuffer() { glDeleteBuffers(1, &buffer_); }
+
+InstanceBuffer::InstanceId InstanceBuffer::add(const InstanceData& instance) {
+    instances_.push_back(instance);
+    markDirty_(instances_.size() - 1);
+    return instances_.size() - 1;
+}
+
+void InstanceBuffer::set(InstanceId instance, const InstanceData& data) {
+    instances_[instance] = data;
+    markDirty_(instance);
+}
+
+void InstanceBuffer::setModelTr(InstanceId instance, const glm::mat4& tr) {
+    instances_[instance].modelTr = tr;
+    markDirty_(instance);
+}
+
+void InstanceBuffer::setMaterial(InstanceId instance, MaterialIndex material) {
+    instances_[instance].material = material;
+    markDirty_(instance);
+}
+
+void InstanceBuffer::clear() {
+    instances_.clear();
+    dirtyInstances_.clear();
+}
+
+size_t InstanceBuffer::size() const { return instances_.size(); }
+
+void InstanceBuffer::markDirty_(InstanceId instance) {
+    // instances past the capacity are sent with the whole buffer when it grows
+    if (instance < capacity_) {
+        dirtyInstances_.push_back(instance);
+    }
+}
+
+void InstanceBuffer::upload_() {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer_);
+    if (instances_.size() > capacity_) {
+        capacity_ = std::max(instances_.size(), 2 * capacity_);
+        glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(capacity_ * sizeof(InstanceData)), nullptr,
+                     GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, static_cast<GLsizeiptr>(instances_.size() * sizeof(InstanceData)),
+                        instances_.data());
+        dirtyInstances_.clear();
+        return;
+    }
+    std::ranges::sort(dirtyInstances_);
+    auto it = dirtyInstances_.begin();
+    while (it != dirtyInstances_.end()) {
+        auto first = *it;
+        auto last = first;
+        for (; it != dirtyInstances_.end() && *it <= last + cMaxDirtyGap; ++it) {
+            last = *it;
+        }
+        if (first >= instances_.size()) {
+            break;
+        }
+        last = std::min(last, instances_.size() - 1);
+        auto bytes = static_cast<GLsizeiptr>((last - first + 1) * sizeof(InstanceData));
+        glBufferSubData(GL_ARRAY_BUFFER, static_cast<GLintptr>(first * sizeof(InstanceData)), bytes,
+                        &instances_[first]);
+    }
+    dirtyInstances_.clear();
+}
+
+void InstanceBuffer::bindAttributes() {
+    if (instances_.size() > capacity_ || !dirtyInstances_.empty()) {
+        upload_();
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, buffer_);
+    // a mat4 attribute takes one location per column
+    for (unsigned int column = 0; column < 4; ++column) {
+        auto location = cInstanceAttributesLocation + column;
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                              (void*)(offsetof(InstanceData, modelTr) + column * sizeof(glm::vec4)));
+        glVertexAttribDivisor(location, 1);
+    }
+    auto materialLocation = cInstanceAttributesLocation + 4;
+    glEnableVertexAttribArray(materialLocation);
+    glVertexAttribIPointer(materialLocation, 1, GL_INT, sizeof(InstanceData),
+                           (void*)offsetof(InstanceData, material));
+    glVertexAttribDivisor(materialLocation, 1);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void InstanceBuffer::unbindAttributes() const {
+    for (unsigned int location = cInstanceAttributesLocation; location < cInstanceAttributesLocation + 5;
+         ++location) {
+        glDisableVertexAttribArray(location);
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "MaterialTable.h"
+
+// attributes of one instance as they are laid out in the buffer, read by shader.vs
+struct InstanceData {
+    glm::mat4 modelTr{1.0f};
+    MaterialIndex material = 0;
+};
+
+// first attribute location of the instance data, should match aInstanceModelTr in shader.vs. The
+// transform takes four locations, the material index the one after them
+constexpr unsigned int cInstanceAttributesLocation{3};
+
+// per instance transforms and materials of a mesh drawn many times with one instanced draw call, see
+// Mesh::drawInstanced. Only the instances changed since the last draw are sent to GPU
+class InstanceBuffer {
+   public:
+    using InstanceId = size_t;
+
+    InstanceBuffer();
+    ~InstanceBuffer();
+    InstanceBuffer(const InstanceBuffer&) = delete;
+    InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+
+    InstanceId add(const InstanceData& instance);
+    void set(InstanceId instance, const InstanceData& data);
+    void setModelTr(InstanceId instance, const glm::mat4& tr);
+    void setMaterial(InstanceId instance, MaterialIndex material);
+    void clear();
+    size_t size() const;
+    // sends changed instances to GPU and points the instance attributes of the bound VAO to the buffer
+    void bindAttributes();
+    // disables the instance attributes of the bound VAO, so that draws without instances don't read them
+    void unbindAttributes() const;
+
+   private:
+    std::vector<InstanceData> instances_;
+    unsigned int buffer_;
+    // in instances
+    size_t capacity_{0};
+    // instances changed since the last upload, unsorted and possibly repeated
+    std::vector<InstanceId> dirtyInstances_;
+
+    void markDirty_(InstanceId instance);
+    void upload_();
+};
@@ -0,0 +1,325 @@
+#include "LightClusters.h"
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <future>
+#include <limits>
+
+namespace {
+// color and ambient, position and diffuse, direction and specular, attenuation and range, cone, see loadLight
+// in shader.fs
+constexpr size_t cRecordTexels{5};
+// lights are cut off where they add less than this to a color channel, about a step of an 8 bit color
+constexpr float cLightCutoff{1.0f / 256.0f};
+
+// std140 mirror of ClusterData in shader.fs
+struct ClusterBlockData {
+    glm::vec2 tileSize;
+    float sliceScale;
+    float sliceBias;
+    glm::ivec3 clustersCount;
+    int lightsCount;
+    int isClustered;
+    int padding[3];
+};
+static_assert(sizeof(ClusterBlockData) == 48 && offsetof(ClusterBlockData, lightsCount) == 28);
+
+void sCreateTextureBuffer(unsigned int& buffer, unsigned int& texture, GLenum format) {
+    glGenBuffers(1, &buffer);
+    // a generated name becomes a buffer object only when it is bound
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+// the lists change every frame, respecifying the store spares waiting for the previous frame to read them
+template <typename T>
+void sUploadTexels(unsigned int buffer, std::vector<T>& texels, size_t texelSize) {
+    // an empty buffer texture is not guaranteed to read as zeros, keep at least one texel
+    texels.resize(std::max(texels.size(), texelSize), T{});
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    glBufferData(GL_TEXTURE_BUFFER, static_cast<GLsizeiptr>(texels.size() * sizeof(T)), texels.data(),
+                 GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+// distance where a point or a spot light drops under cLightCutoff, 0 for lights adding nothing
+template <typename Light>
+float sLightRange(const Light& light) {
+    auto peak = std::max({light.color.x, light.color.y, light.color.z}) *
+                (light.ambientIntence + light.diffuseIntence + light.specularIntence);
+    if (peak <= 0.0f) {
+        return 0.0f;
+    }
+    if (light.range > 0.0f) {
+        return light.range;
+    }
+    // quadratic * d^2 + linear * d + constant = peak / cLightCutoff
+    auto c = light.constant - peak / cLightCutoff;
+    if (c >= 0.0f) {
+        return 0.0f;
+    }
+    if (light.quadratic > 0.0f) {
+        return (-light.linear + std::sqrt(light.linear * light.linear - 4.0f * light.quadratic * c)) /
+               (2.0f * light.quadratic);
+    }
+    if (light.linear > 0.0f) {
+        return -c / light.linear;
+    }
+    return std::numeric_limits<float>::max();
+}
+
+int sSlice(float depth, float sliceScale, float sliceBias) {
+    auto slice = static_cast<int>(std::floor(std::log(depth) * sliceScale + sliceBias));
+    return std::clamp(slice, 0, cClusterSlices - 1);
+}
+
+int sTile(float ndc, int tilesCount) {
+    // lights without attenuation have an unbounded range and reach infinite ndc, clamped before the cast
+    ndc = std::clamp(ndc, -1.0f, 1.0f);
+    auto tile = static_cast<int>(std::floor((ndc + 1.0f) * 0.5f * static_cast<float>(tilesCount)));
+    return std::clamp(tile, 0, tilesCount - 1);
+}
+
+bool sSphereTouchesBox(const glm::vec3& center, float radius, const glm::vec3& boxMin,
+                       const glm::vec3& boxMax) {
+    auto offset = center - glm::clamp(center, boxMin, boxMax);
+    return glm::dot(offset, offset) <= radius * radius;
+}
+}  // namespace
+
+LightClusters::LightClusters() {
+    sCreateTextureBuffer(recordsBuffer_, recordsTexture_, GL_RGBA32F);
+    sCreateTextureBuffer(listsBuffer_, listsTexture_, GL_RG32I);
+    sCreateTextureBuffer(indicesBuffer_, indicesTexture_, GL_R32I);
+    glGenBuffers(1, &blockBuffer_);
+    glBindBuffer(GL_UNIFORM_BUFFER, blockBuffer_);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(ClusterBlockData), nullptr, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, cClusterBlockBinding, blockBuffer_);
+}
+
+LightClusters::~LightClusters() {
+    glDeleteTextures(1, &recordsTexture_);
+    glDeleteTextures(1, &listsTexture_);
+    glDeleteTextures(1, &indicesTexture_);
+    glDeleteBuffers(1, &recordsBuffer_);
+    glDeleteBuffers(1, &listsBuffer_);
+    glDeleteBuffers(1, &indicesBuffer_);
+    glDeleteBuffers(1, &blockBuffer_);
+}
+
+void LightClusters::update(const ClusterView& view, std::span<const PointLight> pointLights,
+                           std::span<const SpotLight> spotLights) {
+    auto start = std::chrono::steady_clock::now();
+    buildClusterBoxes_(view);
+    records_.clear();
+    bounds_.clear();
+    for (const auto& light : pointLights) {
+        auto range = sLightRange(light);
+        if (range <= 0.0f) {
+            continue;
+        }
+        // point lights have no direction and no cone, the last texel tells them from spot lights
+        records_.insert(records_.end(), {light.color.x, light.color.y, light.color.z, light.ambientIntence,
+                                         light.position.x, light.position.y, light.position.z,
+                                         light.diffuseIntence, 0.0f, 0.0f, -1.0f, light.specularIntence,
+                                         light.constant, light.linear, light.quadratic, range,
+                                         0.0f, 0.0f, 0.0f, 0.0f});
+        addLight_(view, light.position, range);
+    }
+    for (const auto& light : spotLights) {
+        auto range = sLightRange(light);
+        if (range <= 0.0f) {
+            continue;
+        }
+        // the cone is bounded by the sphere of the range, which is loose for narrow cones but cheap to test
+        records_.insert(records_.end(), {light.color.x, light.color.y, light.color.z, light.ambientIntence,
+                                         light.position.x, light.position.y, light.position.z,
+                                         light.diffuseIntence, light.direction.x, light.direction.y,
+                                         light.direction.z, light.specularIntence, light.constant,
+                                         light.linear, light.quadratic, range, light.cutOff,
+                                         light.outerCutOff, 1.0f, 0.0f});
+        addLight_(view, light.position, range);
+    }
+    stats_.lightsCount = records_.size() / (cRecordTexels * 4);
+    stats_.visibleLightsCount = bounds_.size();
+
+    if (isClustered_) {
+        assign_();
+    } else {
+        lists_.clear();
+        indices_.clear();
+    }
+    stats_.lightIndicesCount = indices_.size();
+    stats_.maxClusterLightsCount = 0;
+    for (size_t cluster = 0; cluster < lists_.size() / 2; ++cluster) {
+        stats_.maxClusterLightsCount =
+            std::max(stats_.maxClusterLightsCount, static_cast<size_t>(lists_[2 * cluster + 1]));
+    }
+    stats_.assignmentMs =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    upload_(view);
+}
+
+void LightClusters::setClustered(bool isClustered) { isClustered_ = isClustered; }
+
+bool LightClusters::isClustered() const { return isClustered_; }
+
+const LightClusters::Stats& LightClusters::stats() const { return stats_; }
+
+void LightClusters::buildClusterBoxes_(const ClusterView& view) {
+    glm::vec4 projection{view.fieldOfView, view.aspectRatio, view.near, view.far};
+    if (projection == boxesProjection_ && !clusterMins_.empty()) {
+        return;
+    }
+    boxesProjection_ = projection;
+    clusterMins_.resize(cClustersCount);
+    clusterMaxs_.resize(cClustersCount);
+    auto tanY = std::tan(view.fieldOfView / 2.0f);
+    auto tanX = tanY * view.aspectRatio;
+    auto depthRatio = view.far / view.near;
+    for (int slice = 0; slice < cClusterSlices; ++slice) {
+        auto nearDepth = view.near * std::pow(depthRatio, static_cast<float>(slice) / cClusterSlices);
+        auto farDepth = view.near * std::pow(depthRatio, static_cast<float>(slice + 1) / cClusterSlices);
+        for (int tileY = 0; tileY < cClusterTilesY; ++tileY) {
+            auto minY = -1.0f + 2.0f * static_cast<float>(tileY) / cClusterTilesY;
+            auto maxY = -1.0f + 2.0f * static_cast<float>(tileY + 1) / cClusterTilesY;
+            for (int tileX = 0; tileX < cClusterTilesX; ++tileX) {
+                auto minX = -1.0f + 2.0f * static_cast<float>(tileX) / cClusterTilesX;
+                auto maxX = -1.0f + 2.0f * static_cast<float>(tileX + 1) / cClusterTilesX;
+                // sides of a tile are planes through the eye, its extremes are at the near or the far depth
+                auto cluster = static_cast<size_t>((slice * cClusterTilesY + tileY) * cClusterTilesX + tileX);
+                clusterMins_[cluster] = {std::min(minX * nearDepth, minX * farDepth) * tanX,
+                                         std::min(minY * nearDepth, minY * farDepth) * tanY, -farDepth};
+                clusterMaxs_[cluster] = {std::max(maxX * nearDepth, maxX * farDepth) * tanX,
+                                         std::max(maxY * nearDepth, maxY * farDepth) * tanY, -nearDepth};
+            }
+        }
+    }
+}
+
+void LightClusters::addLight_(const ClusterView& view, const glm::vec3& position, float radius) {
+    auto record = static_cast<int32_t>(records_.size() / (cRecordTexels * 4)) - 1;
+    auto center = glm::vec3(view.viewTr * glm::vec4(position, 1.0f));
+    auto depth = -center.z;
+    if (depth + radius < view.near || depth - radius > view.far) {
+        return;
+    }
+    auto minDepth = std::max(depth - radius, view.near);
+    auto maxDepth = std::min(depth + radius, view.far);
+    auto tanY = std::tan(view.fieldOfView / 2.0f);
+    auto tanX = tanY * view.aspectRatio;
+    // x / depth of the sphere box is extreme at its corners, depths are positive here
+    auto minNdcX = std::min((center.x - radius) / minDepth, (center.x - radius) / maxDepth) / tanX;
+    auto maxNdcX = std::max((center.x + radius) / minDepth, (center.x + radius) / maxDepth) / tanX;
+    auto minNdcY = std::min((center.y - radius) / minDepth, (center.y - radius) / maxDepth) / tanY;
+    auto maxNdcY = std::max((center.y + radius) / minDepth, (center.y + radius) / maxDepth) / tanY;
+    if (maxNdcX < -1.0f || minNdcX > 1.0f || maxNdcY < -1.0f || minNdcY > 1.0f) {
+        return;
+    }
+    auto sliceScale = cClusterSlices / std::log(view.far / view.near);
+    auto sliceBias = -std::log(view.near) * sliceScale;
+    bounds_.push_back({.center = center,
+                       .radius = radius,
+                       .record = record,
+                       .minCluster = {sTile(minNdcX, cClusterTilesX), sTile(minNdcY, cClusterTilesY),
+                                      sSlice(minDepth, sliceScale, sliceBias)},
+                       .maxCluster = {sTile(maxNdcX, cClusterTilesX), sTile(maxNdcY, cClusterTilesY),
+                                      sSlice(maxDepth, sliceScale, sliceBias)}});
+}
+
+void LightClusters::assignSlices_(int firstSlice, int lastSlice, SlicesLists& slicesLists) const {
+    slicesLists.lists.clear();
+    slicesLists.indices.clear();
+    std::vector<const LightBounds*> sliceLights;
+    for (int slice = firstSlice; slice < lastSlice; ++slice) {
+        sliceLights.clear();
+        for (const auto& light : bounds_) {
+            if (light.minCluster.z <= slice && slice <= light.maxCluster.z) {
+                sliceLights.push_back(&light);
+            }
+        }
+        for (int tileY = 0; tileY < cClusterTilesY; ++tileY) {
+            for (int tileX = 0; tileX < cClusterTilesX; ++tileX) {
+                auto cluster = static_cast<size_t>((slice * cClusterTilesY + tileY) * cClusterTilesX + tileX);
+                auto offset = slicesLists.indices.size();
+                for (const auto* light : sliceLights) {
+                    if (tileX < light->minCluster.x || tileX > light->maxCluster.x ||
+                        tileY < light->minCluster.y || tileY > light->maxCluster.y) {
+                        continue;
+                    }
+                    if (sSphereTouchesBox(light->center, light->radius, clusterMins_[cluster],
+                                          clusterMaxs_[cluster])) {
+                        slicesLists.indices.push_back(light->record);
+                    }
+                }
+                slicesLists.lists.push_back(static_cast<int32_t>(offset));
+                slicesLists.lists.push_back(static_cast<int32_t>(slicesLists.indices.size() - offset));
+            }
+        }
+    }
+}
+
+void LightClusters::assign_() {
+    // every worker takes a run of slices, the lists of a run are contiguous and follow the previous run
+    auto runsCount = std::min(workers_.size(), static_cast<size_t>(cClusterSlices));
+    slicesLists_.resize(runsCount);
+    std::vector<std::future<void>> runs;
+    runs.reserve(runsCount);
+    for (size_t run = 0; run < runsCount; ++run) {
+        auto firstSlice = static_cast<int>(run * cClusterSlices / runsCount);
+        auto lastSlice = static_cast<int>((run + 1) * cClusterSlices / runsCount);
+        runs.push_back(workers_.submit([this, firstSlice, lastSlice, &slicesLists = slicesLists_[run]]() {
+            assignSlices_(firstSlice, lastSlice, slicesLists);
+        }));
+    }
+    for (auto& run : runs) {
+        run.get();
+    }
+
+    lists_.clear();
+    indices_.clear();
+    for (const auto& slicesLists : slicesLists_) {
+        auto base = static_cast<int32_t>(indices_.size());
+        for (size_t cluster = 0; cluster < slicesLists.lists.size() / 2; ++cluster) {
+            lists_.push_back(slicesLists.lists[2 * cluster] + base);
+            lists_.push_back(slicesLists.lists[2 * cluster + 1]);
+        }
+        indices_.insert(indices_.end(), slicesLists.indices.begin(), slicesLists.indices.end());
+    }
+}
+
+void LightClusters::upload_(const ClusterView& view) {
+    sUploadTexels(recordsBuffer_, records_, 4);
+    sUploadTexels(listsBuffer_, lists_, 2);
+    sUploadTexels(indicesBuffer_, indices_, 1);
+
+    auto sliceScale = cClusterSlices / std::log(view.far / view.near);
+    ClusterBlockData data{
+        .tileSize = view.viewportSize / glm::vec2(cClusterTilesX, cClusterTilesY),
+        .sliceScale = sliceScale,
+        .sliceBias = -std::log(view.near) * sliceScale,
+        .clustersCount = {cClusterTilesX, cClusterTilesY, cClusterSlices},
+        .lightsCount = static_cast<int>(stats_.lightsCount),
+        .isClustered = isClustered_ ? 1 : 0,
+        .padding = {},
+    };
+    glBindBuffer(GL_UNIFORM_BUFFER, blockBuffer_);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(ClusterBlockData), &data, GL_DYNAMIC_DRAW);
+
+    // nothing else uses these units, the textures stay bound for the whole frame
+    for (auto [unit, texture] : {std::pair{cLightRecordsUnit, recordsTexture_},
+                                 std::pair{cClusterListsUnit, listsTexture_},
+                                 std::pair{cClusterLightsUnit, indicesTexture_}}) {
+        glActiveTexture(GL_TEXTURE0 + static_cast<GLenum>(unit));
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
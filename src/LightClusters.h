@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "ShaderProgram.h"
+#include "ThreadPool.h"
+
+// the view frustum is split into tiles of the screen and slices of the depth. Slices get exponentially
+// deeper, so that clusters keep about the same proportions from the near plane to the far one
+constexpr int cClusterTilesX{16};
+constexpr int cClusterTilesY{9};
+constexpr int cClusterSlices{24};
+constexpr size_t cClustersCount{static_cast<size_t>(cClusterTilesX * cClusterTilesY * cClusterSlices)};
+
+// perspective camera the lights are clustered for, the one of the projection of the frame
+struct ClusterView {
+    glm::mat4 viewTr;
+    // vertical, in radians
+    float fieldOfView;
+    float aspectRatio;
+    float near;
+    float far;
+    // in pixels
+    glm::vec2 viewportSize;
+};
+
+// point and spot lights of a scene and the lists of lights reaching every cluster of the view frustum, kept
+// in texture buffers read by shader.fs. A fragment evaluates only the lights of its cluster, so its cost
+// depends on the lights around it rather than on all lights of the scene.
+// Lights are assigned on the CPU by the workers of an own pool, GL 3.3 has no compute shaders
+class LightClusters {
+   public:
+    struct Stats {
+        // black lights are left out
+        size_t lightsCount = 0;
+        // lights reaching the view frustum
+        size_t visibleLightsCount = 0;
+        size_t lightIndicesCount = 0;
+        size_t maxClusterLightsCount = 0;
+        double assignmentMs = 0.0;
+    };
+
+    LightClusters();
+    ~LightClusters();
+    LightClusters(const LightClusters&) = delete;
+    LightClusters& operator=(const LightClusters&) = delete;
+
+    // assigns the lights to the clusters of the view, uploads the lists and binds them to their texture units
+    // for the frame. Spot lights follow the point lights in the records
+    void update(const ClusterView& view, std::span<const PointLight> pointLights,
+                std::span<const SpotLight> spotLights);
+    // without clustering every fragment evaluates every light, kept to compare frame times
+    void setClustered(bool isClustered);
+    bool isClustered() const;
+    const Stats& stats() const;
+
+   private:
+    // bounding sphere of a light in view space and the box of clusters it may reach
+    struct LightBounds {
+        glm::vec3 center;
+        float radius;
+        int32_t record;
+        glm::ivec3 minCluster;
+        glm::ivec3 maxCluster;
+    };
+    // lists of the clusters of some slices, filled by one worker
+    struct SlicesLists {
+        // offset in indices and count per cluster
+        std::vector<int32_t> lists;
+        std::vector<int32_t> indices;
+    };
+
+    ThreadPool workers_;
+    // view space boxes of the clusters, rebuilt when the projection changes
+    std::vector<glm::vec3> clusterMins_;
+    std::vector<glm::vec3> clusterMaxs_;
+    glm::vec4 boxesProjection_{0.0f};
+    std::vector<float> records_;
+    std::vector<LightBounds> bounds_;
+    std::vector<SlicesLists> slicesLists_;
+    std::vector<int32_t> lists_;
+    std::vector<int32_t> indices_;
+    unsigned int recordsBuffer_;
+    unsigned int recordsTexture_;
+    unsigned int listsBuffer_;
+    unsigned int listsTexture_;
+    unsigned int indicesBuffer_;
+    unsigned int indicesTexture_;
+    unsigned int blockBuffer_;
+    bool isClustered_{true};
+    Stats stats_;
+
+    void buildClusterBoxes_(const ClusterView& view);
+    void addLight_(const ClusterView& view, const glm::vec3& position, float radius);
+    void assignSlices_(int firstSlice, int lastSlice, SlicesLists& slicesLists) const;
+    void assign_();
+    void upload_(const ClusterView& view);
+};
@@ -0,0 +1,185 @@
+#include "MaterialTable.h"
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <map>
+
+namespace {
+constexpr size_t cRecordTexels{2};
+
+// array unit and layer share one int in the shader, see sampleLayer in shader.fs
+int32_t sPackLayerRef(int unit, TextureLayerIndex layer) { return (unit << 16) | layer; }
+
+void sCreateTextureBuffer(unsigned int& buffer, unsigned int& texture, GLenum format) {
+    glGenBuffers(1, &buffer);
+    // a generated name becomes a buffer object only when it is bound
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+    // the texture keeps pointing to the buffer when its store is respecified
+    glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+// a set holding all the arrays of a material, they are added to the first set with room for the missing
+// ones if none does. Materials with the same arrays are placed once, so instances sharing textures share
+// a set
+ArraySetIndex sPlaceArrays(std::vector<std::vector<TextureID>>& arraySets,
+                           const std::vector<TextureID>& arrays,
+                           std::map<std::vector<TextureID>, ArraySetIndex>& placedArrays) {
+    auto placedIt = placedArrays.find(arrays);
+    if (placedIt != placedArrays.end()) {
+        return placedIt->second;
+    }
+    auto setIdx = arraySets.size();
+    for (size_t candidateIdx = 0; candidateIdx < arraySets.size(); ++candidateIdx) {
+        const auto& candidate = arraySets[candidateIdx];
+        auto missingCount = std::ranges::count_if(
+            arrays, [&](TextureID array) { return std::ranges::find(candidate, array) == candidate.end(); });
+        if (candidate.size() + static_cast<size_t>(missingCount) <= cMaxMaterialTextureArrays) {
+            setIdx = candidateIdx;
+            break;
+        }
+    }
+    if (setIdx == arraySets.size()) {
+        arraySets.emplace_back();
+    }
+    auto& arraySet = arraySets[setIdx];
+    for (auto array : arrays) {
+        if (std::ranges::find(arraySet, array) == arraySet.end()) {
+            arraySet.push_back(array);
+        }
+    }
+    auto arraySetIdx = static_cast<ArraySetIndex>(setIdx);
+    placedArrays.emplace(arrays, arraySetIdx);
+    return arraySetIdx;
+}
+
+void sUploadTexels(unsigned int buffer, std::vector<int32_t>& texels, size_t texelSize) {
+    // an empty buffer texture is not guaranteed to read as zeros, keep at least one texel
+    texels.resize(std::max(texels.size(), texelSize), 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    glBufferData(GL_TEXTURE_BUFFER, static_cast<GLsizeiptr>(texels.size() * sizeof(int32_t)), texels.data(),
+                 GL_STATIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+}  // namespace
+
+MaterialTable::MaterialTable() {
+    sCreateTextureBuffer(recordsBuffer_, recordsTexture_, GL_RGBA32I);
+    sCreateTextureBuffer(layersBuffer_, layersTexture_, GL_R32I);
+}
+
+MaterialTable::~MaterialTable() {
+    glDeleteTextures(1, &recordsTexture_);
+    glDeleteTextures(1, &layersTexture_);
+    glDeleteBuffers(1, &recordsBuffer_);
+    glDeleteBuffers(1, &layersBuffer_);
+}
+
+MaterialIndex MaterialTable::add(const Material& material) {
+    isDirty_ = true;
+    if (freeIndices_.empty()) {
+        materials_.push_back(material);
+        return static_cast<MaterialIndex>(materials_.size() - 1);
+    }
+    auto index = freeIndices_.back();
+    freeIndices_.pop_back();
+    materials_[index] = material;
+    return index;
+}
+
+void MaterialTable::update(MaterialIndex index, const Material& material) {
+    materials_[index] = material;
+    isDirty_ = true;
+}
+
+const Material& MaterialTable::material(MaterialIndex index) const { return materials_[index]; }
+
+void MaterialTable::remove(MaterialIndex index) {
+    // an empty material holds no texture arrays, so they leave their sets on the next upload
+    materials_[index] = Material{};
+    freeIndices_.push_back(index);
+    isDirty_ = true;
+}
+
+const std::array<int, cTextureTypesCount>& MaterialTable::layersCounts(MaterialIndex index) {
+    if (isDirty_) {
+        upload_();
+    }
+    return layersCounts_[index];
+}
+
+ArraySetIndex MaterialTable::arraySet(MaterialIndex index) {
+    if (isDirty_) {
+        upload_();
+    }
+    return materialArraySets_[index];
+}
+
+void MaterialTable::bind() {
+    if (isDirty_) {
+        upload_();
+    }
+    glActiveTexture(GL_TEXTURE0 + cMaterialRecordsUnit);
+    glBindTexture(GL_TEXTURE_BUFFER, recordsTexture_);
+    glActiveTexture(GL_TEXTURE0 + cMaterialLayersUnit);
+    glBindTexture(GL_TEXTURE_BUFFER, layersTexture_);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void MaterialTable::bindArraySet(ArraySetIndex arraySet) {
+    if (arraySet == cAnyArraySet) {
+        return;
+    }
+    const auto& arrays = arraySets_[static_cast<size_t>(arraySet)];
+    for (size_t unit = 0; unit < arrays.size(); ++unit) {
+        glActiveTexture(GL_TEXTURE0 + static_cast<GLenum>(unit));
+        glBindTexture(GL_TEXTURE_2D_ARRAY, arrays[unit]);
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void MaterialTable::upload_() {
+    std::vector<int32_t> records;
+    std::vector<int32_t> layers;
+    records.reserve(materials_.size() * cRecordTexels * 4);
+    arraySets_.clear();
+    layersCounts_.clear();
+    materialArraySets_.clear();
+    std::map<std::vector<TextureID>, ArraySetIndex> placedArrays;
+    for (const auto& material : materials_) {
+        auto layersOffset = static_cast<int32_t>(layers.size());
+        int32_t layersCounts[cTextureTypesCount] = {};
+        // TextureArrayManager::makeTextureData keeps the arrays of a material within one set
+        auto arraySet = material.textureData && !material.textureData->arrays.empty()
+                            ? sPlaceArrays(arraySets_, material.textureData->arrays, placedArrays)
+                            : cAnyArraySet;
+        for (size_t typeIdx = 0; arraySet != cAnyArraySet && typeIdx < cTextureTypesCount; ++typeIdx) {
+            auto textureLayersIt = material.textureData->textures.find(static_cast<TextureType>(typeIdx));
+            if (textureLayersIt == material.textureData->textures.end()) {
+                continue;
+            }
+            const auto& arrays = arraySets_[static_cast<size_t>(arraySet)];
+            for (const auto& layerRef : textureLayersIt->second) {
+                auto array = material.textureData->arrays[layerRef.arrayIdx];
+                auto unit = static_cast<int>(std::ranges::find(arrays, array) - arrays.begin());
+                layers.push_back(sPackLayerRef(unit, layerRef.layer));
+                ++layersCounts[typeIdx];
+            }
+        }
+        records.insert(records.end(), {std::bit_cast<int32_t>(material.color.x),
+                                       std::bit_cast<int32_t>(material.color.y),
+                                       std::bit_cast<int32_t>(material.color.z),
+                                       std::bit_cast<int32_t>(material.shininess)});
+        records.insert(records.end(), {layersCounts[0], layersCounts[1], layersCounts[2], layersOffset});
+        layersCounts_.push_back({layersCounts[0], layersCounts[1], layersCounts[2]});
+        materialArraySets_.push_back(arraySet);
+    }
+    sUploadTexels(recordsBuffer_, records, 4);
+    sUploadTexels(layersBuffer_, layers, 1);
+    isDirty_ = false;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include "ShaderProgram.h"
+
+// position of a material in a MaterialTable, draws pass only this index
+using MaterialIndex = int;
+// texture arrays bound together, see MaterialTable::arraySet
+using ArraySetIndex = int;
+// materials without textures are drawn with any array set bound
+constexpr ArraySetIndex cAnyArraySet{-1};
+
+// materials of a scene in two texture buffers read by shader.fs: two RGBA32I texels per material (color and
+// shininess as float bits, layers counts and the offset of the layers) and one R32I texel per texture layer.
+// The buffers are rebuilt only after materials change. Texture arrays of the materials are grouped on upload
+// into sets of at most cMaxMaterialTextureArrays, one set is bound at a time and layer refs point to the
+// units of the set of their material. Materials using the same arrays always share a set
+class MaterialTable {
+   public:
+    MaterialTable();
+    ~MaterialTable();
+    MaterialTable(const MaterialTable&) = delete;
+    MaterialTable& operator=(const MaterialTable&) = delete;
+
+    MaterialIndex add(const Material& material);
+    void update(MaterialIndex index, const Material& material);
+    const Material& material(MaterialIndex index) const;
+    // the index may be handed out again by add
+    void remove(MaterialIndex index);
+    // layers per texture type in the record of the material. Uploads pending changes
+    const std::array<int, cTextureTypesCount>& layersCounts(MaterialIndex index);
+    // the set to bind before drawing the material, cAnyArraySet for materials without textures. Uploads
+    // pending changes
+    ArraySetIndex arraySet(MaterialIndex index);
+    // uploads pending changes and binds the buffers, call before drawing with the table
+    void bind();
+    // binds the texture arrays of the set to their units, call after bind
+    void bindArraySet(ArraySetIndex arraySet);
+
+   private:
+    std::vector<Material> materials_;
+    std::vector<MaterialIndex> freeIndices_;
+    bool isDirty_{true};
+    unsigned int recordsBuffer_;
+    unsigned int recordsTexture_;
+    unsigned int layersBuffer_;
+    unsigned int layersTexture_;
+    // texture array bound to each unit, per set
+    std::vector<std::vector<TextureID>> arraySets_;
+    // as written to the records by the last upload
+    std::vector<std::array<int, cTextureTypesCount>> layersCounts_;
+    std::vector<ArraySetIndex> materialArraySets_;
+
+
+    void upload_();
+};
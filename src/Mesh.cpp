@@ -1,59 +1,244 @@
 #include "Mesh.h"
+#include "GeometryArena.h"
+#include "InstanceBuffer.h"
 
-#include <glad/glad.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 
-Mesh::Mesh(const std::vector<Vertex>& vertices, const std::vector<int>& indices, const Material& material)
-    : vertices_{vertices}, indices_{indices}, material_{material} {
+namespace {
+static_assert(sizeof(CompactVertex) == 16);
+
+// maps the unit sphere onto the [-1, 1] square, see Cigolle et al. "A Survey of Efficient Representations for
+// Independent Unit Vectors"
+glm::vec2 sOctahedralEncode(const glm::vec3& normal) {
+    float manhattanLength = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+    if (manhattanLength == 0.0f) {
+        return glm::vec2(0.0f);
+    }
+    glm::vec2 encoded = glm::vec2(normal.x, normal.y) / manhattanLength;
+    if (normal.z < 0.0f) {
+        // the lower hemisphere is folded over the diagonals
+        encoded = glm::vec2((1.0f - std::abs(encoded.y)) * (encoded.x >= 0.0f ? 1.0f : -1.0f),
+                            (1.0f - std::abs(encoded.x)) * (encoded.y >= 0.0f ? 1.0f : -1.0f));
+    }
+    return encoded;
+}
+
+template <typename T>
+void sAppendBytes(std::vector<unsigned char>& bytes, const T& value) {
+    auto begin = reinterpret_cast<const unsigned char*>(&value);
+    bytes.insert(bytes.end(), begin, begin + sizeof(T));
+}
+
+}  // namespace
+
+BoundingBox computeBounds(std::span<const Vertex> vertices) {
+    BoundingBox bounds;
+    if (!vertices.empty()) {
+        bounds.min = bounds.max = vertices.front().position;
+    }
+    for (const auto& vertex : vertices) {
+        bounds.min = glm::min(bounds.min, vertex.position);
+        bounds.max = glm::max(bounds.max, vertex.position);
+    }
+    return bounds;
+}
+
+BoundingBox transformBounds(const BoundingBox& bounds, const glm::mat4& tr) {
+    // the extent along every world axis is the sum of the local extents projected on it, see Arvo
+    // "Transforming Axis-Aligned Bounding Boxes"
+    glm::vec3 center = glm::vec3(tr * glm::vec4((bounds.min + bounds.max) * 0.5f, 1.0f));
+    glm::vec3 halfExtent = (bounds.max - bounds.min) * 0.5f;
+    glm::vec3 worldHalfExtent(0.0f);
+    for (int column = 0; column < 3; ++column) {
+        worldHalfExtent += glm::abs(glm::vec3(tr[column])) * halfExtent[column];
+    }
+    return BoundingBox{center - worldHalfExtent, center + worldHalfExtent};
+}
+
+MeshGeometry encodeGeometry(std::span<const Vertex> vertices, std::span<const int> indices,
+                            VertexFormat format, const std::optional<BoundingBox>& positionBounds) {
+    MeshGeometry geometry;
+    geometry.vertexFormat = format;
+    geometry.bounds = computeBounds(vertices);
+    if (format == VertexFormat::Full) {
+        auto begin = reinterpret_cast<const unsigned char*>(vertices.data());
+        geometry.vertexData.assign(begin, begin + vertices.size_bytes());
+    } else {
+        auto bounds = positionBounds ? *positionBounds : geometry.bounds;
+        geometry.positionOffset = bounds.min;
+        geometry.positionScale = bounds.max - bounds.min;
+
+        geometry.vertexData.reserve(vertices.size() * sizeof(CompactVertex));
+        for (const auto& vertex : vertices) {
+            CompactVertex compact;
+            for (int axis = 0; axis < 3; ++axis) {
+                float extent = geometry.positionScale[axis];
+                float normalized =
+                    extent > 0.0f ? (vertex.position[axis] - bounds.min[axis]) / extent : 0.0f;
+                compact.position[axis] =
+                    static_cast<uint16_t>(std::lround(std::clamp(normalized, 0.0f, 1.0f) * 65535.0f));
+            }
+            compact.position[3] = 0;
+            compact.normal = glm::packSnorm2x16(sOctahedralEncode(vertex.normal));
+            compact.texCoord = glm::packHalf2x16(vertex.texCoord);
+            sAppendBytes(geometry.vertexData, compact);
+        }
+    }
+
+    geometry.indicesCount = indices.size();
+    geometry.lods = {MeshLod{0, indices.size(), 0.0f}};
+    geometry.hasShortIndices = vertices.size() <= 65536;
+    if (geometry.hasShortIndices) {
+        geometry.indexData.reserve(indices.size() * sizeof(uint16_t));
+        for (int index : indices) {
+            sAppendBytes(geometry.indexData, static_cast<uint16_t>(index));
+        }
+    } else {
+        auto begin = reinterpret_cast<const unsigned char*>(indices.data());
+        geometry.indexData.assign(begin, begin + indices.size_bytes());
+    }
+    return geometry;
+}
+
+Mesh::Mesh(std::span<const Vertex> vertices, std::span<const int> indices, MaterialIndex material,
+           VertexFormat vertexFormat)
+    : geometry_{encodeGeometry(vertices, indices, vertexFormat)},
+      material_{material},
+      ownArena_{std::make_unique<GeometryArena>()},
+      arena_{ownArena_.get()} {
     init_();
 }
 
-void Mesh::init_() {
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
+Mesh::Mesh(MeshGeometry&& geometry, MaterialIndex material, GeometryArena& arena)
+    : geometry_{std::move(geometry)}, material_{material}, arena_{&arena} {
+    init_();
+}
 
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+Mesh::Mesh(MeshGeometry&& geometry, MaterialIndex material, GeometryArena& arena, DeferredUpload)
+    : geometry_{std::move(geometry)}, material_{material}, arena_{&arena} {
+    init_(false);
+}
 
-    glBufferData(GL_ARRAY_BUFFER, vertices_.size() * sizeof(Vertex), &vertices_[0], GL_STATIC_DRAW);
+Mesh::~Mesh() { arena_->free(allocation_); }
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices_.size() * sizeof(unsigned int), &indices_[0],
-                 GL_STATIC_DRAW);
+void Mesh::init_(bool uploadData) {
+    updateWorldBounds_();
+    allocation_ = arena_->allocate(geometry_);
+    geometryBytes_ = geometry_.vertexData.size() + geometry_.indexData.size();
+    uploadedBytes_ = 0;
+    if (uploadData) {
+        uploadStep(geometryBytes());
+    }
+}
+
+size_t Mesh::uploadStep(size_t maxBytes) {
+    const auto verticesBytes = geometry_.vertexData.size();
+    const auto indicesBytes = geometry_.indexData.size();
+    size_t uploaded = 0;
+    while (uploaded < maxBytes && !isUploaded()) {
+        bool isVertexData = uploadedBytes_ < verticesBytes;
+        auto offset = isVertexData ? uploadedBytes_ : uploadedBytes_ - verticesBytes;
+        auto size = std::min(maxBytes - uploaded, (isVertexData ? verticesBytes : indicesBytes) - offset);
+        auto data = std::span<const unsigned char>(
+            (isVertexData ? geometry_.vertexData.data() : geometry_.indexData.data()) + offset, size);
+        if (isVertexData) {
+            arena_->writeVertices(allocation_, offset, data);
+        } else {
+            arena_->writeIndices(allocation_, offset, data);
+        }
+        uploadedBytes_ += size;
+        uploaded += size;
+    }
+    return uploaded;
+}
+
+bool Mesh::isUploaded() const { return uploadedBytes_ == geometryBytes_; }
 
-    // vertex positions
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-    // vertex normals
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
-    // vertex texture coords
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoord));
+size_t Mesh::geometryBytes() const { return geometryBytes_; }
 
-    glBindVertexArray(0);
+void Mesh::releaseGeometryData() {
+    if (isUploaded()) {
+        // swapped with empty vectors, clear() keeps the capacity
+        std::vector<unsigned char>().swap(geometry_.vertexData);
+        std::vector<unsigned char>().swap(geometry_.indexData);
+    }
 }
 
-void Mesh::setLocalTr(const glm::mat4& tr) { localTr_ = tr; }
-void Mesh::resetLocalTr() { localTr_ = glm::mat4(1.0f); }
-void Mesh::setModelTr(const glm::mat4& tr) { modelTr_ = tr; }
-void Mesh::resetModelTr() { modelTr_ = glm::mat4(1.0f); }
+void Mesh::setLocalTr(const glm::mat4& tr) {
+    localTr_ = tr;
+    updateWorldBounds_();
+}
+void Mesh::resetLocalTr() { setLocalTr(glm::mat4(1.0f)); }
+void Mesh::setModelTr(const glm::mat4& tr) {
+    modelTr_ = tr;
+    updateWorldBounds_();
+}
+void Mesh::resetModelTr() { setModelTr(glm::mat4(1.0f)); }
+
+const BoundingBox& Mesh::worldBounds() const { return worldBounds_; }
+const BoundingSphere& Mesh::worldSphere() const { return worldSphere_; }
+
+void Mesh::updateWorldBounds_() {
+    auto tr = modelTr_ * localTr_;
+    const auto& bounds = geometry_.bounds;
+    worldBounds_ = transformBounds(bounds, tr);
+    // the sphere around the local box scaled by the largest axis scale, tighter than the one around the
+    // world box for rotated meshes
+    worldScale_ = std::max({glm::length(glm::vec3(tr[0])), glm::length(glm::vec3(tr[1])),
+                            glm::length(glm::vec3(tr[2]))});
+    worldSphere_.center = glm::vec3(tr * glm::vec4((bounds.min + bounds.max) * 0.5f, 1.0f));
+    worldSphere_.radius = glm::length(bounds.max - bounds.min) * 0.5f * worldScale_;
+}
 
 void Mesh::draw(ShaderProgram& shader) const {
-    shader.setUniform("modelTr", modelTr_);
-    shader.setUniform("localTr", localTr_);
-    // set material
-    shader.setUniform("material", material_);
+    if (!isUploaded()) {
+        return;
+    }
+    setUniforms(shader);
+    arena_->draw(drawRange());
+}
+
+void Mesh::drawInstanced(ShaderProgram& shader, InstanceBuffer& instances) const {
+    if (!isUploaded() || instances.size() == 0) {
+        return;
+    }
+    setUniforms(shader, true);
+    arena_->drawInstanced(drawRange(), instances);
+}
 
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, indices_.size(), GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+void Mesh::setUniforms(ShaderProgram& shader, bool instanced) const {
+    const auto& uniforms = shader.meshUniforms();
+    shader.setUniform(uniforms.instanced, instanced);
+    shader.setUniform(uniforms.modelTr, modelTr_);
+    shader.setUniform(uniforms.localTr, localTr_);
+    shader.setUniform(uniforms.compactVertices, geometry_.vertexFormat == VertexFormat::Compact);
+    shader.setUniform(uniforms.positionOffset, geometry_.positionOffset);
+    shader.setUniform(uniforms.positionScale, geometry_.positionScale);
+    shader.setUniform(uniforms.materialIndex, material_);
+}
+
+bool Mesh::hasSameVertexDecoding(const Mesh& other) const {
+    return geometry_.vertexFormat == other.geometry_.vertexFormat &&
+           geometry_.positionOffset == other.geometry_.positionOffset &&
+           geometry_.positionScale == other.geometry_.positionScale;
+}
 
-    shader.clearMaterial("material");
+GeometryAllocationId Mesh::allocation() const { return allocation_; }
+size_t Mesh::lodsCount() const { return geometry_.lods.size(); }
+GeometryDrawRange Mesh::drawRange(size_t lod) const {
+    const auto& level = geometry_.lods[lod];
+    return GeometryDrawRange{allocation_, level.firstIndex, level.indicesCount};
 }
-void Mesh::setMaterial(const Material& material) { material_ = material; }
+float Mesh::worldLodError(size_t lod) const { return geometry_.lods[lod].error * worldScale_; }
+GeometryArena& Mesh::geometryArena() const { return *arena_; }
+unsigned int Mesh::vertexArray() const { return arena_->vertexArray(allocation_); }
+
+void Mesh::setMaterial(MaterialIndex material) { material_ = material; }
+MaterialIndex Mesh::material() const { return material_; }
 
-std::shared_ptr<Mesh> createCubeMesh(const Material& material) {
+std::shared_ptr<Mesh> createCubeMesh(MaterialIndex material) {
     std::vector<Vertex> vertices = {
         // position          // normal            // texture coords
         Vertex{glm::vec3(0.5f, 0.5f, 0.5f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec2(1.0f, 1.0f)},     // 0 -- 0
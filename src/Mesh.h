@@ -1,8 +1,13 @@
 #pragma once
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
 #include <string>
 #include <vector>
 #include <glm/glm.hpp>
 
+#include "MaterialTable.h"
 #include "ShaderProgram.h"
 
 struct Vertex {
@@ -11,25 +16,143 @@ struct Vertex {
     glm::vec2 texCoord;
 };
 
+// 16 bytes instead of 32, decoded in shader.vs
+struct CompactVertex {
+    // unorm16 within the mesh bounds, the fourth component keeps the normal 4 bytes aligned
+    uint16_t position[4];
+    // octahedral encoding packed as two snorm16
+    uint32_t normal;
+    // two half floats
+    uint32_t texCoord;
+};
+
+enum class VertexFormat { Full, Compact };
+
+struct BoundingBox {
+    glm::vec3 min{0.0f};
+    glm::vec3 max{0.0f};
+};
+
+struct BoundingSphere {
+    glm::vec3 center{0.0f};
+    float radius = 0.0f;
+};
+
+// levels a mesh can have, including the full one
+constexpr size_t cMaxMeshLods{8};
+
+// level of detail, a range of the mesh indices drawn instead of the full mesh
+struct MeshLod {
+    size_t firstIndex = 0;
+    size_t indicesCount = 0;
+    // distance of the simplified surface from the full one, in mesh coordinates
+    float error = 0.0f;
+};
+
+// vertex and index data in the layout they have on GPU
+struct MeshGeometry {
+    VertexFormat vertexFormat = VertexFormat::Full;
+    std::vector<unsigned char> vertexData;
+    std::vector<unsigned char> indexData;
+    size_t indicesCount = 0;
+    // 16-bit indices are used when the vertices count allows it
+    bool hasShortIndices = false;
+    // compact positions are decoded as positionOffset + position * positionScale
+    glm::vec3 positionOffset{0.0f};
+    glm::vec3 positionScale{1.0f};
+    // of the vertices before encoding, in mesh coordinates
+    BoundingBox bounds;
+    // from the full mesh to the coarsest one, all levels index the same vertices
+    std::vector<MeshLod> lods;
+};
+
+BoundingBox computeBounds(std::span<const Vertex> vertices);
+// bounds of the box transformed by tr
+BoundingBox transformBounds(const BoundingBox& bounds, const glm::mat4& tr);
+
+// packs vertices and indices, doesn't touch GL so it can run on workers. The geometry gets one level of
+// detail covering all indices.
+// compact positions are quantized to positionBounds, the mesh bounds by default. Meshes quantized to the
+// same bounds share the decoding uniforms and can be drawn together
+MeshGeometry encodeGeometry(std::span<const Vertex> vertices, std::span<const int> indices,
+                            VertexFormat format, const std::optional<BoundingBox>& positionBounds = {});
+
+class GeometryArena;
+class InstanceBuffer;
+using GeometryAllocationId = size_t;
+
+// indices of an allocation drawn by one draw, relative to its first index
+struct GeometryDrawRange {
+    GeometryAllocationId allocation = 0;
+    size_t firstIndex = 0;
+    size_t indicesCount = 0;
+};
+
+// tag for meshes whose GPU storage is allocated on construction and filled later by Mesh::uploadStep
+struct DeferredUpload {};
+
 class Mesh {
    public:
-    Mesh(const std::vector<Vertex>& vertices, const std::vector<int>& indices, const Material& material);
+    // the mesh gets a geometry arena of its own. The material is an index in the table bound when drawing
+    Mesh(std::span<const Vertex> vertices, std::span<const int> indices, MaterialIndex material,
+         VertexFormat vertexFormat = VertexFormat::Full);
+    // the arena must outlive the mesh
+    Mesh(MeshGeometry&& geometry, MaterialIndex material, GeometryArena& arena);
+    Mesh(MeshGeometry&& geometry, MaterialIndex material, GeometryArena& arena, DeferredUpload);
+    ~Mesh();
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
     void draw(ShaderProgram& shader) const;
-    void setMaterial(const Material& material);
+    // one draw call for all instances, their transforms and materials replace the model transform and the
+    // material of the mesh
+    void drawInstanced(ShaderProgram& shader, InstanceBuffer& instances) const;
+    // sets transforms, vertex decoding and material, meshes sharing them can be drawn with one
+    // GeometryArena::multiDraw. Instanced draws take transform and material from the instance attributes
+    void setUniforms(ShaderProgram& shader, bool instanced = false) const;
+    // vertices of both meshes are decoded with the same uniforms, see MeshGeometry::positionOffset
+    bool hasSameVertexDecoding(const Mesh& other) const;
+    GeometryAllocationId allocation() const;
+    size_t lodsCount() const;
+    // the full mesh by default
+    GeometryDrawRange drawRange(size_t lod = 0) const;
+    // error of the level scaled by the transforms, in world units
+    float worldLodError(size_t lod) const;
+    GeometryArena& geometryArena() const;
+    unsigned int vertexArray() const;
+    void setMaterial(MaterialIndex material);
+    MaterialIndex material() const;
     void setLocalTr(const glm::mat4& tr);
     void resetLocalTr();
     void setModelTr(const glm::mat4& tr);
     void resetModelTr();
+    // of the transformed mesh, kept up to date by the transform setters
+    const BoundingBox& worldBounds() const;
+    const BoundingSphere& worldSphere() const;
+    // uploads up to maxBytes of geometry which is not on GPU yet, returns the number of uploaded bytes
+    size_t uploadStep(size_t maxBytes);
+    bool isUploaded() const;
+    size_t geometryBytes() const;
+    // frees the CPU copy of the geometry once it is uploaded, the mesh keeps drawing from the arena
+    void releaseGeometryData();
 
    private:
-    std::vector<Vertex> vertices_;
-    std::vector<int> indices_;
-    Material material_;
-    unsigned int VAO, VBO, EBO;
+    MeshGeometry geometry_;
+    MaterialIndex material_;
+    std::unique_ptr<GeometryArena> ownArena_;
+    GeometryArena* arena_;
+    GeometryAllocationId allocation_;
     glm::mat4 modelTr_{glm::mat4(1.0f)};
     glm::mat4 localTr_{glm::mat4(1.0f)};
+    BoundingBox worldBounds_;
+    BoundingSphere worldSphere_;
+    // largest axis scale of the transforms
+    float worldScale_{1.0f};
+    // of vertex and index data, kept when the data is released
+    size_t geometryBytes_{0};
+    size_t uploadedBytes_{0};
 
-    void init_();
+    void init_(bool uploadData = true);
+    void updateWorldBounds_();
 };
 
-std::shared_ptr<Mesh> createCubeMesh(const Material& material);
\ No newline at end of file
+std::shared_ptr<Mesh> createCubeMesh(MaterialIndex material);
\ No newline at end of file
@@ -0,0 +1,428 @@
+#include "MeshCache.h"
+#include "Utils.h"
+
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <type_traits>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+namespace fs = std::filesystem;
+
+constexpr char cMagic[4] = {'N', 'A', 'M', 'C'};
+// bump on any change of the layout below or of the import producing the meshes
+constexpr uint32_t cVersion = 4;
+// geometry blobs are aligned so that spans over the mapping are properly aligned
+constexpr size_t cBlobAlignment = 16;
+
+struct Header {
+    char magic[4];
+    uint32_t version;
+    uint32_t vertexSize;
+    uint32_t meshesCount;
+    uint64_t sourceSize;
+    int64_t sourceModificationTime;
+    uint64_t sourceHash;
+    uint64_t nodesOffset;
+    uint64_t nodesCount;
+};
+
+struct LodRecord {
+    uint64_t firstIndex;
+    uint64_t indicesCount;
+    float error;
+    uint32_t padding;
+};
+
+struct MeshRecord {
+    uint64_t verticesOffset;
+    uint64_t verticesCount;
+    uint64_t indicesOffset;
+    uint64_t indicesCount;
+    uint64_t imagesOffset;
+    uint64_t imagesCount;
+    float boundsMin[3];
+    float boundsMax[3];
+    int32_t node;
+    uint32_t lodsCount;
+    LodRecord lods[cMaxMeshLods];
+};
+
+// followed by nameLength chars of the node name, nodes are stored in depth-first order
+struct NodeRecord {
+    int32_t parent;
+    uint32_t nameLength;
+    float localTr[16];
+};
+
+// followed by pathLength chars of the image path
+struct ImageRecord {
+    uint32_t type;
+    uint32_t pathLength;
+};
+
+static_assert(std::is_trivially_copyable_v<Vertex>);
+
+std::optional<uint64_t> sHashFile(const fs::path& filePath) {
+    std::ifstream file(filePath, std::ios::binary);
+    if (!file) {
+        return {};
+    }
+    std::vector<char> buffer(1 << 20);
+    uint64_t hash = Utils::cHashSeed;
+    while (file) {
+        file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        hash = Utils::hashBytes(buffer.data(), static_cast<size_t>(file.gcount()), hash);
+    }
+    return hash;
+}
+
+struct SourceKey {
+    uint64_t size;
+    int64_t modificationTime;
+};
+
+std::optional<SourceKey> sGetSourceKey(const fs::path& filePath) {
+    std::error_code error;
+    auto size = fs::file_size(filePath, error);
+    if (error) {
+        return {};
+    }
+    auto modificationTime = fs::last_write_time(filePath, error);
+    if (error) {
+        return {};
+    }
+    return SourceKey{size, static_cast<int64_t>(modificationTime.time_since_epoch().count())};
+}
+
+size_t sAlign(size_t offset) { return (offset + cBlobAlignment - 1) / cBlobAlignment * cBlobAlignment; }
+
+void sWritePadding(std::ofstream& file, size_t& written, size_t offset) {
+    static const char zeros[cBlobAlignment] = {};
+    file.write(zeros, static_cast<std::streamsize>(offset - written));
+    written = offset;
+}
+
+}  // namespace
+
+MappedMeshCacheEntry::MappedMeshCacheEntry(MappedMeshCacheEntry&& other) noexcept
+    : data_{std::exchange(other.data_, nullptr)},
+      size_{std::exchange(other.size_, 0)},
+#ifdef _WIN32
+      mappingHandle_{std::exchange(other.mappingHandle_, nullptr)},
+#endif
+      meshes_{std::move(other.meshes_)},
+      sceneGraph_{std::move(other.sceneGraph_)} {
+}
+
+MappedMeshCacheEntry::~MappedMeshCacheEntry() {
+    if (!data_) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(data_);
+    CloseHandle(mappingHandle_);
+#else
+    munmap(const_cast<unsigned char*>(data_), size_);
+#endif
+}
+
+const std::vector<MeshView>& MappedMeshCacheEntry::meshes() const { return meshes_; }
+
+const SceneGraph& MappedMeshCacheEntry::sceneGraph() const { return sceneGraph_; }
+
+bool MappedMeshCacheEntry::map_(const fs::path& path) {
+#ifdef _WIN32
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    HANDLE mapping = nullptr;
+    if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0) {
+        mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    }
+    CloseHandle(file);
+    if (!mapping) {
+        return false;
+    }
+    auto view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(mapping);
+        return false;
+    }
+    data_ = static_cast<const unsigned char*>(view);
+    size_ = static_cast<size_t>(fileSize.QuadPart);
+    mappingHandle_ = mapping;
+#else
+    int file = open(path.c_str(), O_RDONLY);
+    if (file < 0) {
+        return false;
+    }
+    struct stat fileStat;
+    void* view = MAP_FAILED;
+    if (fstat(file, &fileStat) == 0 && fileStat.st_size > 0) {
+        view = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+    }
+    // the mapping stays valid after the descriptor is closed
+    close(file);
+    if (view == MAP_FAILED) {
+        return false;
+    }
+    data_ = static_cast<const unsigned char*>(view);
+    size_ = static_cast<size_t>(fileStat.st_size);
+#endif
+    return true;
+}
+
+fs::path MeshCache::defaultDirectory() {
+    std::error_code error;
+    auto tempDirectory = fs::temp_directory_path(error);
+    return (error ? fs::path(".") : tempDirectory) / "NACad" / "meshcache";
+}
+
+MeshCache::MeshCache(fs::path directory) : directory_{std::move(directory)} {}
+
+fs::path MeshCache::entryPath_(const fs::path& modelPath, uint32_t variant) const {
+    auto key = fs::absolute(modelPath).lexically_normal().string();
+    auto hash = Utils::hashBytes(key.data(), key.size());
+    // the default variant keeps the names of entries written before variants were introduced
+    if (variant != 0) {
+        hash = Utils::hashBytes(&variant, sizeof(variant), hash);
+    }
+    std::stringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << hash << ".meshcache";
+    return directory_ / name.str();
+}
+
+std::optional<MappedMeshCacheEntry> MeshCache::load(const fs::path& modelPath, uint32_t variant) const {
+    auto sourceKey = sGetSourceKey(modelPath);
+    auto entryPath = entryPath_(modelPath, variant);
+    if (!sourceKey || !fs::exists(entryPath)) {
+        return {};
+    }
+
+    MappedMeshCacheEntry entry;
+    if (!entry.map_(entryPath) || entry.size_ < sizeof(Header)) {
+        std::cout << "Can't read mesh cache entry: " << entryPath << std::endl;
+        return {};
+    }
+    Header header;
+    std::memcpy(&header, entry.data_, sizeof(header));
+    if (std::memcmp(header.magic, cMagic, sizeof(cMagic)) != 0 || header.version != cVersion ||
+        header.vertexSize != sizeof(Vertex) || header.sourceSize != sourceKey->size ||
+        header.sourceModificationTime != sourceKey->modificationTime) {
+        std::cout << "Mesh cache entry is stale: " << modelPath << std::endl;
+        return {};
+    }
+    if (auto sourceHash = sHashFile(modelPath); !sourceHash || *sourceHash != header.sourceHash) {
+        std::cout << "Mesh cache entry is stale: " << modelPath << std::endl;
+        return {};
+    }
+
+    // validate every range before exposing it, a truncated entry is treated as missing
+    auto isInside = [&](uint64_t offset, uint64_t count, size_t elementSize) {
+        return offset <= entry.size_ && count <= (entry.size_ - offset) / elementSize;
+    };
+    constexpr size_t recordsOffset = sizeof(Header);
+    if (!isInside(recordsOffset, header.meshesCount, sizeof(MeshRecord))) {
+        std::cout << "Mesh cache entry is corrupted: " << entryPath << std::endl;
+        return {};
+    }
+    auto nodeOffset = header.nodesOffset;
+    for (size_t nodeIdx = 0; nodeIdx < header.nodesCount; ++nodeIdx) {
+        NodeRecord node;
+        if (!isInside(nodeOffset, 1, sizeof(node))) {
+            std::cout << "Mesh cache entry is corrupted: " << entryPath << std::endl;
+            return {};
+        }
+        std::memcpy(&node, entry.data_ + nodeOffset, sizeof(node));
+        nodeOffset += sizeof(node);
+        // a parent must precede its children and still have its subtree open, see SceneGraph::addNode
+        auto isOpenParent = node.parent == SceneGraph::cNoParent ||
+                            (node.parent >= 0 && static_cast<size_t>(node.parent) < nodeIdx &&
+                             static_cast<size_t>(entry.sceneGraph_.subtreeEnd(node.parent)) == nodeIdx);
+        if (!isOpenParent || !isInside(nodeOffset, node.nameLength, 1)) {
+            std::cout << "Mesh cache entry is corrupted: " << entryPath << std::endl;
+            return {};
+        }
+        glm::mat4 localTr;
+        std::memcpy(&localTr[0][0], node.localTr, sizeof(node.localTr));
+        auto nameChars = reinterpret_cast<const char*>(entry.data_ + nodeOffset);
+        entry.sceneGraph_.addNode(node.parent, localTr, std::string(nameChars, node.nameLength));
+        nodeOffset += node.nameLength;
+    }
+    entry.meshes_.reserve(header.meshesCount);
+    for (size_t meshIdx = 0; meshIdx < header.meshesCount; ++meshIdx) {
+        MeshRecord record;
+        std::memcpy(&record, entry.data_ + recordsOffset + meshIdx * sizeof(MeshRecord), sizeof(record));
+        if (!isInside(record.verticesOffset, record.verticesCount, sizeof(Vertex)) ||
+            !isInside(record.indicesOffset, record.indicesCount, sizeof(int)) ||
+            record.verticesOffset % cBlobAlignment != 0 || record.indicesOffset % cBlobAlignment != 0 ||
+            record.node < 0 || static_cast<size_t>(record.node) >= entry.sceneGraph_.size() ||
+            record.lodsCount > cMaxMeshLods) {
+            std::cout << "Mesh cache entry is corrupted: " << entryPath << std::endl;
+            return {};
+        }
+
+        MeshView mesh;
+        mesh.vertices = {reinterpret_cast<const Vertex*>(entry.data_ + record.verticesOffset),
+                         static_cast<size_t>(record.verticesCount)};
+        mesh.indices = {reinterpret_cast<const int*>(entry.data_ + record.indicesOffset),
+                        static_cast<size_t>(record.indicesCount)};
+        mesh.bounds.min = glm::vec3(record.boundsMin[0], record.boundsMin[1], record.boundsMin[2]);
+        mesh.bounds.max = glm::vec3(record.boundsMax[0], record.boundsMax[1], record.boundsMax[2]);
+        mesh.node = record.node;
+        for (size_t lodIdx = 0; lodIdx < record.lodsCount; ++lodIdx) {
+            const auto& lod = record.lods[lodIdx];
+            if (lod.firstIndex > record.indicesCount ||
+                lod.indicesCount > record.indicesCount - lod.firstIndex) {
+                std::cout << "Mesh cache entry is corrupted: " << entryPath << std::endl;
+                return {};
+            }
+            mesh.lods.push_back(MeshLod{static_cast<size_t>(lod.firstIndex),
+                                        static_cast<size_t>(lod.indicesCount), lod.error});
+        }
+        auto imageOffset = record.imagesOffset;
+        for (size_t imageIdx = 0; imageIdx < record.imagesCount; ++imageIdx) {
+            ImageRecord image;
+            if (!isInside(imageOffset, 1, sizeof(image))) {
+                std::cout << "Mesh cache entry is corrupted: " << entryPath << std::endl;
+                return {};
+            }
+            std::memcpy(&image, entry.data_ + imageOffset, sizeof(image));
+            imageOffset += sizeof(image);
+            if (!isInside(imageOffset, image.pathLength, 1)) {
+                std::cout << "Mesh cache entry is corrupted: " << entryPath << std::endl;
+                return {};
+            }
+            auto pathChars = reinterpret_cast<const char*>(entry.data_ + imageOffset);
+            mesh.images.emplace_back(static_cast<TextureType>(image.type),
+                                     fs::path(std::string(pathChars, image.pathLength)));
+            imageOffset += image.pathLength;
+        }
+        entry.meshes_.push_back(std::move(mesh));
+    }
+    return entry;
+}
+
+bool MeshCache::store(const fs::path& modelPath, const std::vector<MeshView>& meshes,
+                      const SceneGraph& sceneGraph, uint32_t variant) const {
+    auto sourceKey = sGetSourceKey(modelPath);
+    auto sourceHash = sHashFile(modelPath);
+    if (!sourceKey || !sourceHash) {
+        return false;
+    }
+    std::error_code error;
+    fs::create_directories(directory_, error);
+    if (error) {
+        std::cout << "Can't create mesh cache directory: " << directory_ << std::endl;
+        return false;
+    }
+
+    Header header;
+    std::memcpy(header.magic, cMagic, sizeof(cMagic));
+    header.version = cVersion;
+    header.vertexSize = sizeof(Vertex);
+    header.meshesCount = static_cast<uint32_t>(meshes.size());
+    header.sourceSize = sourceKey->size;
+    header.sourceModificationTime = sourceKey->modificationTime;
+    header.sourceHash = *sourceHash;
+
+    // layout: header, mesh records, node and image records with their names, aligned geometry blobs
+    std::vector<MeshRecord> records(meshes.size());
+    std::string namedRecordsBlock;
+    size_t offset = sizeof(Header) + records.size() * sizeof(MeshRecord);
+    header.nodesOffset = offset;
+    header.nodesCount = sceneGraph.size();
+    for (SceneNodeIndex node = 0; static_cast<size_t>(node) < sceneGraph.size(); ++node) {
+        const auto& name = sceneGraph.name(node);
+        NodeRecord record{sceneGraph.parent(node), static_cast<uint32_t>(name.size()), {}};
+        std::memcpy(record.localTr, &sceneGraph.localTr(node)[0][0], sizeof(record.localTr));
+        namedRecordsBlock.append(reinterpret_cast<const char*>(&record), sizeof(record));
+        namedRecordsBlock.append(name);
+    }
+    for (size_t meshIdx = 0; meshIdx < meshes.size(); ++meshIdx) {
+        records[meshIdx].imagesOffset = offset + namedRecordsBlock.size();
+        records[meshIdx].imagesCount = meshes[meshIdx].images.size();
+        records[meshIdx].node = meshes[meshIdx].node;
+        records[meshIdx].lodsCount = static_cast<uint32_t>(meshes[meshIdx].lods.size());
+        for (size_t lodIdx = 0; lodIdx < meshes[meshIdx].lods.size(); ++lodIdx) {
+            const auto& lod = meshes[meshIdx].lods[lodIdx];
+            records[meshIdx].lods[lodIdx] = LodRecord{lod.firstIndex, lod.indicesCount, lod.error, 0};
+        }
+        for (const auto& [textureType, imagePath] : meshes[meshIdx].images) {
+            auto pathString = imagePath.string();
+            ImageRecord image{static_cast<uint32_t>(textureType), static_cast<uint32_t>(pathString.size())};
+            namedRecordsBlock.append(reinterpret_cast<const char*>(&image), sizeof(image));
+            namedRecordsBlock.append(pathString);
+        }
+    }
+    offset += namedRecordsBlock.size();
+    for (size_t meshIdx = 0; meshIdx < meshes.size(); ++meshIdx) {
+        auto& record = records[meshIdx];
+        record.verticesOffset = offset = sAlign(offset);
+        record.verticesCount = meshes[meshIdx].vertices.size();
+        offset += meshes[meshIdx].vertices.size_bytes();
+        record.indicesOffset = offset = sAlign(offset);
+        record.indicesCount = meshes[meshIdx].indices.size();
+        offset += meshes[meshIdx].indices.size_bytes();
+        const auto& bounds = meshes[meshIdx].bounds;
+        for (int axis = 0; axis < 3; ++axis) {
+            record.boundsMin[axis] = bounds.min[axis];
+            record.boundsMax[axis] = bounds.max[axis];
+        }
+    }
+
+    // write to a temporary file first so that a crash never leaves a half-written entry behind
+    auto entryPath = entryPath_(modelPath, variant);
+    auto tempPath = entryPath;
+    tempPath += ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(records.data()),
+                   static_cast<std::streamsize>(records.size() * sizeof(MeshRecord)));
+        file.write(namedRecordsBlock.data(), static_cast<std::streamsize>(namedRecordsBlock.size()));
+        size_t written = sizeof(Header) + records.size() * sizeof(MeshRecord) + namedRecordsBlock.size();
+        for (size_t meshIdx = 0; meshIdx < meshes.size(); ++meshIdx) {
+            const auto& mesh = meshes[meshIdx];
+            sWritePadding(file, written, records[meshIdx].verticesOffset);
+            file.write(reinterpret_cast<const char*>(mesh.vertices.data()),
+                       static_cast<std::streamsize>(mesh.vertices.size_bytes()));
+            written += mesh.vertices.size_bytes();
+            sWritePadding(file, written, records[meshIdx].indicesOffset);
+            file.write(reinterpret_cast<const char*>(mesh.indices.data()),
+                       static_cast<std::streamsize>(mesh.indices.size_bytes()));
+            written += mesh.indices.size_bytes();
+        }
+        if (!file) {
+            std::cout << "Can't write mesh cache entry: " << tempPath << std::endl;
+            file.close();
+            fs::remove(tempPath, error);
+            return false;
+        }
+    }
+    fs::rename(tempPath, entryPath, error);
+    if (error) {
+        std::cout << "Can't write mesh cache entry: " << entryPath << std::endl;
+        fs::remove(tempPath, error);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "Mesh.h"
+#include "SceneGraph.h"
+
+using MeshImagesInfo = std::vector<std::pair<TextureType, std::filesystem::path>>;
+
+// mesh as it is stored in the cache, geometry can be uploaded to GPU as is
+struct MeshView {
+    std::span<const Vertex> vertices;
+    std::span<const int> indices;
+    MeshImagesInfo images;
+    // bounds of the vertices, computed on import
+    BoundingBox bounds;
+    // node of the model scene graph the mesh is attached to
+    SceneNodeIndex node = 0;
+    // levels of detail stored one after another in indices, empty if the mesh has the full level only
+    std::vector<MeshLod> lods;
+};
+
+// read-only mapping of a cache file, spans of meshes() point into the mapping
+class MappedMeshCacheEntry {
+   public:
+    MappedMeshCacheEntry(MappedMeshCacheEntry&& other) noexcept;
+    MappedMeshCacheEntry& operator=(MappedMeshCacheEntry&&) = delete;
+    MappedMeshCacheEntry(const MappedMeshCacheEntry&) = delete;
+    ~MappedMeshCacheEntry();
+
+    const std::vector<MeshView>& meshes() const;
+    const SceneGraph& sceneGraph() const;
+
+   private:
+    friend class MeshCache;
+    MappedMeshCacheEntry() = default;
+    bool map_(const std::filesystem::path& path);
+
+    const unsigned char* data_{nullptr};
+    size_t size_{0};
+#ifdef _WIN32
+    void* mappingHandle_{nullptr};
+#endif
+    std::vector<MeshView> meshes_;
+    SceneGraph sceneGraph_;
+};
+
+// versioned on-disk cache of imported meshes keyed by the model path, modification time and content hash.
+// only the model file itself is tracked, edits of side files (e.g. .mtl) need the entry to be removed.
+// variant tells apart imports of the same file with different processing (e.g. optimized meshes), entries of
+// different variants live side by side
+class MeshCache {
+   public:
+    static std::filesystem::path defaultDirectory();
+
+    explicit MeshCache(std::filesystem::path directory = defaultDirectory());
+    // empty if there is no entry for the model or the entry is stale
+    std::optional<MappedMeshCacheEntry> load(const std::filesystem::path& modelPath,
+                                             uint32_t variant = 0) const;
+    bool store(const std::filesystem::path& modelPath, const std::vector<MeshView>& meshes,
+               const SceneGraph& sceneGraph, uint32_t variant = 0) const;
+
+   private:
+    std::filesystem::path directory_;
+
+    std::filesystem::path entryPath_(const std::filesystem::path& modelPath, uint32_t variant) const;
+};
@@ -0,0 +1,348 @@
+#include "MeshOptimizer.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace {
+
+// Forsyth recommends a somewhat larger cache than the real one for scoring
+constexpr size_t cScoringCacheSize{32};
+constexpr float cLastTriangleScore{0.75f};
+constexpr float cCacheDecayPower{1.5f};
+constexpr float cValenceBoostScale{2.0f};
+constexpr float cValenceBoostPower{0.5f};
+// clusters may be up to this much worse than their cache order, smaller clusters sort better for overdraw
+constexpr float cOverdrawThreshold{1.05f};
+constexpr size_t cNoTriangle{SIZE_MAX};
+
+// vertices are compared bitwise, they must have no padding
+static_assert(sizeof(Vertex) == 8 * sizeof(float));
+
+struct VertexBitwiseHash {
+    size_t operator()(const Vertex& vertex) const { return Utils::hashBytes(&vertex, sizeof(vertex)); }
+};
+
+struct VertexBitwiseEqual {
+    bool operator()(const Vertex& lhs, const Vertex& rhs) const {
+        return std::memcmp(&lhs, &rhs, sizeof(Vertex)) == 0;
+    }
+};
+
+// vertex is in the cache if it was one of the last cacheSize vertices inserted into it
+class FifoCacheSimulator {
+   public:
+    FifoCacheSimulator(size_t verticesCount, size_t cacheSize)
+        : insertionTimes_(verticesCount, 0), cacheSize_{cacheSize}, time_{cacheSize + 1} {}
+
+    // true if the vertex had to be transformed
+    bool access(int vertex) {
+        if (time_ - insertionTimes_[vertex] <= cacheSize_) {
+            return false;
+        }
+        insertionTimes_[vertex] = time_++;
+        return true;
+    }
+    void reset() { time_ += cacheSize_; }
+
+   private:
+    std::vector<size_t> insertionTimes_;
+    size_t cacheSize_;
+    size_t time_;
+};
+
+size_t sCountCacheMisses(std::span<const int> indices, size_t verticesCount, size_t cacheSize) {
+    FifoCacheSimulator cache(verticesCount, cacheSize);
+    return std::ranges::count_if(indices, [&cache](int index) { return cache.access(index); });
+}
+
+// merges bitwise identical vertices and drops triangles which became degenerate
+void sWeldVertices(std::vector<Vertex>& vertices, std::vector<int>& indices) {
+    std::unordered_map<Vertex, int, VertexBitwiseHash, VertexBitwiseEqual> uniqueIndices;
+    uniqueIndices.reserve(vertices.size());
+    std::vector<Vertex> uniqueVertices;
+    std::vector<int> remap(vertices.size());
+    for (size_t vertexIdx = 0; vertexIdx < vertices.size(); ++vertexIdx) {
+        auto [uniqueIt, isNew] =
+            uniqueIndices.try_emplace(vertices[vertexIdx], static_cast<int>(uniqueVertices.size()));
+        if (isNew) {
+            uniqueVertices.push_back(vertices[vertexIdx]);
+        }
+        remap[vertexIdx] = uniqueIt->second;
+    }
+
+    size_t keptCount = 0;
+    for (size_t triangle = 0; triangle < indices.size() / 3; ++triangle) {
+        int a = remap[indices[triangle * 3]];
+        int b = remap[indices[triangle * 3 + 1]];
+        int c = remap[indices[triangle * 3 + 2]];
+        if (a == b || b == c || a == c) {
+            continue;
+        }
+        indices[keptCount * 3] = a;
+        indices[keptCount * 3 + 1] = b;
+        indices[keptCount * 3 + 2] = c;
+        ++keptCount;
+    }
+    indices.resize(keptCount * 3);
+    vertices = std::move(uniqueVertices);
+}
+
+float sVertexScore(int cachePosition, size_t remainingValence) {
+    if (remainingValence == 0) {
+        return -1.0f;
+    }
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        // vertices of the last triangle get a fixed score so the next triangle doesn't just reuse its edge
+        score = cachePosition < 3 ? cLastTriangleScore
+                                  : std::pow(1.0f - static_cast<float>(cachePosition - 3) /
+                                                        static_cast<float>(cScoringCacheSize - 3),
+                                             cCacheDecayPower);
+    }
+    // vertices with few triangles left are finished first, so they leave the cache for good
+    return score + cValenceBoostScale * std::pow(static_cast<float>(remainingValence), -cValenceBoostPower);
+}
+
+std::vector<int> sOptimizeVertexCache(std::span<const int> indices, size_t verticesCount) {
+    const size_t trianglesCount = indices.size() / 3;
+
+    // triangles of every vertex, the ones not emitted yet are kept in front
+    std::vector<size_t> trianglesOffsets(verticesCount + 1, 0);
+    for (int index : indices) {
+        ++trianglesOffsets[index + 1];
+    }
+    for (size_t vertex = 0; vertex < verticesCount; ++vertex) {
+        trianglesOffsets[vertex + 1] += trianglesOffsets[vertex];
+    }
+    std::vector<size_t> adjacentTriangles(indices.size());
+    std::vector<size_t> activeTrianglesCounts(verticesCount, 0);
+    for (size_t triangle = 0; triangle < trianglesCount; ++triangle) {
+        for (size_t corner = 0; corner < 3; ++corner) {
+            int vertex = indices[triangle * 3 + corner];
+            adjacentTriangles[trianglesOffsets[vertex] + activeTrianglesCounts[vertex]++] = triangle;
+        }
+    }
+    auto activeTriangles = [&](int vertex) {
+        return std::span(adjacentTriangles).subspan(trianglesOffsets[vertex], activeTrianglesCounts[vertex]);
+    };
+
+    std::vector<int> cachePositions(verticesCount, -1);
+    std::vector<float> vertexScores(verticesCount);
+    for (size_t vertex = 0; vertex < verticesCount; ++vertex) {
+        vertexScores[vertex] = sVertexScore(-1, activeTrianglesCounts[vertex]);
+    }
+    std::vector<float> triangleScores(trianglesCount);
+    std::vector<bool> isEmitted(trianglesCount, false);
+    size_t bestTriangle = cNoTriangle;
+    for (size_t triangle = 0; triangle < trianglesCount; ++triangle) {
+        triangleScores[triangle] = vertexScores[indices[triangle * 3]] +
+                                   vertexScores[indices[triangle * 3 + 1]] +
+                                   vertexScores[indices[triangle * 3 + 2]];
+        if (bestTriangle == cNoTriangle || triangleScores[triangle] > triangleScores[bestTriangle]) {
+            bestTriangle = triangle;
+        }
+    }
+
+    std::vector<int> result;
+    result.reserve(indices.size());
+    std::vector<int> cache;
+    std::vector<int> newCache;
+    size_t firstNotEmitted = 0;
+    while (result.size() < indices.size()) {
+        if (bestTriangle == cNoTriangle) {
+            // no cached vertex has triangles left, continue anywhere
+            while (isEmitted[firstNotEmitted]) {
+                ++firstNotEmitted;
+            }
+            bestTriangle = firstNotEmitted;
+        }
+        isEmitted[bestTriangle] = true;
+
+        // the emitted triangle goes to the front of the cache
+        newCache.clear();
+        for (size_t corner = 0; corner < 3; ++corner) {
+            int vertex = indices[bestTriangle * 3 + corner];
+            result.push_back(vertex);
+            newCache.push_back(vertex);
+            auto triangles = activeTriangles(vertex);
+            std::iter_swap(std::ranges::find(triangles, bestTriangle), triangles.end() - 1);
+            --activeTrianglesCounts[vertex];
+        }
+        for (int vertex : cache) {
+            if (std::ranges::find(newCache.begin(), newCache.begin() + 3, vertex) == newCache.begin() + 3) {
+                newCache.push_back(vertex);
+            }
+        }
+
+        // rescore vertices which moved in or out of the cache and their triangles
+        for (size_t position = 0; position < newCache.size(); ++position) {
+            int vertex = newCache[position];
+            cachePositions[vertex] = position < cScoringCacheSize ? static_cast<int>(position) : -1;
+            float score = sVertexScore(cachePositions[vertex], activeTrianglesCounts[vertex]);
+            float scoreDelta = score - vertexScores[vertex];
+            vertexScores[vertex] = score;
+            for (size_t triangle : activeTriangles(vertex)) {
+                triangleScores[triangle] += scoreDelta;
+            }
+        }
+        newCache.resize(std::min(newCache.size(), cScoringCacheSize));
+        bestTriangle = cNoTriangle;
+        for (int vertex : newCache) {
+            for (size_t triangle : activeTriangles(vertex)) {
+                if (bestTriangle == cNoTriangle || triangleScores[triangle] > triangleScores[bestTriangle]) {
+                    bestTriangle = triangle;
+                }
+            }
+        }
+        std::swap(cache, newCache);
+    }
+    return result;
+}
+
+std::vector<int> sOptimizeOverdraw(std::span<const Vertex> vertices, std::span<const int> indices) {
+    const size_t trianglesCount = indices.size() / 3;
+    FifoCacheSimulator cache(vertices.size(), cVertexCacheSize);
+    auto triangleMisses = [&](size_t triangle) {
+        return static_cast<size_t>(cache.access(indices[triangle * 3])) +
+               cache.access(indices[triangle * 3 + 1]) + cache.access(indices[triangle * 3 + 2]);
+    };
+
+    // hard boundaries: triangles missing the cache completely start a new run of the cache order
+    std::vector<size_t> hardStarts;
+    for (size_t triangle = 0; triangle < trianglesCount; ++triangle) {
+        if (triangleMisses(triangle) == 3 || triangle == 0) {
+            hardStarts.push_back(triangle);
+        }
+    }
+    hardStarts.push_back(trianglesCount);
+
+    // soft boundaries: runs are split further where the cache efficiency so far is close to the one of the
+    // whole run
+    std::vector<size_t> clusterStarts;
+    for (size_t hardIdx = 0; hardIdx + 1 < hardStarts.size(); ++hardIdx) {
+        const size_t start = hardStarts[hardIdx];
+        const size_t end = hardStarts[hardIdx + 1];
+        cache.reset();
+        size_t runMisses = 0;
+        for (size_t triangle = start; triangle < end; ++triangle) {
+            runMisses += triangleMisses(triangle);
+        }
+        const float runAcmr = static_cast<float>(runMisses) / static_cast<float>(end - start);
+
+        cache.reset();
+        clusterStarts.push_back(start);
+        size_t clusterMisses = 0;
+        for (size_t triangle = start; triangle + 1 < end; ++triangle) {
+            clusterMisses += triangleMisses(triangle);
+            auto clusterSize = static_cast<float>(triangle + 1 - clusterStarts.back());
+            if (static_cast<float>(clusterMisses) <= cOverdrawThreshold * runAcmr * clusterSize) {
+                clusterStarts.push_back(triangle + 1);
+                cache.reset();
+                clusterMisses = 0;
+            }
+        }
+    }
+    clusterStarts.push_back(trianglesCount);
+
+    // clusters facing away from the mesh center are drawn first, they are likely to occlude the rest
+    struct Cluster {
+        size_t start;
+        size_t end;
+        glm::vec3 centroid{0.0f};
+        glm::vec3 normal{0.0f};
+        float area = 0.0f;
+        float sortKey = 0.0f;
+    };
+    std::vector<Cluster> clusters;
+    glm::vec3 meshCentroid{0.0f};
+    float meshArea = 0.0f;
+    for (size_t clusterIdx = 0; clusterIdx + 1 < clusterStarts.size(); ++clusterIdx) {
+        Cluster cluster{.start = clusterStarts[clusterIdx], .end = clusterStarts[clusterIdx + 1]};
+        for (size_t triangle = cluster.start; triangle < cluster.end; ++triangle) {
+            const auto& a = vertices[indices[triangle * 3]].position;
+            const auto& b = vertices[indices[triangle * 3 + 1]].position;
+            const auto& c = vertices[indices[triangle * 3 + 2]].position;
+            auto doubleAreaNormal = glm::cross(b - a, c - a);
+            auto area = glm::length(doubleAreaNormal);
+            cluster.centroid += (a + b + c) * (area / 3.0f);
+            cluster.normal += doubleAreaNormal;
+            cluster.area += area;
+        }
+        meshCentroid += cluster.centroid;
+        meshArea += cluster.area;
+        if (cluster.area > 0.0f) {
+            cluster.centroid /= cluster.area;
+        }
+        clusters.push_back(cluster);
+    }
+    if (meshArea > 0.0f) {
+        meshCentroid /= meshArea;
+    }
+    for (auto& cluster : clusters) {
+        auto normalLength = glm::length(cluster.normal);
+        if (normalLength > 0.0f) {
+            cluster.sortKey = glm::dot(cluster.centroid - meshCentroid, cluster.normal / normalLength);
+        }
+    }
+    std::ranges::stable_sort(clusters, std::ranges::greater{}, &Cluster::sortKey);
+
+    std::vector<int> result;
+    result.reserve(indices.size());
+    for (const auto& cluster : clusters) {
+        result.insert(result.end(), indices.begin() + cluster.start * 3, indices.begin() + cluster.end * 3);
+    }
+    return result;
+}
+
+// vertices are stored in the order of their first use, unused ones are dropped
+void sOptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<int>& indices) {
+    std::vector<int> remap(vertices.size(), -1);
+    std::vector<Vertex> reordered;
+    reordered.reserve(vertices.size());
+    for (auto& index : indices) {
+        if (remap[index] < 0) {
+            remap[index] = static_cast<int>(reordered.size());
+            reordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices = std::move(reordered);
+}
+
+}  // namespace
+
+namespace MeshOptimizer {
+
+float averageCacheMissRatio(std::span<const int> indices, size_t verticesCount, size_t cacheSize) {
+    if (indices.size() < 3) {
+        return 0.0f;
+    }
+    return static_cast<float>(sCountCacheMisses(indices, verticesCount, cacheSize)) /
+           static_cast<float>(indices.size() / 3);
+}
+
+MeshOptimizationStats optimize(std::vector<Vertex>& vertices, std::vector<int>& indices) {
+    MeshOptimizationStats stats;
+    auto measure = [&](float& acmr, float& atvr, size_t& verticesCount) {
+        verticesCount = vertices.size();
+        acmr = averageCacheMissRatio(indices, vertices.size());
+        auto misses = sCountCacheMisses(indices, vertices.size(), cVertexCacheSize);
+        atvr = vertices.empty() ? 0.0f : static_cast<float>(misses) / static_cast<float>(vertices.size());
+    };
+    measure(stats.acmrBefore, stats.atvrBefore, stats.verticesBefore);
+
+    indices.resize(indices.size() / 3 * 3);
+    sWeldVertices(vertices, indices);
+    indices = sOptimizeVertexCache(indices, vertices.size());
+    indices = sOptimizeOverdraw(vertices, indices);
+    sOptimizeVertexFetch(vertices, indices);
+
+    measure(stats.acmrAfter, stats.atvrAfter, stats.verticesAfter);
+    stats.trianglesCount = indices.size() / 3;
+    return stats;
+}
+
+}  // namespace MeshOptimizer
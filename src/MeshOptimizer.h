@@ -0,0 +1,37 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include "Mesh.h"
+
+// post-transform vertex cache size assumed by the statistics, close to what desktop GPUs behave like
+constexpr size_t cVertexCacheSize{16};
+
+struct MeshOptimizationStats {
+    size_t verticesBefore = 0;
+    size_t verticesAfter = 0;
+    size_t trianglesCount = 0;
+    // average cache miss ratio: transformed vertices per triangle, 0.5 is the ideal for regular grids
+    float acmrBefore = 0.0f;
+    float acmrAfter = 0.0f;
+    // average transform to vertex ratio: transformed vertices per unique vertex, 1.0 is the ideal
+    float atvrBefore = 0.0f;
+    float atvrAfter = 0.0f;
+};
+
+namespace MeshOptimizer {
+
+// simulates a FIFO post-transform cache and returns the number of vertex shader invocations per triangle
+float averageCacheMissRatio(std::span<const int> indices, size_t verticesCount,
+                            size_t cacheSize = cVertexCacheSize);
+
+// rewrites a triangle list in place:
+// - welds bitwise identical vertices
+// - orders triangles for the post-transform cache (Forsyth's linear-speed optimization)
+// - splits the order into clusters and sorts them outside in to reduce overdraw, keeping most of the cache
+//   efficiency (Sander et al., "Fast triangle reordering for vertex locality and reduced overdraw")
+// - orders vertices by first use so vertex fetch goes through memory linearly
+MeshOptimizationStats optimize(std::vector<Vertex>& vertices, std::vector<int>& indices);
+
+}  // namespace MeshOptimizer
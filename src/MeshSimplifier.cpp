@@ -0,0 +1,333 @@
+#include "MeshSimplifier.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <unordered_map>
+#include <utility>
+
+namespace {
+
+// every level aims at this fraction of the triangles of the previous one
+constexpr float cLodReduction{0.5f};
+// levels stop when their error reaches this fraction of the mesh bounds diagonal, coarser ones would only
+// be drawn for meshes covering a few pixels
+constexpr float cMaxLodRelativeError{0.05f};
+
+struct PositionBitwiseHash {
+    size_t operator()(const glm::vec3& position) const {
+        return Utils::hashBytes(&position, sizeof(position));
+    }
+};
+
+struct PositionBitwiseEqual {
+    bool operator()(const glm::vec3& lhs, const glm::vec3& rhs) const {
+        return std::memcmp(&lhs, &rhs, sizeof(glm::vec3)) == 0;
+    }
+};
+
+// squared distances to a set of planes weighted by the areas of their triangles, kept as the upper triangle
+// of the symmetric 4x4 matrix of the plane equations
+class Quadric {
+   public:
+    Quadric() = default;
+    Quadric(const glm::vec3& normal, float distance, float weight) {
+        const double plane[4] = {normal.x, normal.y, normal.z, distance};
+        size_t coefficient = 0;
+        for (int row = 0; row < 4; ++row) {
+            for (int column = row; column < 4; ++column) {
+                coefficients_[coefficient++] = plane[row] * plane[column] * weight;
+            }
+        }
+        weight_ = weight;
+    }
+
+    Quadric& operator+=(const Quadric& other) {
+        for (size_t coefficient = 0; coefficient < coefficients_.size(); ++coefficient) {
+            coefficients_[coefficient] += other.coefficients_[coefficient];
+        }
+        weight_ += other.weight_;
+        return *this;
+    }
+
+    // mean squared distance of the point to the planes
+    double error(const glm::vec3& point) const {
+        if (weight_ <= 0.0) {
+            return 0.0;
+        }
+        const double homogeneous[4] = {point.x, point.y, point.z, 1.0};
+        double error = 0.0;
+        size_t coefficient = 0;
+        for (int row = 0; row < 4; ++row) {
+            for (int column = row; column < 4; ++column) {
+                // off-diagonal coefficients stand for both halves of the matrix
+                double factor = row == column ? 1.0 : 2.0;
+                error += factor * coefficients_[coefficient++] * homogeneous[row] * homogeneous[column];
+            }
+        }
+        // rounding may take the error of a point lying on all the planes below zero
+        return std::max(error, 0.0) / weight_;
+    }
+
+   private:
+    std::array<double, 10> coefficients_{};
+    double weight_ = 0.0;
+};
+
+// moves the position from onto the position to, both are represented by their first vertex
+struct Collapse {
+    double error;
+    int from;
+    int to;
+};
+
+}  // namespace
+
+namespace MeshSimplifier {
+
+SimplifiedIndices simplify(std::span<const Vertex> vertices, std::span<const int> indices,
+                           size_t targetIndicesCount, float maxError) {
+    SimplifiedIndices result;
+    auto& current = result.indices;
+    current.assign(indices.begin(), indices.begin() + static_cast<std::ptrdiff_t>(indices.size() / 3 * 3));
+    const size_t verticesCount = vertices.size();
+
+    // vertices with the same position but different attributes are wedges of one position, they are linked
+    // into a circular list and the first of them represents the position
+    std::vector<int> positions(verticesCount);
+    std::vector<int> nextWedges(verticesCount);
+    {
+        std::unordered_map<glm::vec3, int, PositionBitwiseHash, PositionBitwiseEqual> firstWedges;
+        firstWedges.reserve(verticesCount);
+        for (size_t vertex = 0; vertex < verticesCount; ++vertex) {
+            auto [firstIt, isNew] =
+                firstWedges.try_emplace(vertices[vertex].position, static_cast<int>(vertex));
+            positions[vertex] = firstIt->second;
+            if (isNew) {
+                nextWedges[vertex] = static_cast<int>(vertex);
+            } else {
+                nextWedges[vertex] = nextWedges[firstIt->second];
+                nextWedges[firstIt->second] = static_cast<int>(vertex);
+            }
+        }
+    }
+
+    // positions on open or non-manifold edges are locked, moving them would tear or shrink the surface
+    std::vector<bool> isLocked(verticesCount, false);
+    {
+        std::unordered_map<uint64_t, int> edgeUses;
+        edgeUses.reserve(current.size());
+        for (size_t corner = 0; corner < current.size(); ++corner) {
+            auto a = static_cast<uint64_t>(positions[current[corner]]);
+            auto b = static_cast<uint64_t>(positions[current[corner - corner % 3 + (corner + 1) % 3]]);
+            if (a != b) {
+                ++edgeUses[std::min(a, b) << 32 | std::max(a, b)];
+            }
+        }
+        for (const auto& [edge, uses] : edgeUses) {
+            if (uses != 2) {
+                isLocked[edge >> 32] = true;
+                isLocked[edge & 0xffffffff] = true;
+            }
+        }
+    }
+
+    std::vector<Quadric> quadrics(verticesCount);
+    for (size_t triangle = 0; triangle < current.size() / 3; ++triangle) {
+        const auto& a = vertices[current[triangle * 3]].position;
+        const auto& b = vertices[current[triangle * 3 + 1]].position;
+        const auto& c = vertices[current[triangle * 3 + 2]].position;
+        auto doubleAreaNormal = glm::cross(b - a, c - a);
+        auto doubleArea = glm::length(doubleAreaNormal);
+        if (doubleArea == 0.0f) {
+            continue;
+        }
+        auto normal = doubleAreaNormal / doubleArea;
+        Quadric quadric(normal, -glm::dot(normal, a), doubleArea * 0.5f);
+        for (size_t corner = 0; corner < 3; ++corner) {
+            quadrics[positions[current[triangle * 3 + corner]]] += quadric;
+        }
+    }
+
+    // collapses of one pass touch disjoint neighbourhoods, so every one of them is checked against the
+    // triangles it will really produce
+    const double maxSquaredError = static_cast<double>(maxError) * maxError;
+    double squaredError = 0.0;
+    std::vector<int> remap(verticesCount);
+    std::iota(remap.begin(), remap.end(), 0);
+    std::vector<size_t> trianglesOffsets;
+    std::vector<size_t> adjacentTriangles;
+    std::vector<Collapse> collapses;
+    std::vector<bool> isTouched(verticesCount);
+    std::vector<std::pair<int, int>> wedgeTargets;
+    while (current.size() > targetIndicesCount) {
+        const size_t trianglesCount = current.size() / 3;
+        trianglesOffsets.assign(verticesCount + 1, 0);
+        for (int index : current) {
+            ++trianglesOffsets[positions[index] + 1];
+        }
+        std::partial_sum(trianglesOffsets.begin(), trianglesOffsets.end(), trianglesOffsets.begin());
+        adjacentTriangles.resize(current.size());
+        {
+            auto fillOffsets = trianglesOffsets;
+            for (size_t corner = 0; corner < current.size(); ++corner) {
+                adjacentTriangles[fillOffsets[positions[current[corner]]]++] = corner / 3;
+            }
+        }
+        auto trianglesAround = [&](int position) {
+            auto first = trianglesOffsets[position];
+            return std::span(adjacentTriangles).subspan(first, trianglesOffsets[position + 1] - first);
+        };
+
+        // every half-edge proposes moving its start onto its end, the twin half-edge proposes the opposite
+        collapses.clear();
+        for (size_t corner = 0; corner < current.size(); ++corner) {
+            int from = positions[current[corner]];
+            int to = positions[current[corner - corner % 3 + (corner + 1) % 3]];
+            if (from != to && !isLocked[from]) {
+                collapses.push_back(Collapse{quadrics[from].error(vertices[to].position), from, to});
+            }
+        }
+        std::ranges::sort(collapses, {}, &Collapse::error);
+
+        std::fill(isTouched.begin(), isTouched.end(), false);
+        size_t removedTrianglesCount = 0;
+        size_t appliedCount = 0;
+        for (const auto& collapse : collapses) {
+            if (collapse.error > maxSquaredError ||
+                (trianglesCount - removedTrianglesCount) * 3 <= targetIndicesCount) {
+                break;
+            }
+            if (isTouched[collapse.from] || isTouched[collapse.to]) {
+                continue;
+            }
+
+            // every wedge moves to a wedge of the target it shares an edge with, so texture coordinates and
+            // normals stay continuous. A wedge without one lies on a seam which doesn't go along the edge
+            wedgeTargets.clear();
+            bool isSeamKept = true;
+            int wedge = collapse.from;
+            do {
+                bool isUsed = false;
+                int target = -1;
+                for (size_t triangle : trianglesAround(collapse.from)) {
+                    for (size_t corner = 0; corner < 3; ++corner) {
+                        if (current[triangle * 3 + corner] != wedge) {
+                            continue;
+                        }
+                        isUsed = true;
+                        for (size_t other : {(corner + 1) % 3, (corner + 2) % 3}) {
+                            if (positions[current[triangle * 3 + other]] == collapse.to) {
+                                target = current[triangle * 3 + other];
+                            }
+                        }
+                    }
+                }
+                if (isUsed && target < 0) {
+                    isSeamKept = false;
+                    break;
+                }
+                if (isUsed) {
+                    wedgeTargets.emplace_back(wedge, target);
+                }
+                wedge = nextWedges[wedge];
+            } while (wedge != collapse.from);
+            if (!isSeamKept) {
+                continue;
+            }
+
+            // triangles around the moved position must not flip or become degenerate
+            const auto& targetPosition = vertices[collapse.to].position;
+            bool isFlipped = false;
+            size_t collapsedTrianglesCount = 0;
+            for (size_t triangle : trianglesAround(collapse.from)) {
+                glm::vec3 corners[3];
+                glm::vec3 movedCorners[3];
+                bool isCollapsed = false;
+                for (size_t corner = 0; corner < 3; ++corner) {
+                    int position = positions[current[triangle * 3 + corner]];
+                    isCollapsed = isCollapsed || position == collapse.to;
+                    corners[corner] = vertices[position].position;
+                    movedCorners[corner] = position == collapse.from ? targetPosition : corners[corner];
+                }
+                if (isCollapsed) {
+                    ++collapsedTrianglesCount;
+                    continue;
+                }
+                auto normal = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+                auto movedNormal =
+                    glm::cross(movedCorners[1] - movedCorners[0], movedCorners[2] - movedCorners[0]);
+                if (glm::dot(normal, movedNormal) <= 0.0f) {
+                    isFlipped = true;
+                    break;
+                }
+            }
+            if (isFlipped) {
+                continue;
+            }
+
+            for (auto [movedWedge, target] : wedgeTargets) {
+                remap[movedWedge] = target;
+            }
+            quadrics[collapse.to] += quadrics[collapse.from];
+            squaredError = std::max(squaredError, collapse.error);
+            for (size_t triangle : trianglesAround(collapse.from)) {
+                for (size_t corner = 0; corner < 3; ++corner) {
+                    isTouched[positions[current[triangle * 3 + corner]]] = true;
+                }
+            }
+            removedTrianglesCount += collapsedTrianglesCount;
+            ++appliedCount;
+        }
+        if (appliedCount == 0) {
+            break;
+        }
+
+        size_t keptCount = 0;
+        for (size_t triangle = 0; triangle < trianglesCount; ++triangle) {
+            int a = remap[current[triangle * 3]];
+            int b = remap[current[triangle * 3 + 1]];
+            int c = remap[current[triangle * 3 + 2]];
+            if (positions[a] == positions[b] || positions[b] == positions[c] ||
+                positions[a] == positions[c]) {
+                continue;
+            }
+            current[keptCount * 3] = a;
+            current[keptCount * 3 + 1] = b;
+            current[keptCount * 3 + 2] = c;
+            ++keptCount;
+        }
+        current.resize(keptCount * 3);
+    }
+    result.error = static_cast<float>(std::sqrt(squaredError));
+    return result;
+}
+
+std::vector<MeshLod> generateLods(std::span<const Vertex> vertices, std::vector<int>& indices) {
+    std::vector<MeshLod> lods{MeshLod{0, indices.size(), 0.0f}};
+    auto bounds = computeBounds(vertices);
+    auto maxError = glm::length(bounds.max - bounds.min) * cMaxLodRelativeError;
+    std::vector<int> level(indices.begin(), indices.end());
+    float error = 0.0f;
+    while (lods.size() < cMaxMeshLods && level.size() / 3 >= cMinLodTrianglesCount) {
+        auto targetIndicesCount =
+            static_cast<size_t>(static_cast<float>(level.size() / 3) * cLodReduction) * 3;
+        // errors of consecutive levels are added up, which overestimates the distance from the source mesh
+        // rather than underestimates it
+        auto simplified = simplify(vertices, level, targetIndicesCount, maxError - error);
+        if (static_cast<float>(simplified.indices.size()) >
+            cMinLodReduction * static_cast<float>(level.size())) {
+            break;
+        }
+        error += simplified.error;
+        lods.push_back(MeshLod{indices.size(), simplified.indices.size(), error});
+        indices.insert(indices.end(), simplified.indices.begin(), simplified.indices.end());
+        level = std::move(simplified.indices);
+    }
+    return lods;
+}
+
+}  // namespace MeshSimplifier
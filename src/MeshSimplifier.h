@@ -0,0 +1,34 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include "Mesh.h"
+
+// levels of a chain are generated until one keeps more than this fraction of the previous triangles
+constexpr float cMinLodReduction{0.85f};
+// meshes and levels with fewer triangles are not simplified further
+constexpr size_t cMinLodTrianglesCount{64};
+
+struct SimplifiedIndices {
+    // refer to the vertices of the source mesh
+    std::vector<int> indices;
+    // root mean square distance of the removed vertices from the surface they were collapsed onto
+    float error = 0.0f;
+};
+
+namespace MeshSimplifier {
+
+// collapses vertices onto their neighbours in the order of the quadric error (Garland and Heckbert, "Surface
+// Simplification Using Quadric Error Metrics") until at most targetIndicesCount indices are left or no
+// collapse stays under maxError. Vertices don't move, so the result indexes the source vertices.
+// vertices on open or non-manifold edges are kept, vertices on attribute seams only collapse along the seam.
+// expects welded vertices, see MeshOptimizer::optimize
+SimplifiedIndices simplify(std::span<const Vertex> vertices, std::span<const int> indices,
+                           size_t targetIndicesCount, float maxError);
+
+// appends levels simplified to about a half of the previous one to indices and returns all levels, the
+// first one is the source mesh. Errors of the levels are relative to the source mesh
+std::vector<MeshLod> generateLods(std::span<const Vertex> vertices, std::vector<int>& indices);
+
+}  // namespace MeshSimplifier
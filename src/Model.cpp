@@ -1,7 +1,13 @@
 #include "Model.h"
-#include "Utils.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "ThreadPool.h"
 
+#include <algorithm>
+#include <chrono>
+#include <future>
 #include <iostream>
+#include <optional>
 #include <ranges>
 #include <unordered_set>
 
@@ -26,43 +32,426 @@ Model::ImagesInfo sLoadImagesInfoFromAssimpMaterial(aiMaterial* material, const
     return result;
 };
 
+// geometry is streamed to GPU in pieces of this size, so one huge mesh doesn't blow the frame budget
+constexpr size_t cUploadChunkBytes{1 << 20};
+
+double sElapsedMs(std::chrono::steady_clock::time_point startTime) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+// Assimp matrices are row major
+glm::mat4 sToGlm(const aiMatrix4x4& tr) {
+    glm::mat4 result;
+    for (unsigned int row = 0; row < 4; ++row) {
+        for (unsigned int column = 0; column < 4; ++column) {
+            result[column][row] = tr[row][column];
+        }
+    }
+    return result;
+}
+
+// imports with different processing are cached separately, the variant is a combination of the flags
+constexpr uint32_t cOptimizedMeshCacheVariant{1};
+constexpr uint32_t cLodsMeshCacheVariant{2};
+
+uint32_t sMeshCacheVariant(const ModelLoadOptions& options) {
+    return (options.optimizeMeshes ? cOptimizedMeshCacheVariant : 0) |
+           (options.generateLods ? cLodsMeshCacheVariant : 0);
+}
+
+VertexFormat sVertexFormat(const ModelLoadOptions& options) {
+    return options.compactVertices ? VertexFormat::Compact : VertexFormat::Full;
+}
+
+// a mesh spanning fewer steps of the model grid on its longest axis keeps its own quantization bounds
+constexpr float cMinModelGridSteps{1024.0f};
+
+float sMaxExtent(const BoundingBox& bounds) {
+    auto extent = bounds.max - bounds.min;
+    return std::max({extent.x, extent.y, extent.z});
+}
+
+// compact positions of the meshes are quantized to the model bounds, so the meshes share the decoding
+// uniforms and can be batched, and shared edges of neighbouring meshes land on the same grid. Small meshes
+// of a large model would collapse on that grid, they are quantized to their own bounds and batched apart
+std::vector<MeshGeometry> sEncodeMeshes(const std::vector<MeshView>& meshes,
+                                        const ModelLoadOptions& options) {
+    std::optional<BoundingBox> modelBounds;
+    for (const auto& mesh : meshes) {
+        if (mesh.vertices.empty()) {
+            continue;
+        }
+        auto bounds = mesh.bounds;
+        if (modelBounds) {
+            bounds.min = glm::min(bounds.min, modelBounds->min);
+            bounds.max = glm::max(bounds.max, modelBounds->max);
+        }
+        modelBounds = bounds;
+    }
+    auto modelGridStep = modelBounds ? sMaxExtent(*modelBounds) / 65535.0f : 0.0f;
+    std::vector<MeshGeometry> geometries;
+    geometries.reserve(meshes.size());
+    for (const auto& mesh : meshes) {
+        auto isOnModelGrid = sMaxExtent(mesh.bounds) >= cMinModelGridSteps * modelGridStep;
+        geometries.push_back(encodeGeometry(mesh.vertices, mesh.indices, sVertexFormat(options),
+                                            isOnModelGrid ? modelBounds : std::nullopt));
+        if (!mesh.lods.empty()) {
+            geometries.back().lods = mesh.lods;
+        }
+    }
+    return geometries;
+}
+
+// a shared arena is compacted when unloading a model leaves it half empty
+constexpr float cArenaCompactionUsage{0.5f};
+
 }  // namespace
 
-Model::Model(const std::filesystem::path& filePath) { loadModel(filePath); }
+struct Model::AsyncLoad {
+    // geometry is encoded on the import worker, so the GL thread only copies it to buffers
+    struct ImportedMesh {
+        MeshGeometry geometry;
+        ImagesInfo images;
+        SceneNodeIndex node;
+    };
+    struct ImportedModel {
+        std::vector<ImportedMesh> meshes;
+        SceneGraph sceneGraph;
+        Utils::TextureSetPlan texturePlan;
+    };
+
+    std::filesystem::path filePath;
+    std::chrono::steady_clock::time_point startTime;
+    std::future<std::optional<ImportedModel>> imported;
+    bool isImported = false;
+
+    // shared with decoding tasks which may outlive the model
+    std::shared_ptr<const Utils::TextureSetPlan> texturePlan;
+    std::shared_ptr<Utils::PreparedLayersQueue> preparedLayers;
+    Utils::TextureSet textureSet;
+    std::optional<Utils::PixelUploadRing> uploadRing;
+    size_t uploadedLayersCount = 0;
+
+    std::vector<Mesh*> pendingMeshes;
+    size_t nextPendingMesh = 0;
+
+    size_t totalBytes = 0;
+    size_t uploadedBytes = 0;
+};
+
+Model::Model(const std::filesystem::path& filePath, const ModelLoadOptions& options)
+    : options_{options},
+      ownArena_{options.geometryArena ? std::unique_ptr<GeometryArena>() : std::make_unique<GeometryArena>()},
+      arena_{options.geometryArena ? options.geometryArena : ownArena_.get()},
+      ownMaterials_{options.materialTable ? std::unique_ptr<MaterialTable>()
+                                          : std::make_unique<MaterialTable>()},
+      materials_{options.materialTable ? options.materialTable : ownMaterials_.get()} {
+    loadModel(filePath);
+}
+
+Model::~Model() {
+    if (asyncLoad_) {
+        // the import task works with this model
+        if (!asyncLoad_->isImported) {
+            asyncLoad_->imported.wait();
+        }
+        // release texture arrays that were allocated but never finished
+        textures_.adopt(std::move(asyncLoad_->textureSet));
+        asyncLoad_.reset();
+    }
+    if (!ownMaterials_) {
+        for (auto index : materialIndices_ | std::views::values) {
+            materials_->remove(index);
+        }
+    }
+    if (ownArena_) {
+        return;
+    }
+    drawBatches_.clear();
+    nodeMeshes_.clear();
+    meshesAndImagesInfo_.clear();
+    auto stats = arena_->stats();
+    auto usage = stats.capacityBytes > 0
+                     ? static_cast<float>(stats.usedBytes) / static_cast<float>(stats.capacityBytes)
+                     : 1.0f;
+    if (usage < cArenaCompactionUsage) {
+        arena_->compact();
+    }
+}
 
 void Model::loadModel(const std::filesystem::path& filePath) {
+    auto startTime = std::chrono::steady_clock::now();
+    if (asyncLoad_ && !asyncLoad_->isImported) {
+        asyncLoad_->imported.wait();
+    }
+    directory_ = filePath.parent_path();
+    if (options_.async) {
+        startAsyncLoad_(filePath);
+        return;
+    }
+
+    loadState_ = ModelLoadState::Loading;
+    auto addMeshes = [this](const std::vector<MeshView>& meshes, const SceneGraph& sceneGraph) {
+        addMeshes_(meshes, sceneGraph);
+    };
+    if (!importMeshes_(filePath, addMeshes)) {
+        loadState_ = ModelLoadState::Failed;
+        return;
+    }
+    createTexturesAndSetMaterial_();
+    loadState_ = ModelLoadState::Ready;
+    std::cout << "Reading model file finished: " << filePath << " in " << sElapsedMs(startTime) << " ms"
+              << std::endl;
+}
+
+bool Model::importMeshes_(const std::filesystem::path& filePath, const OnMeshes& onMeshes) {
+    MeshCache meshCache;
+    if (options_.useMeshCache) {
+        if (auto cacheEntry = meshCache.load(filePath, sMeshCacheVariant(options_))) {
+            onMeshes(cacheEntry->meshes(), cacheEntry->sceneGraph());
+            std::cout << "Meshes are taken from mesh cache: " << filePath << std::endl;
+            return true;
+        }
+    }
+
     std::cout << "Reading model file: " << filePath << std::endl;
     Assimp::Importer importer;
     const auto* scene = importer.ReadFile(filePath.string(), aiProcess_Triangulate | aiProcess_FlipUVs);
     if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
         std::cout << "Error: read model file failed: " << filePath << std::endl;
+        return false;
+    }
+    std::vector<MeshData> meshesData;
+    SceneGraph sceneGraph;
+    processNode_(scene->mRootNode, scene, SceneGraph::cNoParent, sceneGraph, meshesData);
+    if (options_.optimizeMeshes) {
+        optimizeMeshes_(meshesData);
+    }
+    if (options_.generateLods) {
+        generateLods_(meshesData);
+    }
+
+    std::vector<MeshView> meshes;
+    meshes.reserve(meshesData.size());
+    for (const auto& meshData : meshesData) {
+        meshes.push_back(MeshView{meshData.vertices, meshData.indices, meshData.images, meshData.bounds,
+                                  meshData.node, meshData.lods});
+    }
+    onMeshes(meshes, sceneGraph);
+    if (options_.useMeshCache) {
+        meshCache.store(filePath, meshes, sceneGraph, sMeshCacheVariant(options_));
+    }
+    return true;
+}
+
+void Model::update(double budgetMs) {
+    updateNodeTrs_();
+    if (!asyncLoad_) {
         return;
     }
-    directory_ = filePath.parent_path();
-    processNode_(scene->mRootNode, scene);
-    createTexturesAndSetMaterial_();
-    std::cout << "Reading model file finished: " << filePath << std::endl;
+    auto& load = *asyncLoad_;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double, std::milli>(budgetMs);
+    if (!load.isImported) {
+        if (load.imported.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return;
+        }
+        startAsyncUploads_();
+        if (!asyncLoad_) {
+            return;
+        }
+    }
+
+    // decoded texture layers go first since they hold memory, geometry fills the rest of the budget.
+    // at least one step is done per call, so the load always progresses
+    do {
+        if (auto layer = load.preparedLayers->tryPop()) {
+            const auto& target = load.texturePlan->targets[layer->targetIdx];
+            const auto& array = load.texturePlan->arrays[target.arrayIdx];
+            Utils::uploadTextureLayer(load.textureSet, *load.texturePlan, *layer, &*load.uploadRing);
+            load.uploadedBytes += Utils::textureLayerSize(array);
+            ++load.uploadedLayersCount;
+        } else if (load.nextPendingMesh < load.pendingMeshes.size()) {
+            auto* mesh = load.pendingMeshes[load.nextPendingMesh];
+            load.uploadedBytes += mesh->uploadStep(cUploadChunkBytes);
+            if (mesh->isUploaded()) {
+                mesh->releaseGeometryData();
+                ++load.nextPendingMesh;
+            }
+        } else if (load.uploadedLayersCount == load.texturePlan->targets.size()) {
+            finishAsyncLoad_();
+            return;
+        } else {
+            // waiting for decoders
+            return;
+        }
+    } while (std::chrono::steady_clock::now() < deadline);
+}
+
+ModelLoadState Model::loadState() const { return loadState_; }
+
+float Model::loadProgress() const {
+    if (loadState_ == ModelLoadState::Ready) {
+        return 1.0f;
+    }
+    if (!asyncLoad_ || asyncLoad_->totalBytes == 0) {
+        return 0.0f;
+    }
+    return static_cast<float>(asyncLoad_->uploadedBytes) / static_cast<float>(asyncLoad_->totalBytes);
+}
+
+void Model::startAsyncLoad_(const std::filesystem::path& filePath) {
+    loadState_ = ModelLoadState::Loading;
+    asyncLoad_ = std::make_unique<AsyncLoad>();
+    asyncLoad_->filePath = filePath;
+    asyncLoad_->startTime = std::chrono::steady_clock::now();
+    asyncLoad_->imported =
+        ThreadPool::global().submit([this, filePath]() -> std::optional<AsyncLoad::ImportedModel> {
+            AsyncLoad::ImportedModel imported;
+            auto encodeMeshes = [this, &imported](const std::vector<MeshView>& meshes,
+                                                  const SceneGraph& sceneGraph) {
+                auto geometries = sEncodeMeshes(meshes, options_);
+                for (size_t meshIdx = 0; meshIdx < meshes.size(); ++meshIdx) {
+                    imported.meshes.push_back(AsyncLoad::ImportedMesh{
+                        std::move(geometries[meshIdx]), meshes[meshIdx].images, meshes[meshIdx].node});
+                }
+                imported.sceneGraph = sceneGraph;
+            };
+            if (!importMeshes_(filePath, encodeMeshes)) {
+                return {};
+            }
+            std::unordered_set<std::filesystem::path> uniqueImages;
+            for (const auto& importedMesh : imported.meshes) {
+                for (const auto& image : importedMesh.images | std::views::values) {
+                    uniqueImages.insert(image);
+                }
+            }
+            imported.texturePlan = Utils::planTextureSet(uniqueImages, options_.compressTextures);
+            return imported;
+        });
+}
+
+void Model::startAsyncUploads_() {
+    auto& load = *asyncLoad_;
+    auto imported = load.imported.get();
+    load.isImported = true;
+    if (!imported) {
+        loadState_ = ModelLoadState::Failed;
+        asyncLoad_.reset();
+        return;
+    }
+
+    // GPU storage is allocated now and filled by update, meshes are drawn untextured until all layers arrive
+    setSceneGraph_(imported->sceneGraph);
+    for (auto& importedMesh : imported->meshes) {
+        auto material = materialFor_(importedMesh.images);
+        auto mesh = std::make_unique<Mesh>(std::move(importedMesh.geometry), material, *arena_,
+                                           DeferredUpload{});
+        load.totalBytes += mesh->geometryBytes();
+        load.pendingMeshes.push_back(mesh.get());
+        attachMesh_(std::move(mesh), importedMesh.node, std::move(importedMesh.images));
+    }
+    buildDrawBatches_();
+    updateNodeTrs_();
+
+    load.texturePlan = std::make_shared<const Utils::TextureSetPlan>(std::move(imported->texturePlan));
+    load.preparedLayers = std::make_shared<Utils::PreparedLayersQueue>();
+    load.textureSet = Utils::allocateTextureArrays(*load.texturePlan);
+    load.uploadRing.emplace();
+    for (size_t targetIdx = 0; targetIdx < load.texturePlan->targets.size(); ++targetIdx) {
+        const auto& array = load.texturePlan->arrays[load.texturePlan->targets[targetIdx].arrayIdx];
+        load.totalBytes += Utils::textureLayerSize(array);
+        ThreadPool::global().submit([plan = load.texturePlan, preparedLayers = load.preparedLayers,
+                                     targetIdx]() {
+            preparedLayers->push(
+                Utils::PreparedLayer{targetIdx, Utils::prepareTextureLayer(*plan, targetIdx)});
+        });
+    }
 }
 
-void Model::draw(ShaderProgram& shader) const {
+void Model::finishAsyncLoad_() {
+    auto& load = *asyncLoad_;
+    Utils::finishTextureArrays(load.textureSet);
+    textures_.adopt(std::move(load.textureSet));
+    assignMaterials_();
+    loadState_ = ModelLoadState::Ready;
+    std::cout << "Reading model file finished: " << load.filePath << " in " << sElapsedMs(load.startTime)
+              << " ms" << std::endl;
+    asyncLoad_.reset();
+}
+
+size_t Model::meshesCount() const { return meshesAndImagesInfo_.size(); }
+
+size_t Model::drawBatchesCount() const { return drawBatches_.size(); }
+
+BoundingBox Model::worldBounds() const {
+    std::optional<BoundingBox> bounds;
     for (const auto& mesh : meshesAndImagesInfo_ | std::views::keys) {
-        mesh->draw(shader);
+        if (!mesh->isUploaded()) {
+            continue;
+        }
+        const auto& meshBounds = mesh->worldBounds();
+        if (!bounds) {
+            bounds = meshBounds;
+            continue;
+        }
+        bounds->min = glm::min(bounds->min, meshBounds.min);
+        bounds->max = glm::max(bounds->max, meshBounds.max);
+    }
+    return bounds.value_or(BoundingBox{});
+}
+
+SceneGraph& Model::sceneGraph() { return sceneGraph_; }
+
+const SceneGraph& Model::sceneGraph() const { return sceneGraph_; }
+
+void Model::submit(RenderQueue& queue, ShaderProgram& shader) const {
+    submit_(queue, [&shader](MaterialIndex) -> ShaderProgram& { return shader; });
+}
+
+void Model::submit(RenderQueue& queue, ShaderVariants& shaders) const {
+    submit_(queue, [this, &shaders](MaterialIndex material) -> ShaderProgram& {
+        return shaders.program(*materials_, material);
+    });
+}
+
+void Model::submit_(RenderQueue& queue,
+                    const std::function<ShaderProgram&(MaterialIndex)>& selectShader) const {
+    for (const auto& batch : drawBatches_) {
+        // meshes of an asynchronous load appear as their geometry arrives
+        drawRanges_.clear();
+        for (const auto* mesh : batch) {
+            if (mesh->isUploaded() && queue.isVisible(*mesh)) {
+                drawRanges_.push_back(mesh->drawRange(queue.selectLod(*mesh)));
+            }
+        }
+        if (drawRanges_.empty()) {
+            continue;
+        }
+        queue.submit(selectShader(batch.front()->material()), *materials_, *batch.front(), drawRanges_);
     }
 }
 
-void Model::processNode_(aiNode* node, const aiScene* scene) {
+void Model::processNode_(aiNode* node, const aiScene* scene, SceneNodeIndex parent, SceneGraph& sceneGraph,
+                         std::vector<MeshData>& meshesData) {
+    auto sceneNode = sceneGraph.addNode(parent, sToGlm(node->mTransformation), node->mName.C_Str());
     for (size_t i = 0; i < node->mNumMeshes; ++i) {
         auto* mesh = scene->mMeshes[node->mMeshes[i]];
-        loadFromAiMesh_(mesh, scene);
+        loadFromAiMesh_(mesh, scene, sceneNode, meshesData);
     }
     for (size_t i = 0; i < node->mNumChildren; ++i) {
-        processNode_(node->mChildren[i], scene);
+        processNode_(node->mChildren[i], scene, sceneNode, sceneGraph, meshesData);
     }
 }
 
-void Model::loadFromAiMesh_(aiMesh* mesh, const aiScene* scene) {
-    std::vector<Vertex> vertices;
-    std::vector<int> indices;
+void Model::loadFromAiMesh_(aiMesh* mesh, const aiScene* scene, SceneNodeIndex node,
+                            std::vector<MeshData>& meshesData) {
+    if (mesh->mMaterialIndex == 0) {
+        return;
+    }
+    MeshData meshData;
+    meshData.node = node;
+    auto& vertices = meshData.vertices;
+    auto& indices = meshData.indices;
 
     vertices.reserve(mesh->mNumVertices);
     for (size_t i = 0; i < mesh->mNumVertices; ++i) {
@@ -84,13 +473,86 @@ void Model::loadFromAiMesh_(aiMesh* mesh, const aiScene* scene) {
         }
     }
 
-    auto ourMesh = std::make_unique<Mesh>(vertices, indices, Material{});
+    // taken before optimization, welding and reordering keep the positions
+    meshData.bounds = computeBounds(vertices);
+
+    auto materials = scene->mMaterials[mesh->mMaterialIndex];
+    meshData.images = sLoadImagesInfoFromAssimpMaterial(materials, directory_);
+    meshesData.push_back(std::move(meshData));
+}
+
+void Model::optimizeMeshes_(std::vector<MeshData>& meshesData) const {
+    auto startTime = std::chrono::steady_clock::now();
+    size_t verticesBefore = 0;
+    size_t verticesAfter = 0;
+    for (size_t meshIdx = 0; meshIdx < meshesData.size(); ++meshIdx) {
+        auto& meshData = meshesData[meshIdx];
+        auto stats = MeshOptimizer::optimize(meshData.vertices, meshData.indices);
+        std::cout << "Mesh " << meshIdx << " optimized: " << stats.trianglesCount << " triangles, vertices "
+                  << stats.verticesBefore << " -> " << stats.verticesAfter << ", ACMR " << stats.acmrBefore
+                  << " -> " << stats.acmrAfter << ", ATVR " << stats.atvrBefore << " -> " << stats.atvrAfter
+                  << std::endl;
+        verticesBefore += stats.verticesBefore;
+        verticesAfter += stats.verticesAfter;
+    }
+    std::cout << meshesData.size() << " meshes optimized in " << sElapsedMs(startTime) << " ms, vertices "
+              << verticesBefore << " -> " << verticesAfter << std::endl;
+}
+
+void Model::generateLods_(std::vector<MeshData>& meshesData) const {
+    auto startTime = std::chrono::steady_clock::now();
+    size_t lodsCount = 0;
+    for (auto& meshData : meshesData) {
+        meshData.lods = MeshSimplifier::generateLods(meshData.vertices, meshData.indices);
+        lodsCount += meshData.lods.size();
+    }
+    std::cout << lodsCount << " levels of detail of " << meshesData.size() << " meshes generated in "
+              << sElapsedMs(startTime) << " ms" << std::endl;
+}
+
+void Model::addMeshes_(const std::vector<MeshView>& meshes, const SceneGraph& sceneGraph) {
+    setSceneGraph_(sceneGraph);
+    auto geometries = sEncodeMeshes(meshes, options_);
+    for (size_t meshIdx = 0; meshIdx < meshes.size(); ++meshIdx) {
+        auto gpuMesh = std::make_unique<Mesh>(std::move(geometries[meshIdx]),
+                                              materialFor_(meshes[meshIdx].images), *arena_);
+        // the geometry lives in the arena from now on
+        gpuMesh->releaseGeometryData();
+        attachMesh_(std::move(gpuMesh), meshes[meshIdx].node, meshes[meshIdx].images);
+    }
+    buildDrawBatches_();
+    updateNodeTrs_();
+}
+
+void Model::setSceneGraph_(const SceneGraph& sceneGraph) {
+    sceneGraph_ = sceneGraph;
+    nodeMeshes_.assign(sceneGraph_.size(), {});
+}
+
+void Model::attachMesh_(std::unique_ptr<Mesh> mesh, SceneNodeIndex node, ImagesInfo images) {
+    nodeMeshes_[node].push_back(mesh.get());
+    meshesAndImagesInfo_.emplace(std::move(mesh), std::move(images));
+}
 
-    if (mesh->mMaterialIndex > 0) {
-        auto materials = scene->mMaterials[mesh->mMaterialIndex];
-        auto images = sLoadImagesInfoFromAssimpMaterial(materials, directory_);
-        meshesAndImagesInfo_.emplace(std::make_pair(std::move(ourMesh), images));
+void Model::updateNodeTrs_() {
+    if (!sceneGraph_.hasChanges()) {
+        return;
     }
+    // the world bounds of the meshes follow, so culling sees the moved meshes in the same frame
+    sceneGraph_.updateWorldTrs([this](SceneNodeIndex node) {
+        for (auto* mesh : nodeMeshes_[node]) {
+            mesh->setModelTr(sceneGraph_.worldTr(node));
+        }
+    });
+}
+
+MaterialIndex Model::materialFor_(const ImagesInfo& imagesInfo) {
+    // untextured until the textures are loaded, see assignMaterials_
+    auto it = materialIndices_.find(imagesInfo);
+    if (it == materialIndices_.end()) {
+        it = materialIndices_.emplace(imagesInfo, materials_->add(Material{.color = defaultColor})).first;
+    }
+    return it->second;
 }
 
 void Model::createTexturesAndSetMaterial_() {
@@ -98,23 +560,38 @@ void Model::createTexturesAndSetMaterial_() {
     for (const auto& images : meshesAndImagesInfo_ | std::views::values | std::views::join) {
         uniqueImages.insert(images.second);
     }
-    const auto [textureId, textureLayersMap] = Utils::createTextureFromImages(uniqueImages);
+    textures_.addImages(uniqueImages, 0, options_.compressTextures);
+    assignMaterials_();
+}
 
-    for (auto& [mesh, imagesInfo] : meshesAndImagesInfo_) {
+void Model::assignMaterials_() {
+    for (const auto& [imagesInfo, index] : materialIndices_) {
         Material material;
+        material.textureData = textures_.makeTextureData(imagesInfo);
+        if (!material.textureData) {
+            material.color = defaultColor;
+        }
+        materials_->update(index, material);
+    }
+}
 
-        std::unordered_map<TextureType, std::vector<TextureLayerIndex>> textures;
-        for (const auto& [textureType, imagePath] : imagesInfo) {
-            if (auto textureLayersIt = textureLayersMap.find(imagePath);
-                textureLayersIt != textureLayersMap.end()) {
-                textures[textureType].emplace_back(textureLayersIt->second);
+void Model::buildDrawBatches_() {
+    // meshes of a batch share the material index, the transforms of their node and the vertex decoding,
+    // which is the one of the model for all but small meshes
+    drawBatches_.clear();
+    for (const auto& meshes : nodeMeshes_) {
+        auto firstBatch = drawBatches_.size();
+        for (const auto* mesh : meshes) {
+            auto batchIt = std::find_if(
+                drawBatches_.begin() + static_cast<std::ptrdiff_t>(firstBatch), drawBatches_.end(),
+                [mesh](const std::vector<const Mesh*>& batch) {
+                    return batch.front()->material() == mesh->material() &&
+                           batch.front()->hasSameVertexDecoding(*mesh);
+                });
+            if (batchIt == drawBatches_.end()) {
+                batchIt = drawBatches_.insert(drawBatches_.end(), std::vector<const Mesh*>{});
             }
+            batchIt->push_back(mesh);
         }
-        if (textures.empty()) {
-            material.color = defaultColor;
-        } else {
-            material.textureData = TextureData{.id = textureId, .textures = std::move(textures)};
-        }
-        mesh->setMaterial(material);
     }
-}
\ No newline at end of file
+}
@@ -1,25 +1,127 @@
 #pragma once
 
+#include "GeometryArena.h"
+#include "MaterialTable.h"
 #include "Mesh.h"
+#include "MeshCache.h"
+#include "RenderQueue.h"
+#include "SceneGraph.h"
+#include "ShaderVariants.h"
+#include "TextureArrayManager.h"
 #include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
 #include <unordered_map>
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+struct ModelLoadOptions {
+    // reuse meshes imported on previous runs, see MeshCache
+    bool useMeshCache = true;
+    // parse and decode on worker threads, upload to GPU a bit each frame in Model::update
+    bool async = false;
+    // weld vertices and reorder triangles and vertices for the GPU caches on import, see MeshOptimizer
+    bool optimizeMeshes = true;
+    // simplified index buffers drawn for meshes far from the camera, see MeshSimplifier and
+    // RenderQueue::selectLod
+    bool generateLods = true;
+    // quantized positions, octahedral normals and half float texture coordinates, see CompactVertex
+    bool compactVertices = true;
+    // store textures block compressed (BC1/BC3/BC4/BC5), encoded images are kept in the texture cache
+    bool compressTextures = false;
+    // arena shared by the models of a scene, it must outlive them. The model gets its own arena if null
+    GeometryArena* geometryArena = nullptr;
+    // material table shared by the models of a scene, it must outlive them. The model gets its own if null
+    MaterialTable* materialTable = nullptr;
+};
+
+enum class ModelLoadState { Loading, Ready, Failed };
+
 class Model {
    public:
-    Model(const std::filesystem::path& file);
+    Model(const std::filesystem::path& file, const ModelLoadOptions& options = {});
+    ~Model();
     void loadModel(const std::filesystem::path& file);
-    void draw(ShaderProgram& shader) const;
+    // submits one multi-draw per node and material with the level of detail the queue selects for every
+    // mesh, the model must stay alive until the queue is flushed
+    void submit(RenderQueue& queue, ShaderProgram& shader) const;
+    // the same with the variant of every material
+    void submit(RenderQueue& queue, ShaderVariants& shaders) const;
+    // moves the meshes of nodes changed in the scene graph and continues an asynchronous load, spends about
+    // budgetMs on GPU uploads. Call once per frame
+    void update(double budgetMs);
+    ModelLoadState loadState() const;
+    // fraction of the model data uploaded to GPU
+    float loadProgress() const;
+    size_t meshesCount() const;
+    // meshes of a node sharing a material are drawn with one multi-draw call
+    size_t drawBatchesCount() const;
+    // of the meshes uploaded so far, in world coordinates
+    BoundingBox worldBounds() const;
+    // node hierarchy of the file, changed local transforms are applied by update
+    SceneGraph& sceneGraph();
+    const SceneGraph& sceneGraph() const;
 
-    using ImagesInfo = std::vector<std::pair<TextureType, std::filesystem::path>>;
+    using ImagesInfo = MeshImagesInfo;
 
    private:
+    // runs the import steps in isolation, see benchmarks/ImportBenchmarks.cpp
+    friend struct ModelBenchmarkAccess;
+
+    // mesh converted from Assimp
+    struct MeshData {
+        std::vector<Vertex> vertices;
+        std::vector<int> indices;
+        ImagesInfo images;
+        BoundingBox bounds;
+        SceneNodeIndex node;
+        std::vector<MeshLod> lods;
+    };
+    struct AsyncLoad;
+
+    ModelLoadOptions options_;
     std::filesystem::path directory_;
+    // declared before the meshes, they give their ranges back on destruction
+    std::unique_ptr<GeometryArena> ownArena_;
+    GeometryArena* arena_;
+    std::unique_ptr<MaterialTable> ownMaterials_;
+    MaterialTable* materials_;
+    // meshes with the same images share one material of the table
+    std::map<ImagesInfo, MaterialIndex> materialIndices_;
     std::unordered_map<std::unique_ptr<Mesh>, ImagesInfo> meshesAndImagesInfo_;
+    SceneGraph sceneGraph_;
+    // meshes attached to each node of the scene graph
+    std::vector<std::vector<Mesh*>> nodeMeshes_;
+    std::vector<std::vector<const Mesh*>> drawBatches_;
+    mutable std::vector<GeometryDrawRange> drawRanges_;
+    TextureArrayManager textures_;
+    ModelLoadState loadState_{ModelLoadState::Loading};
+    std::unique_ptr<AsyncLoad> asyncLoad_;
 
-    void processNode_(aiNode* node, const aiScene* scene);
-    void loadFromAiMesh_(aiMesh* mesh, const aiScene* scene);
+    // passes all meshes and the node hierarchy of the file to onMeshes, takes them from the mesh cache when
+    // possible. Doesn't touch GL, so it runs on workers for asynchronous loads
+    using OnMeshes = std::function<void(const std::vector<MeshView>&, const SceneGraph&)>;
+    bool importMeshes_(const std::filesystem::path& filePath, const OnMeshes& onMeshes);
+    void processNode_(aiNode* node, const aiScene* scene, SceneNodeIndex parent, SceneGraph& sceneGraph,
+                      std::vector<MeshData>& meshesData);
+    void loadFromAiMesh_(aiMesh* mesh, const aiScene* scene, SceneNodeIndex node,
+                         std::vector<MeshData>& meshesData);
+    void optimizeMeshes_(std::vector<MeshData>& meshesData) const;
+    void generateLods_(std::vector<MeshData>& meshesData) const;
+    void addMeshes_(const std::vector<MeshView>& meshes, const SceneGraph& sceneGraph);
+    void setSceneGraph_(const SceneGraph& sceneGraph);
+    void attachMesh_(std::unique_ptr<Mesh> mesh, SceneNodeIndex node, ImagesInfo images);
+    // moves the meshes of the changed subtrees
+    void updateNodeTrs_();
+    MaterialIndex materialFor_(const ImagesInfo& imagesInfo);
+    void buildDrawBatches_();
+    // the program of every batch is picked by its material
+    void submit_(RenderQueue& queue, const std::function<ShaderProgram&(MaterialIndex)>& selectShader) const;
     void createTexturesAndSetMaterial_();
-};
\ No newline at end of file
+    void assignMaterials_();
+    void startAsyncLoad_(const std::filesystem::path& filePath);
+    void startAsyncUploads_();
+    void finishAsyncLoad_();
+};
@@ -0,0 +1,134 @@
+#include "OcclusionCuller.h"
+
+#include <glad/glad.h>
+#include <iterator>
+
+namespace {
+// unit cube corners, mixed between the box min and max by occlusionBox.vs
+const float cCubeCorners[] = {0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f,
+                              0.0f, 0.0f, 1.0f, 1.0f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 1.0f, 1.0f};
+const unsigned char cCubeIndices[] = {0, 2, 1, 0, 3, 2, 4, 5, 6, 4, 6, 7, 0, 1, 5, 0, 5, 4,
+                                      3, 6, 2, 3, 7, 6, 0, 4, 7, 0, 7, 3, 1, 2, 6, 1, 6, 5};
+// the near plane corners are at most this many near plane distances from the camera for fields of view
+// under 90 degrees
+constexpr float cNearPlaneMargin{2.0f};
+
+bool sContains(const BoundingBox& box, const glm::vec3& point, float margin) {
+    return glm::all(glm::greaterThanEqual(point, box.min - margin)) &&
+           glm::all(glm::lessThanEqual(point, box.max + margin));
+}
+}  // namespace
+
+OcclusionCuller::OcclusionCuller(const ShaderProgram& boxShader)
+    : boxShader_(boxShader),
+      boxMinLocation_(boxShader.uniformLocation("boxMin")),
+      boxMaxLocation_(boxShader.uniformLocation("boxMax")) {
+    glGenVertexArrays(1, &vao_);
+    glGenBuffers(1, &vbo_);
+    glGenBuffers(1, &ebo_);
+    glBindVertexArray(vao_);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(cCubeCorners), cCubeCorners, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo_);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cCubeIndices), cCubeIndices, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    glBindVertexArray(0);
+}
+
+OcclusionCuller::~OcclusionCuller() {
+    clear();
+    glDeleteQueries(static_cast<GLsizei>(freeQueries_.size()), freeQueries_.data());
+    glDeleteBuffers(1, &ebo_);
+    glDeleteBuffers(1, &vbo_);
+    glDeleteVertexArrays(1, &vao_);
+}
+
+void OcclusionCuller::setView(const glm::vec3& viewPosition, float nearPlane) {
+    viewPosition_ = viewPosition;
+    nearPlane_ = nearPlane;
+}
+
+bool OcclusionCuller::testMesh(const Mesh& mesh) {
+    const auto& bounds = mesh.worldBounds();
+    if (sContains(bounds, viewPosition_, cNearPlaneMargin * nearPlane_)) {
+        // not tested, so the result is dropped at the end of the frame
+        return true;
+    }
+    auto& test = tests_[&mesh];
+    auto isVisible = !test.isOccluded || test.frame + 1 != frame_;
+    test.bounds = bounds;
+    test.frame = frame_;
+    return isVisible;
+}
+
+void OcclusionCuller::issueTests() {
+    stats_ = Stats{};
+    boxShader_.use();
+    glBindVertexArray(vao_);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_FALSE);
+    // the faces of a box lying on the surface it bounds should pass
+    glDepthFunc(GL_LEQUAL);
+    for (auto it = tests_.begin(); it != tests_.end();) {
+        auto& test = it->second;
+        if (test.isPending) {
+            readQuery_(test);
+        }
+        if (test.frame != frame_) {
+            // meshes not tested in this frame start visible again, a pending query is simply overwritten
+            if (test.query != 0) {
+                freeQueries_.push_back(test.query);
+            }
+            it = tests_.erase(it);
+            continue;
+        }
+        if (test.isPending) {
+            ++stats_.waitingTestsCount;
+        } else {
+            if (test.query == 0) {
+                if (freeQueries_.empty()) {
+                    glGenQueries(1, &test.query);
+                } else {
+                    test.query = freeQueries_.back();
+                    freeQueries_.pop_back();
+                }
+            }
+            boxShader_.setUniform(boxMinLocation_, test.bounds.min);
+            boxShader_.setUniform(boxMaxLocation_, test.bounds.max);
+            glBeginQuery(GL_ANY_SAMPLES_PASSED, test.query);
+            glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(std::size(cCubeIndices)), GL_UNSIGNED_BYTE, 0);
+            glEndQuery(GL_ANY_SAMPLES_PASSED);
+            test.isPending = true;
+            ++stats_.testsCount;
+        }
+        ++it;
+    }
+    glBindVertexArray(0);
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    ++frame_;
+}
+
+void OcclusionCuller::clear() {
+    for (const auto& [mesh, test] : tests_) {
+        if (test.query != 0) {
+            freeQueries_.push_back(test.query);
+        }
+    }
+    tests_.clear();
+}
+
+const OcclusionCuller::Stats& OcclusionCuller::stats() const { return stats_; }
+
+void OcclusionCuller::readQuery_(Test& test) {
+    int isAvailable = 0;
+    glGetQueryObjectiv(test.query, GL_QUERY_RESULT_AVAILABLE, &isAvailable);
+    if (isAvailable) {
+        unsigned int anySamplesPassed = 0;
+        glGetQueryObjectuiv(test.query, GL_QUERY_RESULT, &anySamplesPassed);
+        test.isOccluded = anySamplesPassed == 0;
+        test.isPending = false;
+    }
+}
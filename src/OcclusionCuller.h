@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+#include "ShaderProgram.h"
+
+// hides meshes whose bounding box was behind the depth of the scene. After the draws of a frame the boxes of
+// the tested meshes are drawn depth tested only, each in a GL_ANY_SAMPLES_PASSED query, and the results are
+// read one frame later without waiting for the GPU. A mesh is hidden while its last finished query found no
+// samples, so it may pop in a frame late. Meshes not tested in the previous frame are visible
+class OcclusionCuller {
+   public:
+    // counters of the last issueTests
+    struct Stats {
+        size_t testsCount = 0;
+        // queries of earlier frames whose results were still not there, their meshes keep the last result
+        size_t waitingTestsCount = 0;
+    };
+
+    // the program draws the boxes, made of occlusionBox.vs and a fragment shader writing nothing
+    explicit OcclusionCuller(const ShaderProgram& boxShader);
+    ~OcclusionCuller();
+    OcclusionCuller(const OcclusionCuller&) = delete;
+    OcclusionCuller& operator=(const OcclusionCuller&) = delete;
+
+    // boxes the camera is in or near are never tested, their front faces would be clipped
+    void setView(const glm::vec3& viewPosition, float nearPlane);
+    // false if the last finished test of the mesh found it hidden. The mesh is tested again in this frame
+    bool testMesh(const Mesh& mesh);
+    // draws the boxes of the meshes tested in this frame against the depth buffer. Expects the depth of the
+    // frame to be complete, leaves the depth function GL_LESS with color and depth writes on
+    void issueTests();
+    // forgets all results, e.g. after the culling was off for a while
+    void clear();
+    const Stats& stats() const;
+
+   private:
+    struct Test {
+        unsigned int query = 0;
+        BoundingBox bounds;
+        // frame the mesh was last tested in
+        size_t frame = 0;
+        bool isPending = false;
+        bool isOccluded = false;
+    };
+
+    ShaderProgram boxShader_;
+    UniformLocation boxMinLocation_;
+    UniformLocation boxMaxLocation_;
+    unsigned int vao_{0};
+    unsigned int vbo_{0};
+    unsigned int ebo_{0};
+    std::unordered_map<const Mesh*, Test> tests_;
+    // queries of the tests that were dropped, reused by new ones
+    std::vector<unsigned int> freeQueries_;
+    glm::vec3 viewPosition_{0.0f};
+    float nearPlane_{0.0f};
+    // starts at 1, so that a new test was never tested in the previous frame
+    size_t frame_{1};
+    Stats stats_;
+
+    // takes the result of the pending query of the test if it is ready
+    void readQuery_(Test& test);
+};
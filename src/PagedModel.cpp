@@ -0,0 +1,539 @@
+#include "PagedModel.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <ranges>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+#include <assimp/scene.h>
+
+namespace {
+namespace fs = std::filesystem;
+
+constexpr char cMagic[4] = {'N', 'A', 'P', 'M'};
+// bump on any change of the layout below or of the import producing the chunks
+constexpr uint32_t cVersion = 1;
+// pages start at multiples of the usual disk and OS page size
+constexpr uint64_t cPageAlignment = 4096;
+// geometry blobs inside a page, as in the mesh cache
+constexpr uint64_t cBlobAlignment = 16;
+
+// layout: header, material records with their image paths, chunk records, pages
+struct Header {
+    char magic[4];
+    uint32_t version;
+    uint32_t materialsCount;
+    uint32_t chunksCount;
+    uint64_t materialsOffset;
+    uint64_t chunksOffset;
+    float boundsMin[3];
+    float boundsMax[3];
+};
+
+struct ChunkRecord {
+    float boundsMin[3];
+    float boundsMax[3];
+    uint64_t pageOffset;
+    uint64_t pageBytes;
+    uint64_t geometryBytes;
+};
+
+// followed by imagesCount image records
+struct MaterialRecord {
+    uint32_t imagesCount;
+};
+
+// followed by pathLength chars of the image path
+struct ImageRecord {
+    uint32_t type;
+    uint32_t pathLength;
+};
+
+// starts every page, followed by meshesCount meshes
+struct PageRecord {
+    uint32_t meshesCount;
+    uint32_t padding;
+};
+
+struct LodRecord {
+    uint64_t firstIndex;
+    uint64_t indicesCount;
+    float error;
+    uint32_t padding;
+};
+
+// followed by the vertex and the index data, each aligned to cBlobAlignment
+struct PageMeshRecord {
+    uint32_t material;
+    uint32_t vertexFormat;
+    uint32_t hasShortIndices;
+    uint32_t lodsCount;
+    uint64_t vertexBytes;
+    uint64_t indexBytes;
+    uint64_t indicesCount;
+    float positionOffset[3];
+    float positionScale[3];
+    float boundsMin[3];
+    float boundsMax[3];
+    LodRecord lods[cMaxMeshLods];
+};
+
+const std::map<aiTextureType, TextureType> cAiTextureTypeToOurTextureType{
+    {aiTextureType_DIFFUSE, TextureType::Diffuse},
+    {aiTextureType_SPECULAR, TextureType::Specular},
+    {aiTextureType_EMISSIVE, TextureType::Emission}};
+
+// a triangle of the imported scene, chunks are ranges of them
+struct Triangle {
+    glm::vec3 centroid;
+    uint32_t mesh;
+    uint32_t face;
+};
+
+uint64_t sAlign(uint64_t offset, uint64_t alignment) {
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+template <typename T>
+void sAppend(std::string& bytes, const T& value) {
+    bytes.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void sPad(std::string& bytes, uint64_t alignment) { bytes.resize(sAlign(bytes.size(), alignment), '\0'); }
+
+void sToFloats(const glm::vec3& vector, float (&floats)[3]) {
+    for (int axis = 0; axis < 3; ++axis) {
+        floats[axis] = vector[axis];
+    }
+}
+
+glm::vec3 sToVec3(const float (&floats)[3]) { return glm::vec3(floats[0], floats[1], floats[2]); }
+
+BoundingBox sUnite(const BoundingBox& first, const BoundingBox& second) {
+    return BoundingBox{glm::min(first.min, second.min), glm::max(first.max, second.max)};
+}
+
+MeshImagesInfo sImagesInfo(const aiMaterial& material, const fs::path& directory) {
+    MeshImagesInfo images;
+    for (const auto& [assimpType, ourType] : cAiTextureTypeToOurTextureType) {
+        for (unsigned int imageIdx = 0; imageIdx < material.GetTextureCount(assimpType); ++imageIdx) {
+            aiString imageName;
+            material.GetTexture(assimpType, imageIdx, &imageName);
+            images.emplace_back(ourType, directory / imageName.C_Str());
+        }
+    }
+    return images;
+}
+
+// ranges of triangles of at most maxTriangles, split at the median centroid along the longest axis of the
+// centroid bounds. Neighbouring ranges are near each other in space, so are their pages in the file
+std::vector<std::pair<size_t, size_t>> sPartition(std::vector<Triangle>& triangles, size_t maxTriangles) {
+    std::vector<std::pair<size_t, size_t>> chunks;
+    std::vector<std::pair<size_t, size_t>> ranges{{0, triangles.size()}};
+    while (!ranges.empty()) {
+        auto [begin, end] = ranges.back();
+        ranges.pop_back();
+        if (begin == end) {
+            continue;
+        }
+        if (end - begin <= maxTriangles) {
+            chunks.emplace_back(begin, end);
+            continue;
+        }
+        glm::vec3 min(std::numeric_limits<float>::max());
+        glm::vec3 max(std::numeric_limits<float>::lowest());
+        for (size_t triangleIdx = begin; triangleIdx < end; ++triangleIdx) {
+            min = glm::min(min, triangles[triangleIdx].centroid);
+            max = glm::max(max, triangles[triangleIdx].centroid);
+        }
+        auto extent = max - min;
+        auto axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+        auto middle = begin + (end - begin) / 2;
+        auto first = triangles.begin();
+        std::nth_element(
+            first + static_cast<std::ptrdiff_t>(begin), first + static_cast<std::ptrdiff_t>(middle),
+            first + static_cast<std::ptrdiff_t>(end),
+            [axis](const Triangle& a, const Triangle& b) { return a.centroid[axis] < b.centroid[axis]; });
+        // the first half is taken next
+        ranges.emplace_back(middle, end);
+        ranges.emplace_back(begin, middle);
+    }
+    return chunks;
+}
+
+Vertex sVertex(const aiMesh& mesh, unsigned int index) {
+    Vertex vertex;
+    vertex.position = glm::vec3(mesh.mVertices[index].x, mesh.mVertices[index].y, mesh.mVertices[index].z);
+    vertex.normal = mesh.mNormals ? glm::vec3(mesh.mNormals[index].x, mesh.mNormals[index].y,
+                                              mesh.mNormals[index].z)
+                                  : glm::vec3(0.0f, 0.0f, 1.0f);
+    vertex.texCoord = mesh.mTextureCoords[0]
+                          ? glm::vec2(mesh.mTextureCoords[0][index].x, mesh.mTextureCoords[0][index].y)
+                          : glm::vec2(0.0f);
+    return vertex;
+}
+
+struct ChunkPage {
+    std::string bytes;
+    BoundingBox bounds;
+    uint64_t geometryBytes = 0;
+};
+
+// one mesh per material of the triangles, quantized to the bounds of the chunk so that they share the
+// decoding uniforms
+ChunkPage sBuildPage(const aiScene& scene, std::span<const Triangle> triangles,
+                     const PagedModelBuildOptions& options) {
+    struct MeshData {
+        std::vector<Vertex> vertices;
+        std::vector<int> indices;
+        std::vector<MeshLod> lods;
+    };
+    std::map<uint32_t, MeshData> meshesData;
+    // (mesh, vertex) -> vertex of the chunk mesh
+    std::unordered_map<uint64_t, int> chunkVertices;
+    for (const auto& triangle : triangles) {
+        const auto& mesh = *scene.mMeshes[triangle.mesh];
+        auto& meshData = meshesData[mesh.mMaterialIndex];
+        for (unsigned int corner = 0; corner < 3; ++corner) {
+            auto index = mesh.mFaces[triangle.face].mIndices[corner];
+            auto key = static_cast<uint64_t>(triangle.mesh) << 32 | index;
+            auto [it, isInserted] = chunkVertices.emplace(key, static_cast<int>(meshData.vertices.size()));
+            if (isInserted) {
+                meshData.vertices.push_back(sVertex(mesh, index));
+            }
+            meshData.indices.push_back(it->second);
+        }
+    }
+
+    ChunkPage page;
+    bool hasBounds = false;
+    for (auto& meshData : meshesData | std::views::values) {
+        if (options.optimizeMeshes) {
+            MeshOptimizer::optimize(meshData.vertices, meshData.indices);
+        }
+        if (options.generateLods) {
+            meshData.lods = MeshSimplifier::generateLods(meshData.vertices, meshData.indices);
+        }
+        auto bounds = computeBounds(meshData.vertices);
+        page.bounds = hasBounds ? sUnite(page.bounds, bounds) : bounds;
+        hasBounds = true;
+    }
+
+    sAppend(page.bytes, PageRecord{static_cast<uint32_t>(meshesData.size()), 0});
+    auto format = options.compactVertices ? VertexFormat::Compact : VertexFormat::Full;
+    for (const auto& [material, meshData] : meshesData) {
+        auto geometry = encodeGeometry(meshData.vertices, meshData.indices, format, page.bounds);
+        if (!meshData.lods.empty()) {
+            geometry.lods = meshData.lods;
+        }
+        PageMeshRecord record{};
+        record.material = material;
+        record.vertexFormat = static_cast<uint32_t>(geometry.vertexFormat);
+        record.hasShortIndices = geometry.hasShortIndices;
+        record.lodsCount = static_cast<uint32_t>(std::min(geometry.lods.size(), cMaxMeshLods));
+        record.vertexBytes = geometry.vertexData.size();
+        record.indexBytes = geometry.indexData.size();
+        record.indicesCount = geometry.indicesCount;
+        sToFloats(geometry.positionOffset, record.positionOffset);
+        sToFloats(geometry.positionScale, record.positionScale);
+        sToFloats(geometry.bounds.min, record.boundsMin);
+        sToFloats(geometry.bounds.max, record.boundsMax);
+        for (size_t lodIdx = 0; lodIdx < record.lodsCount; ++lodIdx) {
+            const auto& lod = geometry.lods[lodIdx];
+            record.lods[lodIdx] = LodRecord{lod.firstIndex, lod.indicesCount, lod.error, 0};
+        }
+        sPad(page.bytes, cBlobAlignment);
+        sAppend(page.bytes, record);
+        sPad(page.bytes, cBlobAlignment);
+        page.bytes.append(reinterpret_cast<const char*>(geometry.vertexData.data()),
+                          geometry.vertexData.size());
+        sPad(page.bytes, cBlobAlignment);
+        page.bytes.append(reinterpret_cast<const char*>(geometry.indexData.data()),
+                          geometry.indexData.size());
+        page.geometryBytes += record.vertexBytes + record.indexBytes;
+    }
+    return page;
+}
+
+}  // namespace
+
+bool buildPagedModel(const fs::path& modelPath, const fs::path& outputPath,
+                     const PagedModelBuildOptions& options) {
+    auto startTime = std::chrono::steady_clock::now();
+    std::cout << "Reading model file: " << modelPath << std::endl;
+    Assimp::Importer importer;
+    // node transforms are baked into the vertices, chunks are placed in model coordinates
+    const auto* scene = importer.ReadFile(
+        modelPath.string(), aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_PreTransformVertices);
+    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
+        std::cout << "Error: read model file failed: " << modelPath << std::endl;
+        return false;
+    }
+
+    std::vector<Triangle> triangles;
+    for (unsigned int meshIdx = 0; meshIdx < scene->mNumMeshes; ++meshIdx) {
+        const auto& mesh = *scene->mMeshes[meshIdx];
+        // the default material is skipped as Model does
+        if (mesh.mMaterialIndex == 0) {
+            continue;
+        }
+        for (unsigned int faceIdx = 0; faceIdx < mesh.mNumFaces; ++faceIdx) {
+            const auto& face = mesh.mFaces[faceIdx];
+            if (face.mNumIndices != 3) {
+                continue;
+            }
+            glm::vec3 centroid(0.0f);
+            for (unsigned int corner = 0; corner < 3; ++corner) {
+                const auto& position = mesh.mVertices[face.mIndices[corner]];
+                centroid += glm::vec3(position.x, position.y, position.z) / 3.0f;
+            }
+            triangles.push_back(Triangle{centroid, meshIdx, faceIdx});
+        }
+    }
+    auto chunkRanges = sPartition(triangles, std::max<size_t>(options.maxChunkTriangles, 1));
+
+    Header header{};
+    std::memcpy(header.magic, cMagic, sizeof(cMagic));
+    header.version = cVersion;
+    header.materialsCount = scene->mNumMaterials;
+    header.chunksCount = static_cast<uint32_t>(chunkRanges.size());
+    header.materialsOffset = sizeof(Header);
+    std::string materialsBlock;
+    for (unsigned int materialIdx = 0; materialIdx < scene->mNumMaterials; ++materialIdx) {
+        auto images = sImagesInfo(*scene->mMaterials[materialIdx], modelPath.parent_path());
+        sAppend(materialsBlock, MaterialRecord{static_cast<uint32_t>(images.size())});
+        for (const auto& [textureType, imagePath] : images) {
+            auto pathString = imagePath.string();
+            ImageRecord image{static_cast<uint32_t>(textureType), static_cast<uint32_t>(pathString.size())};
+            sAppend(materialsBlock, image);
+            materialsBlock.append(pathString);
+        }
+    }
+    header.chunksOffset = sAlign(header.materialsOffset + materialsBlock.size(), cBlobAlignment);
+    std::vector<ChunkRecord> chunkRecords(chunkRanges.size());
+
+    // written to a temporary file first, as mesh cache entries are
+    auto tempPath = outputPath;
+    tempPath += ".tmp";
+    std::error_code error;
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        // the header and the chunk table are written again once the pages are placed
+        std::string tableBlock;
+        sAppend(tableBlock, header);
+        tableBlock.append(materialsBlock);
+        sPad(tableBlock, cBlobAlignment);
+        tableBlock.resize(tableBlock.size() + chunkRecords.size() * sizeof(ChunkRecord), '\0');
+        sPad(tableBlock, cPageAlignment);
+        file.write(tableBlock.data(), static_cast<std::streamsize>(tableBlock.size()));
+        uint64_t offset = tableBlock.size();
+        std::optional<BoundingBox> modelBounds;
+        uint64_t geometryBytes = 0;
+        for (size_t chunkIdx = 0; chunkIdx < chunkRanges.size(); ++chunkIdx) {
+            auto [begin, end] = chunkRanges[chunkIdx];
+            auto page = sBuildPage(*scene, std::span(triangles).subspan(begin, end - begin), options);
+            sPad(page.bytes, cPageAlignment);
+            file.write(page.bytes.data(), static_cast<std::streamsize>(page.bytes.size()));
+            auto& record = chunkRecords[chunkIdx];
+            sToFloats(page.bounds.min, record.boundsMin);
+            sToFloats(page.bounds.max, record.boundsMax);
+            record.pageOffset = offset;
+            record.pageBytes = page.bytes.size();
+            record.geometryBytes = page.geometryBytes;
+            offset += page.bytes.size();
+            geometryBytes += page.geometryBytes;
+            modelBounds = modelBounds ? sUnite(*modelBounds, page.bounds) : page.bounds;
+        }
+        auto bounds = modelBounds.value_or(BoundingBox{});
+        sToFloats(bounds.min, header.boundsMin);
+        sToFloats(bounds.max, header.boundsMax);
+        file.seekp(0);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.seekp(static_cast<std::streamoff>(header.chunksOffset));
+        file.write(reinterpret_cast<const char*>(chunkRecords.data()),
+                   static_cast<std::streamsize>(chunkRecords.size() * sizeof(ChunkRecord)));
+        if (!file) {
+            std::cout << "Can't write paged model: " << tempPath << std::endl;
+            file.close();
+            fs::remove(tempPath, error);
+            return false;
+        }
+        std::cout << "Paged model written: " << outputPath << ", " << triangles.size() << " triangles in "
+                  << chunkRanges.size() << " chunks, " << geometryBytes / (1 << 20) << " MB of geometry in "
+                  << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime)
+                         .count()
+                  << " ms" << std::endl;
+    }
+    fs::rename(tempPath, outputPath, error);
+    if (error) {
+        std::cout << "Can't write paged model: " << outputPath << std::endl;
+        fs::remove(tempPath, error);
+        return false;
+    }
+    return true;
+}
+
+std::optional<PagedModelFile> PagedModelFile::open(const fs::path& path) {
+    std::error_code error;
+    auto fileSize = fs::file_size(path, error);
+    std::ifstream file(path, std::ios::binary);
+    Header header;
+    if (error || !file || fileSize < sizeof(header) ||
+        !file.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        std::cout << "Can't read paged model: " << path << std::endl;
+        return {};
+    }
+    if (std::memcmp(header.magic, cMagic, sizeof(cMagic)) != 0 || header.version != cVersion) {
+        std::cout << "Paged model is of another version, build it again: " << path << std::endl;
+        return {};
+    }
+    auto isInside = [fileSize](uint64_t offset, uint64_t count, size_t elementSize) {
+        return offset <= fileSize && count <= (fileSize - offset) / elementSize;
+    };
+    if (!isInside(header.chunksOffset, header.chunksCount, sizeof(ChunkRecord))) {
+        std::cout << "Paged model is corrupted: " << path << std::endl;
+        return {};
+    }
+
+    PagedModelFile pagedFile;
+    pagedFile.path_ = path;
+    pagedFile.bounds_ = BoundingBox{sToVec3(header.boundsMin), sToVec3(header.boundsMax)};
+    // the materials block is small, it is read at once and parsed from memory
+    auto materialsBytes = header.chunksOffset - std::min(header.materialsOffset, header.chunksOffset);
+    std::string materialsBlock(materialsBytes, '\0');
+    file.seekg(static_cast<std::streamoff>(header.materialsOffset));
+    file.read(materialsBlock.data(), static_cast<std::streamsize>(materialsBlock.size()));
+    size_t offset = 0;
+    auto readRecord = [&](auto& record) {
+        if (offset + sizeof(record) > materialsBlock.size()) {
+            return false;
+        }
+        std::memcpy(&record, materialsBlock.data() + offset, sizeof(record));
+        offset += sizeof(record);
+        return true;
+    };
+    for (uint32_t materialIdx = 0; materialIdx < header.materialsCount; ++materialIdx) {
+        MaterialRecord material;
+        if (!file || !readRecord(material)) {
+            std::cout << "Paged model is corrupted: " << path << std::endl;
+            return {};
+        }
+        auto& images = pagedFile.materials_.emplace_back();
+        for (uint32_t imageIdx = 0; imageIdx < material.imagesCount; ++imageIdx) {
+            ImageRecord image;
+            if (!readRecord(image) || offset + image.pathLength > materialsBlock.size()) {
+                std::cout << "Paged model is corrupted: " << path << std::endl;
+                return {};
+            }
+            images.emplace_back(static_cast<TextureType>(image.type),
+                                fs::path(materialsBlock.substr(offset, image.pathLength)));
+            offset += image.pathLength;
+        }
+    }
+
+    std::vector<ChunkRecord> records(header.chunksCount);
+    file.seekg(static_cast<std::streamoff>(header.chunksOffset));
+    file.read(reinterpret_cast<char*>(records.data()),
+              static_cast<std::streamsize>(records.size() * sizeof(ChunkRecord)));
+    if (!file) {
+        std::cout << "Can't read paged model: " << path << std::endl;
+        return {};
+    }
+    pagedFile.chunks_.reserve(records.size());
+    for (const auto& record : records) {
+        if (!isInside(record.pageOffset, record.pageBytes, 1)) {
+            std::cout << "Paged model is corrupted: " << path << std::endl;
+            return {};
+        }
+        auto bounds = BoundingBox{sToVec3(record.boundsMin), sToVec3(record.boundsMax)};
+        pagedFile.chunks_.push_back(
+            PagedChunk{bounds, record.pageOffset, record.pageBytes, record.geometryBytes});
+    }
+    return pagedFile;
+}
+
+const std::vector<PagedChunk>& PagedModelFile::chunks() const { return chunks_; }
+
+const std::vector<MeshImagesInfo>& PagedModelFile::materials() const { return materials_; }
+
+const BoundingBox& PagedModelFile::bounds() const { return bounds_; }
+
+std::optional<std::vector<PagedMesh>> PagedModelFile::readPage(size_t chunkIdx) const {
+    const auto& chunk = chunks_[chunkIdx];
+    std::vector<unsigned char> page(chunk.pageBytes);
+    std::ifstream file(path_, std::ios::binary);
+    file.seekg(static_cast<std::streamoff>(chunk.pageOffset));
+    if (!file.read(reinterpret_cast<char*>(page.data()), static_cast<std::streamsize>(page.size()))) {
+        std::cout << "Can't read page " << chunkIdx << " of paged model: " << path_ << std::endl;
+        return {};
+    }
+
+    // every range is validated, a corrupted page is treated as unreadable
+    uint64_t offset = 0;
+    auto take = [&](uint64_t size, uint64_t alignment) -> const unsigned char* {
+        offset = sAlign(offset, alignment);
+        if (offset > page.size() || size > page.size() - offset) {
+            return nullptr;
+        }
+        auto* data = page.data() + offset;
+        offset += size;
+        return data;
+    };
+    PageRecord pageRecord;
+    const auto* pageRecordData = take(sizeof(pageRecord), 1);
+    if (!pageRecordData) {
+        std::cout << "Page " << chunkIdx << " of paged model is corrupted: " << path_ << std::endl;
+        return {};
+    }
+    std::memcpy(&pageRecord, pageRecordData, sizeof(pageRecord));
+    std::vector<PagedMesh> meshes;
+    meshes.reserve(pageRecord.meshesCount);
+    for (uint32_t meshIdx = 0; meshIdx < pageRecord.meshesCount; ++meshIdx) {
+        PageMeshRecord record;
+        const auto* recordData = take(sizeof(record), cBlobAlignment);
+        if (recordData) {
+            std::memcpy(&record, recordData, sizeof(record));
+        }
+        const auto* vertexData = recordData ? take(record.vertexBytes, cBlobAlignment) : nullptr;
+        const auto* indexData = vertexData ? take(record.indexBytes, cBlobAlignment) : nullptr;
+        auto indexSize = record.hasShortIndices ? sizeof(uint16_t) : sizeof(uint32_t);
+        if (!indexData || record.material >= materials_.size() ||
+            record.vertexFormat > static_cast<uint32_t>(VertexFormat::Compact) || record.lodsCount == 0 ||
+            record.lodsCount > cMaxMeshLods || record.indicesCount * indexSize != record.indexBytes) {
+            std::cout << "Page " << chunkIdx << " of paged model is corrupted: " << path_ << std::endl;
+            return {};
+        }
+        auto& mesh = meshes.emplace_back();
+        mesh.material = record.material;
+        auto& geometry = mesh.geometry;
+        geometry.vertexFormat = static_cast<VertexFormat>(record.vertexFormat);
+        geometry.vertexData.assign(vertexData, vertexData + record.vertexBytes);
+        geometry.indexData.assign(indexData, indexData + record.indexBytes);
+        geometry.indicesCount = static_cast<size_t>(record.indicesCount);
+        geometry.hasShortIndices = record.hasShortIndices != 0;
+        geometry.positionOffset = sToVec3(record.positionOffset);
+        geometry.positionScale = sToVec3(record.positionScale);
+        geometry.bounds = BoundingBox{sToVec3(record.boundsMin), sToVec3(record.boundsMax)};
+        for (uint32_t lodIdx = 0; lodIdx < record.lodsCount; ++lodIdx) {
+            const auto& lod = record.lods[lodIdx];
+            if (lod.firstIndex > record.indicesCount ||
+                lod.indicesCount > record.indicesCount - lod.firstIndex) {
+                std::cout << "Page " << chunkIdx << " of paged model is corrupted: " << path_ << std::endl;
+                return {};
+            }
+            geometry.lods.push_back(MeshLod{static_cast<size_t>(lod.firstIndex),
+                                            static_cast<size_t>(lod.indicesCount), lod.error});
+        }
+    }
+    return meshes;
+}
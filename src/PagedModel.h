@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+#include "Mesh.h"
+#include "MeshCache.h"
+
+struct PagedModelBuildOptions {
+    // a chunk is split in halves along its longest axis while it has more triangles
+    size_t maxChunkTriangles = 1 << 16;
+    // see ModelLoadOptions
+    bool optimizeMeshes = true;
+    bool generateLods = true;
+    bool compactVertices = true;
+};
+
+struct PagedChunk {
+    // in model coordinates, node transforms are baked into the vertices
+    BoundingBox bounds;
+    uint64_t pageOffset = 0;
+    uint64_t pageBytes = 0;
+    // vertex and index data of the meshes of the chunk, as much as they take in the arena
+    uint64_t geometryBytes = 0;
+};
+
+// part of a chunk sharing one material of the file, compact positions are quantized to the chunk bounds
+struct PagedMesh {
+    uint32_t material = 0;
+    MeshGeometry geometry;
+};
+
+// imports the model, splits its triangles into spatial chunks and writes every chunk as a page of its own,
+// aligned so that it is read with one request. Runs offline, the model has to fit in memory once here
+bool buildPagedModel(const std::filesystem::path& modelPath, const std::filesystem::path& outputPath,
+                     const PagedModelBuildOptions& options = {});
+
+// a file written by buildPagedModel. The chunk table and the materials are read on open, pages on demand,
+// see StreamingModel
+class PagedModelFile {
+   public:
+    static std::optional<PagedModelFile> open(const std::filesystem::path& path);
+
+    const std::vector<PagedChunk>& chunks() const;
+    // images of every material, meshes of pages index them
+    const std::vector<MeshImagesInfo>& materials() const;
+    const BoundingBox& bounds() const;
+    // the geometry of the chunk as it goes to GPU, empty if the page can't be read. Opens the file for every
+    // call, so pages can be read by several workers at once
+    std::optional<std::vector<PagedMesh>> readPage(size_t chunkIdx) const;
+
+   private:
+    std::filesystem::path path_;
+    std::vector<PagedChunk> chunks_;
+    std::vector<MeshImagesInfo> materials_;
+    BoundingBox bounds_;
+};
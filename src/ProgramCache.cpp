@@ -0,0 +1,161 @@
+#include "ProgramCache.h"
+#include "Utils.h"
+#include <glad/glad.h>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+constexpr char cMagic[4] = {'N', 'A', 'P', 'B'};
+constexpr uint32_t cVersion{1};
+
+struct Header {
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    // binary format reported by the driver
+    uint32_t format;
+    uint32_t size;
+};
+static_assert(sizeof(Header) == 24);
+
+std::string sGetString(GLenum name) {
+    auto* value = reinterpret_cast<const char*>(glGetString(name));
+    return value ? value : "";
+}
+}  // namespace
+
+fs::path ProgramCache::defaultDirectory() {
+    std::error_code error;
+    auto tempDirectory = fs::temp_directory_path(error);
+    return (error ? fs::path(".") : tempDirectory) / "NACad" / "programcache";
+}
+
+ProgramCache::ProgramCache(fs::path directory) : directory_{std::move(directory)} {
+    int formatsCount = 0;
+    if (GLAD_GL_VERSION_4_1 || GLAD_GL_ARB_get_program_binary) {
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatsCount);
+    }
+    isSupported_ = formatsCount > 0;
+    driverHash_ = Utils::cHashSeed;
+    for (auto name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+        // with the terminating zero, so that the strings don't run into each other
+        auto value = sGetString(name);
+        driverHash_ = Utils::hashBytes(value.c_str(), value.size() + 1, driverHash_);
+    }
+}
+
+bool ProgramCache::isSupported() const { return isSupported_; }
+
+uint64_t ProgramCache::key(std::string_view vShaderSrc, std::string_view sShaderSrc) const {
+    auto hash = Utils::hashBytes(vShaderSrc.data(), vShaderSrc.size(), driverHash_);
+    // the length keeps a text moved from one shader to the other from giving the same key
+    auto vShaderSize = static_cast<uint64_t>(vShaderSrc.size());
+    hash = Utils::hashBytes(&vShaderSize, sizeof(vShaderSize), hash);
+    return Utils::hashBytes(sShaderSrc.data(), sShaderSrc.size(), hash);
+}
+
+std::optional<unsigned int> ProgramCache::load(uint64_t key) {
+    if (!isSupported_) {
+        return {};
+    }
+    auto entryPath = entryPath_(key);
+    std::ifstream file(entryPath, std::ios::binary);
+    if (!file) {
+        ++stats_.missesCount;
+        return {};
+    }
+    // the size is checked before it is trusted, a truncated entry is treated as missing
+    std::error_code error;
+    auto fileSize = fs::file_size(entryPath, error);
+    Header header{};
+    std::vector<char> binary;
+    auto isRead = !error && fileSize >= sizeof(header) &&
+                  file.read(reinterpret_cast<char*>(&header), sizeof(header)) &&
+                  header.size == fileSize - sizeof(header);
+    if (isRead) {
+        binary.resize(header.size);
+        isRead = static_cast<bool>(file.read(binary.data(), static_cast<std::streamsize>(binary.size())));
+    }
+    if (!isRead || std::memcmp(header.magic, cMagic, sizeof(cMagic)) != 0 || header.version != cVersion ||
+        header.key != key) {
+        std::cout << "Program cache entry is corrupted: " << entryPath << std::endl;
+        ++stats_.missesCount;
+        return {};
+    }
+
+    auto programId = glCreateProgram();
+    glProgramBinary(programId, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+    int linkSuccess{0};
+    glGetProgramiv(programId, GL_LINK_STATUS, &linkSuccess);
+    if (!linkSuccess) {
+        // e.g. a driver update that kept the version string, the entry is written again after compiling
+        std::cout << "Program cache entry is rejected by the driver: " << entryPath << std::endl;
+        glDeleteProgram(programId);
+        fs::remove(entryPath, error);
+        ++stats_.rejectedCount;
+        return {};
+    }
+    ++stats_.hitsCount;
+    return programId;
+}
+
+bool ProgramCache::store(uint64_t key, unsigned int programId) const {
+    if (!isSupported_) {
+        return false;
+    }
+    int binaryLength = 0;
+    glGetProgramiv(programId, GL_PROGRAM_BINARY_LENGTH, &binaryLength);
+    if (binaryLength <= 0) {
+        return false;
+    }
+    std::vector<char> binary(static_cast<size_t>(binaryLength));
+    GLenum format = 0;
+    GLsizei writtenLength = 0;
+    glGetProgramBinary(programId, binaryLength, &writtenLength, &format, binary.data());
+    binary.resize(static_cast<size_t>(writtenLength));
+
+    std::error_code error;
+    fs::create_directories(directory_, error);
+    auto entryPath = entryPath_(key);
+    // another instance may write the same entry, readers only ever see a complete file
+    auto tempPath = entryPath;
+    tempPath += ".tmp";
+    Header header{.magic = {},
+                  .version = cVersion,
+                  .key = key,
+                  .format = static_cast<uint32_t>(format),
+                  .size = static_cast<uint32_t>(binary.size())};
+    std::memcpy(header.magic, cMagic, sizeof(cMagic));
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(binary.data(), static_cast<std::streamsize>(binary.size()));
+        if (!file) {
+            std::cout << "Can't write program cache entry: " << tempPath << std::endl;
+            file.close();
+            fs::remove(tempPath, error);
+            return false;
+        }
+    }
+    fs::rename(tempPath, entryPath, error);
+    if (error) {
+        fs::remove(tempPath, error);
+        return false;
+    }
+    return true;
+}
+
+const ProgramCache::Stats& ProgramCache::stats() const { return stats_; }
+
+fs::path ProgramCache::entryPath_(uint64_t key) const {
+    std::stringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << key << ".programbin";
+    return directory_ / name.str();
+}
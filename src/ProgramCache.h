@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string_view>
+
+// on-disk cache of linked programs saved with glGetProgramBinary and restored with glProgramBinary. Entries
+// are keyed by the shader sources with their defines and by the vendor, renderer and version strings of the
+// driver. A binary the driver rejects anyway is dropped and the program is compiled from source again.
+// needs the GL context, without GL 4.1 or ARB_get_program_binary the cache stays empty
+class ProgramCache {
+   public:
+    // counters since the cache was created
+    struct Stats {
+        size_t hitsCount = 0;
+        size_t missesCount = 0;
+        size_t rejectedCount = 0;
+    };
+
+    static std::filesystem::path defaultDirectory();
+
+    explicit ProgramCache(std::filesystem::path directory = defaultDirectory());
+
+    bool isSupported() const;
+    uint64_t key(std::string_view vShaderSrc, std::string_view sShaderSrc) const;
+    // a linked program, empty if there is no entry or the driver rejects it
+    std::optional<unsigned int> load(uint64_t key);
+    // the program should be linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+    bool store(uint64_t key, unsigned int programId) const;
+    const Stats& stats() const;
+
+   private:
+    std::filesystem::path directory_;
+    bool isSupported_{false};
+    // of the vendor, renderer and version strings, the start of every key
+    uint64_t driverHash_{0};
+    Stats stats_;
+
+    std::filesystem::path entryPath_(uint64_t key) const;
+};
@@ -0,0 +1,270 @@
+#include "RenderQueue.h"
+#include "GeometryArena.h"
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <utility>
+
+namespace {
+// key fields from the most to the least significant. A program switch is the most expensive, then the
+// buffers of a material table and the texture arrays of a set of it, then the VAO. The material index goes
+// last since every draw sets its uniforms anyway. Fields are truncated, equal keys only make the grouping
+// worse
+constexpr int cProgramShift{52};
+constexpr int cMaterialTableShift{44};
+constexpr int cArraySetShift{36};
+constexpr int cVertexArrayShift{20};
+constexpr uint64_t cProgramMask{(1u << 12) - 1};
+constexpr uint64_t cMaterialTableMask{(1u << 8) - 1};
+constexpr uint64_t cArraySetMask{(1u << 8) - 1};
+constexpr uint64_t cVertexArrayMask{(1u << 16) - 1};
+constexpr uint64_t cMaterialMask{(1u << 20) - 1};
+
+uint64_t sPackKey(unsigned int program, size_t materialTable, ArraySetIndex arraySet,
+                  unsigned int vertexArray, MaterialIndex material) {
+    // materials without textures go first, they are drawn with whatever set is bound
+    auto arraySetField = static_cast<uint64_t>(arraySet - cAnyArraySet);
+    return (program & cProgramMask) << cProgramShift |
+           (materialTable & cMaterialTableMask) << cMaterialTableShift |
+           (arraySetField & cArraySetMask) << cArraySetShift |
+           (vertexArray & cVertexArrayMask) << cVertexArrayShift |
+           (static_cast<uint64_t>(material) & cMaterialMask);
+}
+}  // namespace
+
+RenderQueue::RenderQueue() { glGenQueries(2, samplesQueries_); }
+
+RenderQueue::~RenderQueue() { glDeleteQueries(2, samplesQueries_); }
+
+void RenderQueue::setFrustum(const Frustum& frustum) { frustum_ = frustum; }
+
+bool RenderQueue::isVisible(const Mesh& mesh) {
+    // the sphere test rejects most invisible meshes, the box one the rest of them near the frustum corners
+    bool isVisible = frustum_.isVisible(mesh.worldSphere()) && frustum_.isVisible(mesh.worldBounds());
+    if (!isVisible) {
+        ++culledMeshesCount_;
+        return false;
+    }
+    if (occlusionCuller_ && !occlusionCuller_->testMesh(mesh)) {
+        ++occludedMeshesCount_;
+        return false;
+    }
+    ++visibleMeshesCount_;
+    return true;
+}
+
+void RenderQueue::setOcclusionCuller(OcclusionCuller* culler) {
+    if (culler && culler != occlusionCuller_) {
+        // results from before the culling was off may be stale
+        culler->clear();
+    }
+    occlusionCuller_ = culler;
+}
+
+void RenderQueue::setLodSelection(const LodSelection& selection) { lodSelection_ = selection; }
+
+size_t RenderQueue::selectLod(const Mesh& mesh) {
+    if (!lodSelection_) {
+        return 0;
+    }
+    // the nearest point of the bounding sphere gives the largest projection of the error
+    const auto& sphere = mesh.worldSphere();
+    auto distance = glm::length(sphere.center - lodSelection_->viewPosition) - sphere.radius;
+    if (distance <= 0.0f) {
+        return 0;
+    }
+    auto maxWorldError = lodSelection_->maxScreenError * distance / lodSelection_->pixelsPerUnit;
+    // errors grow with the level
+    size_t lod = 0;
+    while (lod + 1 < mesh.lodsCount() && mesh.worldLodError(lod + 1) <= maxWorldError) {
+        ++lod;
+    }
+    if (lod > 0) {
+        ++simplifiedMeshesCount_;
+    }
+    return lod;
+}
+
+void RenderQueue::setDepthPrepass(ShaderProgram* depthShader) { depthShader_ = depthShader; }
+
+void RenderQueue::setOverdrawView(ShaderProgram* overdrawShader) { overdrawShader_ = overdrawShader; }
+
+void RenderQueue::submit(ShaderProgram& shader, MaterialTable& materials, const Mesh& mesh) {
+    if (mesh.isUploaded() && isVisible(mesh)) {
+        ranges_.push_back(mesh.drawRange(selectLod(mesh)));
+        push_(shader, materials, mesh, nullptr, mesh.vertexArray(), ranges_.size() - 1, 1);
+    }
+}
+
+void RenderQueue::submit(ShaderProgram& shader, MaterialTable& materials, const Mesh& uniformsMesh,
+                         std::span<const GeometryDrawRange> ranges) {
+    auto& arena = uniformsMesh.geometryArena();
+    // ranges are usually of one vertex array, they are split only when index sizes differ
+    auto remaining = ranges_.size();
+    ranges_.insert(ranges_.end(), ranges.begin(), ranges.end());
+    while (remaining < ranges_.size()) {
+        auto vertexArray = arena.vertexArray(ranges_[remaining].allocation);
+        auto sameArrayEnd = std::stable_partition(
+            ranges_.begin() + static_cast<std::ptrdiff_t>(remaining), ranges_.end(),
+            [&](const GeometryDrawRange& range) {
+                return arena.vertexArray(range.allocation) == vertexArray;
+            });
+        auto end = static_cast<size_t>(sameArrayEnd - ranges_.begin());
+        push_(shader, materials, uniformsMesh, nullptr, vertexArray, remaining, end - remaining);
+        remaining = end;
+    }
+}
+
+void RenderQueue::submitInstanced(ShaderProgram& shader, MaterialTable& materials, const Mesh& mesh,
+                                  InstanceBuffer& instances) {
+    if (mesh.isUploaded() && instances.size() > 0) {
+        push_(shader, materials, mesh, &instances, mesh.vertexArray(), 0, 0);
+    }
+}
+
+void RenderQueue::push_(ShaderProgram& shader, MaterialTable& materials, const Mesh& mesh,
+                        InstanceBuffer* instances, unsigned int vertexArray, size_t firstRange,
+                        size_t rangesCount) {
+    auto tableIt = std::ranges::find(materialTables_, &materials);
+    if (tableIt == materialTables_.end()) {
+        tableIt = materialTables_.insert(materialTables_.end(), &materials);
+    }
+    auto tableRank = static_cast<size_t>(tableIt - materialTables_.begin());
+    // instances are expected to use materials with the textures of the mesh one, which share its set
+    auto arraySet = materials.arraySet(mesh.material());
+    commands_.push_back(Command{.key = sPackKey(shader.programId(), tableRank, arraySet, vertexArray,
+                                                mesh.material()),
+                                .shader = &shader,
+                                .materials = &materials,
+                                .arraySet = arraySet,
+                                .mesh = &mesh,
+                                .instances = instances,
+                                .vertexArray = vertexArray,
+                                .firstRange = firstRange,
+                                .rangesCount = rangesCount});
+}
+
+void RenderQueue::flush() {
+    std::ranges::stable_sort(commands_, {}, &Command::key);
+    stats_ = Stats{};
+    stats_.drawsCount = commands_.size();
+    stats_.visibleMeshesCount = std::exchange(visibleMeshesCount_, 0);
+    stats_.culledMeshesCount = std::exchange(culledMeshesCount_, 0);
+    stats_.occludedMeshesCount = std::exchange(occludedMeshesCount_, 0);
+    stats_.simplifiedMeshesCount = std::exchange(simplifiedMeshesCount_, 0);
+    if (depthShader_ && !commands_.empty()) {
+        // the depth program samples no materials
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        drawCommands_(depthShader_, false, false);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        stats_.prepassDrawCallsCount = commands_.size();
+        glDepthFunc(GL_EQUAL);
+        glDepthMask(GL_FALSE);
+    }
+    if (overdrawShader_) {
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+    }
+    auto slot = flushesCount_++ % 2;
+    if (isSamplesQueryPending_[slot]) {
+        // a result that is still not there is dropped rather than waited for
+        readSamplesQuery_(slot);
+        isSamplesQueryPending_[slot] = false;
+    }
+    glBeginQuery(GL_SAMPLES_PASSED, samplesQueries_[slot]);
+    drawCommands_(overdrawShader_, true, true);
+    glEndQuery(GL_SAMPLES_PASSED);
+    isSamplesQueryPending_[slot] = true;
+    if (isSamplesQueryPending_[1 - slot]) {
+        readSamplesQuery_(1 - slot);
+    }
+    stats_.shadedSamplesCount = shadedSamplesCount_;
+
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
+    glDisable(GL_BLEND);
+    if (occlusionCuller_) {
+        // the depth of the frame is complete, the boxes are tested against it for the next frames
+        occlusionCuller_->issueTests();
+    }
+    stats_.skippedBindsCount = 4 * commands_.size() - stats_.programBindsCount -
+                               stats_.materialTableBindsCount - stats_.arraySetBindsCount -
+                               stats_.vertexArrayBindsCount;
+    commands_.clear();
+    ranges_.clear();
+    materialTables_.clear();
+}
+
+void RenderQueue::drawCommands_(ShaderProgram* shader, bool bindMaterials, bool isCounted) {
+    const ShaderProgram* currentShader = nullptr;
+    const MaterialTable* currentMaterials = nullptr;
+    // nothing is bound at the start and after a table change
+    ArraySetIndex currentArraySet = cAnyArraySet;
+    // 0 is never the VAO of an arena pool
+    unsigned int currentVertexArray = 0;
+    Stats passStats;
+    for (const auto& command : commands_) {
+        auto& commandShader = shader ? *shader : *command.shader;
+        if (&commandShader != currentShader) {
+            commandShader.use();
+            currentShader = &commandShader;
+            ++passStats.programBindsCount;
+        }
+        if (bindMaterials && command.materials != currentMaterials) {
+            command.materials->bind();
+            currentMaterials = command.materials;
+            currentArraySet = cAnyArraySet;
+            ++passStats.materialTableBindsCount;
+        }
+        if (bindMaterials && command.arraySet != cAnyArraySet && command.arraySet != currentArraySet) {
+            command.materials->bindArraySet(command.arraySet);
+            currentArraySet = command.arraySet;
+            ++passStats.arraySetBindsCount;
+        }
+        if (command.vertexArray != currentVertexArray) {
+            glBindVertexArray(command.vertexArray);
+            currentVertexArray = command.vertexArray;
+            ++passStats.vertexArrayBindsCount;
+        }
+        command.mesh->setUniforms(commandShader, command.instances != nullptr);
+        auto& arena = command.mesh->geometryArena();
+        auto ranges = std::span(ranges_).subspan(command.firstRange, command.rangesCount);
+        if (command.instances) {
+            auto range = command.mesh->drawRange();
+            arena.drawInstancedBound(range, *command.instances);
+            passStats.trianglesCount += range.indicesCount / 3 * command.instances->size();
+        } else if (ranges.size() == 1) {
+            arena.drawBound(ranges.front());
+        } else {
+            arena.multiDrawBound(ranges);
+        }
+        for (const auto& range : ranges) {
+            passStats.trianglesCount += range.indicesCount / 3;
+        }
+        ++passStats.drawCallsCount;
+    }
+    if (currentVertexArray != 0) {
+        glBindVertexArray(0);
+    }
+    if (isCounted) {
+        stats_.drawCallsCount = passStats.drawCallsCount;
+        stats_.programBindsCount = passStats.programBindsCount;
+        stats_.materialTableBindsCount = passStats.materialTableBindsCount;
+        stats_.arraySetBindsCount = passStats.arraySetBindsCount;
+        stats_.vertexArrayBindsCount = passStats.vertexArrayBindsCount;
+        stats_.trianglesCount = passStats.trianglesCount;
+    }
+}
+
+void RenderQueue::readSamplesQuery_(size_t slot) {
+    int isAvailable = 0;
+    glGetQueryObjectiv(samplesQueries_[slot], GL_QUERY_RESULT_AVAILABLE, &isAvailable);
+    if (isAvailable) {
+        GLuint64 samplesCount = 0;
+        glGetQueryObjectui64v(samplesQueries_[slot], GL_QUERY_RESULT, &samplesCount);
+        shadedSamplesCount_ = static_cast<size_t>(samplesCount);
+        isSamplesQueryPending_[slot] = false;
+    }
+}
+
+const RenderQueue::Stats& RenderQueue::stats() const { return stats_; }
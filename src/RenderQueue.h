@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Frustum.h"
+#include "InstanceBuffer.h"
+#include "MaterialTable.h"
+#include "Mesh.h"
+#include "OcclusionCuller.h"
+#include "ShaderProgram.h"
+
+// draws of a frame are submitted here and issued together by flush, sorted by a key packed from program,
+// material table, texture array set, vertex array and material index. Binds of a program, a material
+// table, an array set or a VAO that is already current are skipped. Meshes outside the frustum are not
+// submitted, the others are drawn at the coarsest level of detail whose error stays under the screen-space
+// threshold. With a depth pre-pass every pixel is shaded once, with an occlusion culler meshes hidden behind
+// others are left out as well
+class RenderQueue {
+   public:
+    struct LodSelection {
+        glm::vec3 viewPosition{0.0f};
+        // pixels covered by a unit at a unit distance, viewport height / (2 * tan(vertical fov / 2))
+        float pixelsPerUnit = 1.0f;
+        // simplified levels are drawn while their error projects to at most this many pixels
+        float maxScreenError = 1.0f;
+    };
+
+    // counters of the last flush
+    struct Stats {
+        size_t drawsCount = 0;
+        // multi-draws count once
+        size_t drawCallsCount = 0;
+        size_t programBindsCount = 0;
+        size_t materialTableBindsCount = 0;
+        size_t arraySetBindsCount = 0;
+        size_t vertexArrayBindsCount = 0;
+        // binds an unsorted submission binding everything for every draw would have done on top
+        size_t skippedBindsCount = 0;
+        // meshes tested against the frustum, instanced draws are not culled
+        size_t visibleMeshesCount = 0;
+        size_t culledMeshesCount = 0;
+        // meshes inside the frustum left out by the occlusion culler, not included in visibleMeshesCount
+        size_t occludedMeshesCount = 0;
+        // meshes drawn at one of their simplified levels
+        size_t simplifiedMeshesCount = 0;
+        size_t trianglesCount = 0;
+        // draw calls of the depth pre-pass, not included in the counters above
+        size_t prepassDrawCallsCount = 0;
+        // samples passing the depth test in the shading pass of the flush before the last one, read without
+        // waiting for the GPU. Divided by the viewport pixels it gives the overdraw
+        size_t shadedSamplesCount = 0;
+    };
+
+    RenderQueue();
+    ~RenderQueue();
+    RenderQueue(const RenderQueue&) = delete;
+    RenderQueue& operator=(const RenderQueue&) = delete;
+
+    // frustum of the next flush, everything is visible by default
+    void setFrustum(const Frustum& frustum);
+    // tests the world bounds of the mesh and counts it as visible, culled or occluded
+    bool isVisible(const Mesh& mesh);
+    // meshes inside the frustum are also tested by the culler, whose boxes are drawn at the end of flush.
+    // nullptr turns the occlusion culling off
+    void setOcclusionCuller(OcclusionCuller* culler);
+    // view of the next flush, meshes are drawn in full until it is set
+    void setLodSelection(const LodSelection& selection);
+    // coarsest level of the mesh whose error projects to at most maxScreenError pixels, counts simplified
+    // meshes
+    size_t selectLod(const Mesh& mesh);
+
+    // with a program the draws are first drawn depth only with it, then shaded with GL_EQUAL and without
+    // depth writes, so expensive fragments are shaded only where they are visible. The program should only
+    // write depth and use shader.vs, whose gl_Position is invariant. nullptr turns the pre-pass off
+    void setDepthPrepass(ShaderProgram* depthShader);
+    // the shading pass draws with this program and additive blending instead of the programs of the draws, so
+    // the image shows how many times each pixel is shaded. nullptr draws normally
+    void setOverdrawView(ShaderProgram* overdrawShader);
+
+    // the program, the table, the mesh and the instances must stay alive until flush. Instanced meshes are
+    // drawn in full, the textured materials of their instances should use the texture arrays of the mesh
+    // material
+    void submit(ShaderProgram& shader, MaterialTable& materials, const Mesh& mesh);
+    // one multi-draw per vertex array of the ranges, with the uniforms of uniformsMesh
+    void submit(ShaderProgram& shader, MaterialTable& materials, const Mesh& uniformsMesh,
+                std::span<const GeometryDrawRange> ranges);
+    void submitInstanced(ShaderProgram& shader, MaterialTable& materials, const Mesh& mesh,
+                         InstanceBuffer& instances);
+    // issues the submitted draws and empties the queue. GL state changed outside the queue is not tracked,
+    // so every flush starts with nothing bound. Depth test is expected to be on, the depth function is left
+    // GL_LESS
+    void flush();
+    const Stats& stats() const;
+
+   private:
+    struct Command {
+        uint64_t key;
+        ShaderProgram* shader;
+        MaterialTable* materials;
+        ArraySetIndex arraySet;
+        const Mesh* mesh;
+        InstanceBuffer* instances;
+        unsigned int vertexArray;
+        // range in ranges_, empty for instanced draws
+        size_t firstRange;
+        size_t rangesCount;
+    };
+
+    std::vector<Command> commands_;
+    std::vector<GeometryDrawRange> ranges_;
+    // material tables of the submitted commands in submission order, their positions are used in the keys
+    std::vector<const MaterialTable*> materialTables_;
+    ShaderProgram* depthShader_{nullptr};
+    ShaderProgram* overdrawShader_{nullptr};
+    OcclusionCuller* occlusionCuller_{nullptr};
+    // GL_SAMPLES_PASSED queries of the shading pass, one is read while the other one is in flight
+    unsigned int samplesQueries_[2];
+    bool isSamplesQueryPending_[2]{false, false};
+    size_t flushesCount_{0};
+    size_t shadedSamplesCount_{0};
+    Frustum frustum_;
+    std::optional<LodSelection> lodSelection_;
+    size_t visibleMeshesCount_{0};
+    size_t culledMeshesCount_{0};
+    size_t occludedMeshesCount_{0};
+    size_t simplifiedMeshesCount_{0};
+    Stats stats_;
+
+    void push_(ShaderProgram& shader, MaterialTable& materials, const Mesh& mesh, InstanceBuffer* instances,
+               unsigned int vertexArray, size_t firstRange, size_t rangesCount);
+    // issues the sorted commands with their own programs or with shader. Binds and triangles are counted in
+    // stats_ if isCounted
+    void drawCommands_(ShaderProgram* shader, bool bindMaterials, bool isCounted);
+    // takes the result of the query of the slot if it is ready
+    void readSamplesQuery_(size_t slot);
+};
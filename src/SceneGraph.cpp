@@ -0,0 +1,61 @@
+#include "SceneGraph.h"
+
+#include <algorithm>
+#include <cassert>
+#include <utility>
+
+SceneNodeIndex SceneGraph::addNode(SceneNodeIndex parent, const glm::mat4& localTr, std::string name) {
+    auto node = static_cast<SceneNodeIndex>(parents_.size());
+    // the subtree of the parent must still be open, otherwise the new node would break the depth-first order
+    assert(parent == cNoParent || subtreeEnds_[parent] == node);
+    parents_.push_back(parent);
+    subtreeEnds_.push_back(node + 1);
+    localTrs_.push_back(localTr);
+    worldTrs_.push_back(localTr);
+    names_.push_back(std::move(name));
+    for (auto ancestor = parent; ancestor != cNoParent; ancestor = parents_[ancestor]) {
+        subtreeEnds_[ancestor] = node + 1;
+    }
+    changedNodes_.push_back(node);
+    return node;
+}
+
+size_t SceneGraph::size() const { return parents_.size(); }
+
+SceneNodeIndex SceneGraph::parent(SceneNodeIndex node) const { return parents_[node]; }
+
+SceneNodeIndex SceneGraph::subtreeEnd(SceneNodeIndex node) const { return subtreeEnds_[node]; }
+
+const std::string& SceneGraph::name(SceneNodeIndex node) const { return names_[node]; }
+
+const glm::mat4& SceneGraph::localTr(SceneNodeIndex node) const { return localTrs_[node]; }
+
+const glm::mat4& SceneGraph::worldTr(SceneNodeIndex node) const { return worldTrs_[node]; }
+
+void SceneGraph::setLocalTr(SceneNodeIndex node, const glm::mat4& tr) {
+    localTrs_[node] = tr;
+    changedNodes_.push_back(node);
+}
+
+bool SceneGraph::hasChanges() const { return !changedNodes_.empty(); }
+
+void SceneGraph::updateWorldTrs(const std::function<void(SceneNodeIndex)>& onUpdated) {
+    // in depth-first order a changed ancestor is updated first together with its whole subtree, so changed
+    // nodes inside it are skipped, and the parent of a subtree root is always up to date
+    std::ranges::sort(changedNodes_);
+    SceneNodeIndex updatedEnd = 0;
+    for (auto changedNode : changedNodes_) {
+        if (changedNode < updatedEnd) {
+            continue;
+        }
+        updatedEnd = subtreeEnds_[changedNode];
+        for (auto node = changedNode; node < updatedEnd; ++node) {
+            auto parent = parents_[node];
+            worldTrs_[node] = parent == cNoParent ? localTrs_[node] : worldTrs_[parent] * localTrs_[node];
+            if (onUpdated) {
+                onUpdated(node);
+            }
+        }
+    }
+    changedNodes_.clear();
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+using SceneNodeIndex = int;
+
+// node hierarchy of a model with local and world transforms. Nodes are kept in depth-first order in flat
+// arrays, so the subtree of a node is the range [node, subtreeEnd(node)) and a parent always comes before its
+// children. Only the subtrees of nodes whose local transform changed are updated
+class SceneGraph {
+   public:
+    static constexpr SceneNodeIndex cNoParent{-1};
+
+    // nodes are added in depth-first order, parent is cNoParent, the last added node or one of its ancestors
+    SceneNodeIndex addNode(SceneNodeIndex parent, const glm::mat4& localTr, std::string name = {});
+    size_t size() const;
+    SceneNodeIndex parent(SceneNodeIndex node) const;
+    SceneNodeIndex subtreeEnd(SceneNodeIndex node) const;
+    const std::string& name(SceneNodeIndex node) const;
+    const glm::mat4& localTr(SceneNodeIndex node) const;
+    // as of the last updateWorldTrs
+    const glm::mat4& worldTr(SceneNodeIndex node) const;
+
+    void setLocalTr(SceneNodeIndex node, const glm::mat4& tr);
+    bool hasChanges() const;
+    // recomputes world transforms of the changed subtrees, onUpdated gets every updated node in depth-first
+    // order
+    void updateWorldTrs(const std::function<void(SceneNodeIndex)>& onUpdated = {});
+
+   private:
+    std::vector<SceneNodeIndex> parents_;
+    std::vector<SceneNodeIndex> subtreeEnds_;
+    std::vector<glm::mat4> localTrs_;
+    std::vector<glm::mat4> worldTrs_;
+    std::vector<std::string> names_;
+    // nodes changed since the last update, possibly repeated or inside each other's subtrees
+    std::vector<SceneNodeIndex> changedNodes_;
+};
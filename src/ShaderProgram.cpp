@@ -1,4 +1,5 @@
 #include "ShaderProgram.h"
+#include "ProgramCache.h"
 
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
@@ -10,6 +11,8 @@
 #include <fstream>
 #include <iostream>
 #include <vector>
+#include <algorithm>
+#include <array>
 
 namespace {
 std::string sGetFileContent(const std::filesystem::path& filePath) {
@@ -21,6 +24,27 @@ std::string sGetFileContent(const std::filesystem::path& filePath) {
     // }
     return buffer.str();
 }
+// #version has to stay the first line, the defines go right after it
+std::string sInsertDefines(const std::string& shaderSrc, std::span<const std::string> defines) {
+    if (defines.empty() || shaderSrc.empty()) {
+        return shaderSrc;
+    }
+    auto versionEnd = shaderSrc.find('\n');
+    if (versionEnd == std::string::npos) {
+        versionEnd = shaderSrc.size();
+    }
+    auto result = shaderSrc.substr(0, versionEnd) + "\n";
+    for (const auto& define : defines) {
+        result += "#define " + define + "\n";
+    }
+    // compile errors keep pointing to the lines of the file
+    result += "#line 2\n";
+    if (versionEnd < shaderSrc.size()) {
+        result += shaderSrc.substr(versionEnd + 1);
+    }
+    return result;
+}
+
 std::optional<unsigned int> sCreateAndCompileShader(const std::string& shaderSrc, bool isVertexShader) {
     if (shaderSrc.empty()) {
         std::string shaderType = isVertexShader ? "Vertex" : "Fragment";
@@ -51,10 +75,15 @@ void sCleanUpShaders(const std::vector<unsigned int>& shadersIds) {
     }
 }
 
-std::optional<unsigned int> sCreateAndLinkProgram(unsigned int vShaderId, unsigned int sShaderId) {
+std::optional<unsigned int> sCreateAndLinkProgram(unsigned int vShaderId, unsigned int sShaderId,
+                                                  bool isRetrievable) {
     auto programId = glCreateProgram();
     glAttachShader(programId, vShaderId);
     glAttachShader(programId, sShaderId);
+    // lets the driver keep the binary for glGetProgramBinary, see ProgramCache
+    if (isRetrievable) {
+        glProgramParameteri(programId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
     glLinkProgram(programId);
 
     int linkSuccess{-1};
@@ -70,7 +99,9 @@ std::optional<unsigned int> sCreateAndLinkProgram(unsigned int vShaderId, unsign
 }  // namespace
 
 std::optional<ShaderProgram> ShaderProgram::createShaderProgram(const std::filesystem::path& vShaderPath,
-                                                                const std::filesystem::path& sShaderPath) {
+                                                                const std::filesystem::path& sShaderPath,
+                                                                std::span<const std::string> defines,
+                                                                ProgramCache* cache) {
     namespace fs = std::filesystem;
     if (!fs::exists(vShaderPath) || fs::is_directory(vShaderPath)) {
         std::cout << "Can't find shader file: " << vShaderPath << std::endl;
@@ -80,8 +111,15 @@ std::optional<ShaderProgram> ShaderProgram::createShaderProgram(const std::files
         std::cout << "Can't find shader file: " << sShaderPath << std::endl;
         return {};
     }
-    auto vShaderStr = sGetFileContent(vShaderPath);
-    auto sShaderStr = sGetFileContent(sShaderPath);
+    auto vShaderStr = sInsertDefines(sGetFileContent(vShaderPath), defines);
+    auto sShaderStr = sInsertDefines(sGetFileContent(sShaderPath), defines);
+    auto isCached = cache && cache->isSupported();
+    auto cacheKey = isCached ? cache->key(vShaderStr, sShaderStr) : 0;
+    if (isCached) {
+        if (auto cachedProgramId = cache->load(cacheKey)) {
+            return ShaderProgram(*cachedProgramId);
+        }
+    }
 
     auto vShaderId = sCreateAndCompileShader(vShaderStr, true);
     if (!vShaderId) {
@@ -93,185 +131,126 @@ std::optional<ShaderProgram> ShaderProgram::createShaderProgram(const std::files
         return {};
     }
 
-    auto programId = sCreateAndLinkProgram(*vShaderId, *sShaderId);
+    auto programId = sCreateAndLinkProgram(*vShaderId, *sShaderId, isCached);
     sCleanUpShaders({*vShaderId, *sShaderId});
     if (!programId) {
         return {};
     }
+    if (isCached) {
+        cache->store(cacheKey, *programId);
+    }
 
     return ShaderProgram(*programId);
 }
 
-ShaderProgram::ShaderProgram(unsigned int programId) : programId_{programId} {}
-
-void ShaderProgram::use() { glUseProgram(programId_); }
+ShaderProgram::ShaderProgram(unsigned int programId) : programId_{programId} {
+    reflectUniforms_();
+    meshUniforms_.modelTr = uniformLocation("modelTr");
+    meshUniforms_.localTr = uniformLocation("localTr");
+    meshUniforms_.compactVertices = uniformLocation("compactVertices");
+    meshUniforms_.positionOffset = uniformLocation("positionOffset");
+    meshUniforms_.positionScale = uniformLocation("positionScale");
+    meshUniforms_.materialIndex = uniformLocation("materialIndex");
+    meshUniforms_.instanced = uniformLocation("instanced");
+
+    // GLSL 3.30 has no binding layout qualifier, blocks are attached to their binding points here
+    for (const auto& [blockName, binding] : {std::pair{"FrameData", cFrameBlockBinding},
+                                             std::pair{"LightsData", cLightsBlockBinding},
+                                             std::pair{"ClusterData", cClusterBlockBinding}}) {
+        auto blockIndex = glGetUniformBlockIndex(programId_, blockName);
+        if (blockIndex != GL_INVALID_INDEX) {
+            glUniformBlockBinding(programId_, blockIndex, binding);
+        }
+    }
 
-void ShaderProgram::setUniform(const std::string& varName, bool value) {
-    auto location = glGetUniformLocation(programId_, varName.c_str());
-    glUniform1i(location, value);
-}
-void ShaderProgram::setUniform(const std::string& varName, int value) {
-    auto location = glGetUniformLocation(programId_, varName.c_str());
-    glUniform1i(location, value);
-}
-void ShaderProgram::setUniform(const std::string& varName, unsigned int value) {
-    auto location = glGetUniformLocation(programId_, varName.c_str());
-    glUniform1i(location, value);
-}
-void ShaderProgram::setUniform(const std::string& varName, float value) {
-    auto location = glGetUniformLocation(programId_, varName.c_str());
-    glUniform1f(location, value);
-}
-void ShaderProgram::setUniform(const std::string& varName, const glm::mat4& transform) {
-    auto location = glGetUniformLocation(programId_, varName.c_str());
-    glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(transform));
-}
-void ShaderProgram::setUniform(const std::string& varName, const glm::vec3& color) {
-    auto location = glGetUniformLocation(programId_, varName.c_str());
-    glUniform3fv(location, 1, glm::value_ptr(color));
-}
-void ShaderProgram::clearMaterial(const std::string& structName) {
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
-    for (auto& textureTypeName : {"diffuse", "specular", "emission"}) {
-        auto textureLayersUniformName = structName + "." + textureTypeName + "LayersIndices";
-        auto countLayersUniformName = structName + "." + textureTypeName + "LayersCount";
-        setUniform(textureLayersUniformName, 0);
-        setUniform(countLayersUniformName, 0);
+    // texture units never change, the samplers are pointed to them once
+    int previousProgram = 0;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+    glUseProgram(programId_);
+    for (int unit = 0; unit < cMaxMaterialTextureArrays; ++unit) {
+        setUniform("textureArrays[" + std::to_string(unit) + "]", unit);
     }
+    setUniform("materialRecords", cMaterialRecordsUnit);
+    setUniform("materialLayers", cMaterialLayersUnit);
+    setUniform("lightRecords", cLightRecordsUnit);
+    setUniform("clusterLists", cClusterListsUnit);
+    setUniform("clusterLights", cClusterLightsUnit);
+    glUseProgram(static_cast<unsigned int>(previousProgram));
 }
-void ShaderProgram::setUniform(const std::string& structName, const Material& material) {
-    if (material.textureData) {
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D_ARRAY, material.textureData->id);
-        setUniform("textureArray", 0);
-        auto fromTextureTypeToString = [](const TextureType& type) {
-            switch (type) {
-                case TextureType::Diffuse:
-                    return "diffuse";
-                case TextureType::Specular:
-                    return "specular";
-                case TextureType::Emission:
-                    return "emission";
-                default:
-                    return "";
-            }
-        };
-        for (const auto& textureType : {TextureType::Diffuse, TextureType::Specular, TextureType::Emission}) {
-            auto countLayersUniformName =
-                structName + "." + fromTextureTypeToString(textureType) + "LayersCount";
-            auto textureLayersIt = material.textureData->textures.find(textureType);
-            if (textureLayersIt == material.textureData->textures.end()) {
-                setUniform(countLayersUniformName, 0);
-                continue;
-            }
-            setUniform(countLayersUniformName, static_cast<int>(textureLayersIt->second.size()));
 
-            auto textureLayersUniformName =
-                structName + "." + fromTextureTypeToString(textureType) + "LayersIndices";
-            for (size_t i = 0; i < textureLayersIt->second.size(); ++i) {
-                auto layerUniformName = textureLayersUniformName + "[" + std::to_string(i) + "]";
-                setUniform(layerUniformName, textureLayersIt->second[i]);
+void ShaderProgram::use() { glUseProgram(programId_); }
+
+unsigned int ShaderProgram::programId() const { return programId_; }
+
+void ShaderProgram::reflectUniforms_() {
+    int uniformsCount = 0;
+    int maxNameLength = 0;
+    glGetProgramiv(programId_, GL_ACTIVE_UNIFORMS, &uniformsCount);
+    glGetProgramiv(programId_, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+    std::vector<char> nameBuffer(static_cast<size_t>(std::max(maxNameLength, 1)));
+    for (int uniformIdx = 0; uniformIdx < uniformsCount; ++uniformIdx) {
+        int nameLength = 0;
+        int arraySize = 0;
+        GLenum type;
+        glGetActiveUniform(programId_, static_cast<GLuint>(uniformIdx),
+                           static_cast<GLsizei>(nameBuffer.size()), &nameLength, &arraySize, &type,
+                           nameBuffer.data());
+        std::string name(nameBuffer.data(), static_cast<size_t>(nameLength));
+        auto location = glGetUniformLocation(programId_, name.c_str());
+        // members of uniform blocks have no location
+        if (location < 0) {
+            continue;
+        }
+        // arrays are reported once as "name[0]", every element gets its own entry and the bare name
+        // refers to the first one
+        if (name.ends_with("[0]")) {
+            auto baseName = name.substr(0, name.size() - 3);
+            uniformLocations_.emplace(baseName, location);
+            for (int element = 0; element < arraySize; ++element) {
+                auto elementName = baseName + "[" + std::to_string(element) + "]";
+                uniformLocations_.emplace(elementName, glGetUniformLocation(programId_, elementName.c_str()));
             }
+        } else {
+            uniformLocations_.emplace(std::move(name), location);
         }
     }
-    setUniform(structName + ".shininess", material.shininess);
-    setUniform(structName + ".color", material.color);
 }
 
-void ShaderProgram::setUniform(const std::string& structName, const GlobalLight& light) {
-    auto varName = structName + ".ambientIntence";
-    auto location = glGetUniformLocation(programId_, varName.c_str());
-    glUniform1f(location, light.ambientIntence);
-
-    varName = structName + ".diffuseIntence";
-    location = glGetUniformLocation(programId_, varName.c_str());
-    glUniform1f(location, light.diffuseIntence);
-
-    varName = structName + ".specularIntence";
-    location = glGetUniformLocation(programId_, varName.c_str());
-    glUniform1f(location, light.specularIntence);
-
-    varName = structName + ".color";
-    location = glGetUniformLocation(programId_, varName.c_str());
-    glUniform3fv(location, 1, glm::value_ptr(light.color));
-
-    varName = structName + ".position";
-    location = glGetUniformLocation(programId_, varName.c_str());
-    glUniform3fv(location, 1, glm::value_ptr(light.position));
+UniformLocation ShaderProgram::uniformLocation(std::string_view name) const {
+    auto it = uniformLocations_.find(name);
+    return it != uniformLocations_.end() ? it->second : -1;
 }
 
-void ShaderProgram::setUniform(const std::string& structName, const PointLight& light) {
-    auto varName = structName + ".ambientIntence";
-    auto location = glGetUniformLocation(programId_, varName.c_str());
-    glUniform1f(location, light.ambientIntence);
-
-    varName = structName + ".diffuseIntence";
-    location = glGetUniformLocation(programId_, varName.c_str());
-    glUniform1f(location, light.diffuseIntence);
-
-    varName = structName + ".specularIntence";
-    location = glGetUniformLocation(programId_, varName.c_str());
-    glUniform1f(location, light.specularIntence);
+const MeshUniforms& ShaderProgram::meshUniforms() const { return meshUniforms_; }
 
-    varName = structName + ".color";
-    location = glGetUniformLocation(programId_, varName.c_str());
-    glUniform3fv(location, 1, glm::value_ptr(light.color));
-
-    varName = structName + ".position";
-    location = glGetUniformLocation(programId_, varName.c_str());
-    glUniform3fv(location, 1, glm::value_ptr(light.position));
-
-    varName = structName + ".constant";
-    location = glGetUniformLocation(programId_, varName.c_str());
-    glUniform1f(location, light.constant);
-    varName = structName + ".linear";
-    location = glGetUniformLocation(programId_, varName.c_str());
-    glUniform1f(location, light.linear);
-    varName = structName + ".quadratic";
-    location = glGetUniformLocation(programId_, varName.c_str());
-    glUniform1f(location, light.quadratic);
+void ShaderProgram::setUniform(UniformLocation location, bool value) { glUniform1i(location, value); }
+void ShaderProgram::setUniform(UniformLocation location, int value) { glUniform1i(location, value); }
+void ShaderProgram::setUniform(UniformLocation location, unsigned int value) {
+    glUniform1i(location, static_cast<int>(value));
+}
+void ShaderProgram::setUniform(UniformLocation location, float value) { glUniform1f(location, value); }
+void ShaderProgram::setUniform(UniformLocation location, const glm::mat4& transform) {
+    glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(transform));
+}
+void ShaderProgram::setUniform(UniformLocation location, const glm::vec3& color) {
+    glUniform3fv(location, 1, glm::value_ptr(color));
 }
-void ShaderProgram::setUniform(const std::string& structName, const SpotLight& light) {
-    auto varName = structName + ".ambientIntence";
-    auto location = glGetUniformLocation(programId_, varName.c_str());
-    glUniform1f(location, light.ambientIntence);
-
-    varName = structName + ".diffuseIntence";
-    location = glGetUniformLocation(programId_, varName.c_str());
-    glUniform1f(location, light.diffuseIntence);
-
-    varName = structName + ".specularIntence";
-    location = glGetUniformLocation(programId_, varName.c_str());
-    glUniform1f(location, light.specularIntence);
-
-    varName = structName + ".color";
-    location = glGetUniformLocation(programId_, varName.c_str());
-    glUniform3fv(location, 1, glm::value_ptr(light.color));
-
-    varName = structName + ".position";
-    location = glGetUniformLocation(programId_, varName.c_str());
-    glUniform3fv(location, 1, glm::value_ptr(light.position));
-
-    varName = structName + ".direction";
-    location = glGetUniformLocation(programId_, varName.c_str());
-    glUniform3fv(location, 1, glm::value_ptr(light.direction));
-
-    varName = structName + ".constant";
-    location = glGetUniformLocation(programId_, varName.c_str());
-    glUniform1f(location, light.constant);
-    varName = structName + ".linear";
-    location = glGetUniformLocation(programId_, varName.c_str());
-    glUniform1f(location, light.linear);
-    varName = structName + ".quadratic";
-    location = glGetUniformLocation(programId_, varName.c_str());
-    glUniform1f(location, light.quadratic);
-
-    varName = structName + ".cutOff";
-    location = glGetUniformLocation(programId_, varName.c_str());
-    glUniform1f(location, light.cutOff);
 
-    varName = structName + ".outerCutOff";
-    location = glGetUniformLocation(programId_, varName.c_str());
-    glUniform1f(location, light.outerCutOff);
+void ShaderProgram::setUniform(std::string_view varName, bool value) {
+    setUniform(uniformLocation(varName), value);
+}
+void ShaderProgram::setUniform(std::string_view varName, int value) {
+    setUniform(uniformLocation(varName), value);
+}
+void ShaderProgram::setUniform(std::string_view varName, unsigned int value) {
+    setUniform(uniformLocation(varName), value);
+}
+void ShaderProgram::setUniform(std::string_view varName, float value) {
+    setUniform(uniformLocation(varName), value);
+}
+void ShaderProgram::setUniform(std::string_view varName, const glm::mat4& transform) {
+    setUniform(uniformLocation(varName), transform);
+}
+void ShaderProgram::setUniform(std::string_view varName, const glm::vec3& color) {
+    setUniform(uniformLocation(varName), color);
 }
@@ -1,7 +1,12 @@
 #pragma once
 
+#include <array>
 #include <filesystem>
+#include <functional>
 #include <optional>
+#include <span>
+#include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 #include <glm/glm.hpp>
@@ -9,10 +14,30 @@
 enum class TextureType { Diffuse, Specular, Emission };
 using TextureID = unsigned int;
 using TextureLayerIndex = int;
+// should match MAX_TEXTURE_ARRAYS in shader.fs
+constexpr int cMaxMaterialTextureArrays{8};
+// texture units of the material table buffers, right after the texture arrays, see MaterialTable
+constexpr int cMaterialRecordsUnit{cMaxMaterialTextureArrays};
+constexpr int cMaterialLayersUnit{cMaxMaterialTextureArrays + 1};
+// texture units of the light cluster buffers, after the material table ones, see LightClusters
+constexpr int cLightRecordsUnit{cMaterialLayersUnit + 1};
+constexpr int cClusterListsUnit{cMaterialLayersUnit + 2};
+constexpr int cClusterLightsUnit{cMaterialLayersUnit + 3};
+constexpr size_t cTextureTypesCount{3};
+// binding points of the uniform blocks, blocks of every program are attached to them on creation
+constexpr unsigned int cFrameBlockBinding{0};
+constexpr unsigned int cLightsBlockBinding{1};
+constexpr unsigned int cClusterBlockBinding{2};
+
+// layer in one of the texture arrays of a material
+struct TextureLayerRef {
+    int arrayIdx;  // index in TextureData::arrays
+    TextureLayerIndex layer;
+};
 
 struct TextureData {
-    TextureID id;
-    std::unordered_map<TextureType, std::vector<TextureLayerIndex>> textures;
+    std::vector<TextureID> arrays;
+    std::unordered_map<TextureType, std::vector<TextureLayerRef>> textures;
 };
 
 struct Material {
@@ -39,6 +64,8 @@ struct PointLight {
     float constant = 1.0;
     float linear = 0.09;
     float quadratic = 0.032;
+    // the light fades out to nothing at this distance, 0 derives it from the attenuation, see LightClusters
+    float range = 0.0;
 
     float ambientIntence = 0.3;
     float diffuseIntence = 0.7;
@@ -57,30 +84,72 @@ struct SpotLight {
     float constant = 1.0;
     float linear = 0.09;
     float quadratic = 0.032;
+    // as PointLight::range
+    float range = 0.0;
 
     float ambientIntence = 0.;
     float diffuseIntence = 1.0;
     float specularIntence = 1.0;
 };
 
+class ProgramCache;
+
+// location of an active uniform, -1 for names the program doesn't use, GL ignores sets of those
+using UniformLocation = int;
+
+// uniforms set for every mesh draw, resolved once and then set without name lookups, see Mesh::setUniforms
+struct MeshUniforms {
+    UniformLocation modelTr = -1;
+    UniformLocation localTr = -1;
+    UniformLocation compactVertices = -1;
+    UniformLocation positionOffset = -1;
+    UniformLocation positionScale = -1;
+    UniformLocation materialIndex = -1;
+    // transform and material come from the instance attributes, see InstanceBuffer
+    UniformLocation instanced = -1;
+};
+
 class ShaderProgram {
    public:
+    // defines are "NAME value" pairs put right after the #version line of both shaders. With a cache the
+    // linked program is restored from its binary when the sources and the driver are the same as before
     static std::optional<ShaderProgram> createShaderProgram(const std::filesystem::path& vShaderPath,
-                                                            const std::filesystem::path& sShaderPath);
+                                                            const std::filesystem::path& sShaderPath,
+                                                            std::span<const std::string> defines = {},
+                                                            ProgramCache* cache = nullptr);
     void use();
-    void setUniform(const std::string& varName, bool value);
-    void setUniform(const std::string& varName, int value);
-    void setUniform(const std::string& varName, unsigned int value);
-    void setUniform(const std::string& varName, float value);
-    void setUniform(const std::string& varName, const glm::mat4& transform);
-    void setUniform(const std::string& varName, const glm::vec3& color);
-    void setUniform(const std::string& structName, const Material& material);
-    void clearMaterial(const std::string& structName);
-    void setUniform(const std::string& structName, const GlobalLight& light);
-    void setUniform(const std::string& structName, const SpotLight& light);
-    void setUniform(const std::string& structName, const PointLight& light);
+    unsigned int programId() const;
+
+    // active uniforms are reflected once after linking, elements of arrays are addressable as "name[i]"
+    UniformLocation uniformLocation(std::string_view name) const;
+    const MeshUniforms& meshUniforms() const;
+
+    void setUniform(UniformLocation location, bool value);
+    void setUniform(UniformLocation location, int value);
+    void setUniform(UniformLocation location, unsigned int value);
+    void setUniform(UniformLocation location, float value);
+    void setUniform(UniformLocation location, const glm::mat4& transform);
+    void setUniform(UniformLocation location, const glm::vec3& color);
+
+    // by name, the names are looked up in the reflected uniforms
+    void setUniform(std::string_view varName, bool value);
+    void setUniform(std::string_view varName, int value);
+    void setUniform(std::string_view varName, unsigned int value);
+    void setUniform(std::string_view varName, float value);
+    void setUniform(std::string_view varName, const glm::mat4& transform);
+    void setUniform(std::string_view varName, const glm::vec3& color);
 
    private:
+    // lets the locations map be searched by string_view without building a string
+    struct NameHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view name) const { return std::hash<std::string_view>{}(name); }
+    };
+
     ShaderProgram(unsigned int id);
     unsigned int programId_;
+    std::unordered_map<std::string, UniformLocation, NameHash, std::equal_to<>> uniformLocations_;
+    MeshUniforms meshUniforms_;
+
+    void reflectUniforms_();
 };
@@ -0,0 +1,95 @@
+#include "ShaderVariants.h"
+
+#include <iostream>
+
+namespace {
+int sSpecializedLayersCount(const std::array<int, cTextureTypesCount>& layersCounts, TextureType type) {
+    auto count = layersCounts[static_cast<size_t>(type)];
+    return count <= cMaxSpecializedLayers ? count : -1;
+}
+}  // namespace
+
+std::vector<std::string> ShaderFeatures::defines() const {
+    std::vector<std::string> result;
+    for (const auto& [name, count] : {std::pair{"DIFFUSE_LAYERS", diffuseLayersCount},
+                                      std::pair{"SPECULAR_LAYERS", specularLayersCount},
+                                      std::pair{"EMISSION_LAYERS", emissionLayersCount}}) {
+        if (count >= 0) {
+            result.push_back(std::string(name) + " " + std::to_string(count));
+        }
+    }
+    result.push_back(std::string("GLOBAL_LIGHT ") + (globalLight ? "1" : "0"));
+    result.push_back(std::string("LOCAL_LIGHTS ") + (localLights ? "1" : "0"));
+    return result;
+}
+
+uint32_t ShaderFeatures::key() const {
+    // counts are -1 to cMaxSpecializedLayers, four bits each
+    static_assert(cMaxSpecializedLayers < 15);
+    return static_cast<uint32_t>(diffuseLayersCount + 1) |
+           static_cast<uint32_t>(specularLayersCount + 1) << 4 |
+           static_cast<uint32_t>(emissionLayersCount + 1) << 8 |
+           static_cast<uint32_t>(globalLight) << 12 | static_cast<uint32_t>(localLights) << 13;
+}
+
+std::optional<ShaderVariants> ShaderVariants::createShaderVariants(const std::filesystem::path& vShaderPath,
+                                                                   const std::filesystem::path& sShaderPath,
+                                                                   ProgramCache* cache) {
+    auto generalProgram = ShaderProgram::createShaderProgram(vShaderPath, sShaderPath, {}, cache);
+    if (!generalProgram) {
+        return {};
+    }
+    return ShaderVariants(vShaderPath, sShaderPath, cache, std::move(*generalProgram));
+}
+
+ShaderVariants::ShaderVariants(const std::filesystem::path& vShaderPath,
+                               const std::filesystem::path& sShaderPath, ProgramCache* cache,
+                               ShaderProgram generalProgram)
+    : vShaderPath_{vShaderPath},
+      sShaderPath_{sShaderPath},
+      cache_{cache},
+      generalProgram_{std::move(generalProgram)} {}
+
+void ShaderVariants::setLights(bool hasGlobalLight, bool hasLocalLights) {
+    hasGlobalLight_ = hasGlobalLight;
+    hasLocalLights_ = hasLocalLights;
+}
+
+ShaderFeatures ShaderVariants::features(MaterialTable& materials, MaterialIndex material) const {
+    const auto& layersCounts = materials.layersCounts(material);
+    return ShaderFeatures{.diffuseLayersCount = sSpecializedLayersCount(layersCounts, TextureType::Diffuse),
+                          .specularLayersCount = sSpecializedLayersCount(layersCounts, TextureType::Specular),
+                          .emissionLayersCount = sSpecializedLayersCount(layersCounts, TextureType::Emission),
+                          .globalLight = hasGlobalLight_,
+                          .localLights = hasLocalLights_};
+}
+
+ShaderProgram& ShaderVariants::program(const ShaderFeatures& features) {
+    auto [it, isNew] = variants_.try_emplace(features.key());
+    if (isNew) {
+        auto defines = features.defines();
+        it->second = ShaderProgram::createShaderProgram(vShaderPath_, sShaderPath_, defines, cache_);
+        if (!it->second) {
+            std::cout << "Shader variant failed to compile, the general program is used instead:";
+            for (const auto& define : defines) {
+                std::cout << " " << define << ";";
+            }
+            std::cout << std::endl;
+        }
+    }
+    return it->second ? *it->second : generalProgram_;
+}
+
+ShaderProgram& ShaderVariants::program(MaterialTable& materials, MaterialIndex material) {
+    return program(features(materials, material));
+}
+
+ShaderProgram& ShaderVariants::generalProgram() { return generalProgram_; }
+
+size_t ShaderVariants::programsCount() const {
+    size_t count = 1;
+    for (const auto& [key, variant] : variants_) {
+        count += variant ? 1 : 0;
+    }
+    return count;
+}
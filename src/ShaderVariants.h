@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "MaterialTable.h"
+#include "ShaderProgram.h"
+
+// layer counts up to this get variants of their own, materials with more layers read the count from their
+// record like the general program does
+constexpr int cMaxSpecializedLayers{4};
+
+// what a program variant is specialized for, see the feature defines in shader.fs
+struct ShaderFeatures {
+    // -1 leaves the count to the material record
+    int diffuseLayersCount = -1;
+    int specularLayersCount = -1;
+    int emissionLayersCount = -1;
+    bool globalLight = true;
+    // point and spot lights of LightClusters
+    bool localLights = true;
+
+    // "NAME value" pairs for ShaderProgram::createShaderProgram
+    std::vector<std::string> defines() const;
+    uint32_t key() const;
+};
+
+// programs of one pair of shaders specialized for the materials drawn with them. Every variant is compiled on
+// its first use and kept, so a material without textures runs a fragment shader without layer loops and an
+// unlit scene skips the lights. The general program without defines handles every material
+class ShaderVariants {
+   public:
+    // nullopt if the general program doesn't compile. The cache, if any, must outlive the variants
+    static std::optional<ShaderVariants> createShaderVariants(const std::filesystem::path& vShaderPath,
+                                                              const std::filesystem::path& sShaderPath,
+                                                              ProgramCache* cache = nullptr);
+
+    // light types present in the scene, the features of materials follow them
+    void setLights(bool hasGlobalLight, bool hasLocalLights);
+    // layer counts are taken from the record of the material in the table, which the variant loops read
+    ShaderFeatures features(MaterialTable& materials, MaterialIndex material) const;
+    // a variant that fails to compile is reported once and replaced by the general program
+    ShaderProgram& program(const ShaderFeatures& features);
+    ShaderProgram& program(MaterialTable& materials, MaterialIndex material);
+    ShaderProgram& generalProgram();
+    // compiled so far, the general program included
+    size_t programsCount() const;
+
+   private:
+    ShaderVariants(const std::filesystem::path& vShaderPath, const std::filesystem::path& sShaderPath,
+                   ProgramCache* cache, ShaderProgram generalProgram);
+
+    std::filesystem::path vShaderPath_;
+    std::filesystem::path sShaderPath_;
+    ProgramCache* cache_;
+    ShaderProgram generalProgram_;
+    // by ShaderFeatures::key, nullopt for variants that failed to compile
+    std::unordered_map<uint32_t, std::optional<ShaderProgram>> variants_;
+    bool hasGlobalLight_{true};
+    bool hasLocalLights_{true};
+};
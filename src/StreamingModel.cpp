@@ -0,0 +1,318 @@
+#include "StreamingModel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <ranges>
+#include <unordered_set>
+
+namespace {
+// of materials without textures, as in Model
+const glm::vec3 defaultColor(1.0f, 0.925f, 0.5568f);
+// a couple of readers keep a disk busy, more only make the reads wait for each other
+constexpr size_t cIoWorkersCount{2};
+// reads queued at once, so that a jump of the camera doesn't queue reads for pages that are soon unwanted
+constexpr size_t cMaxReadsInFlight{8};
+// chunks allocated in the arena and not uploaded yet, uploads of the nearest chunks finish first
+constexpr size_t cMaxUploadingChunks{4};
+// geometry is streamed to GPU in pieces of this size, as Model does
+constexpr size_t cUploadChunkBytes{1 << 20};
+// the arena grows by doubling and reuses freed ranges first fit, so after evictions leave it half empty it is
+// compacted, as Model does on unload. This keeps its capacity near the resident geometry
+constexpr float cArenaCompactionUsage{0.5f};
+
+float sDistance(const BoundingBox& box, const glm::vec3& point) {
+    return glm::length(point - glm::clamp(point, box.min, box.max));
+}
+}  // namespace
+
+bool StreamingModel::Chunk::isUploaded() const { return !meshes.empty() && nextUploadMesh == meshes.size(); }
+
+StreamingModel::StreamingModel(const std::filesystem::path& pagedFile, const StreamingModelOptions& options)
+    : options_{options},
+      file_{PagedModelFile::open(pagedFile)},
+      ownArena_{options.geometryArena ? std::unique_ptr<GeometryArena>() : std::make_unique<GeometryArena>()},
+      arena_{options.geometryArena ? options.geometryArena : ownArena_.get()},
+      ownMaterials_{options.materialTable ? std::unique_ptr<MaterialTable>()
+                                          : std::make_unique<MaterialTable>()},
+      materials_{options.materialTable ? options.materialTable : ownMaterials_.get()},
+      ioWorkers_{cIoWorkersCount} {
+    if (!file_) {
+        return;
+    }
+    chunks_ = std::vector<Chunk>(file_->chunks().size());
+    stats_.chunksCount = chunks_.size();
+    loadMaterials_();
+    std::cout << "Paged model opened: " << pagedFile << ", " << chunks_.size() << " chunks" << std::endl;
+}
+
+StreamingModel::~StreamingModel() {
+    // the reads work with the file
+    for (auto chunkIdx : readingChunks_) {
+        chunks_[chunkIdx].read.wait();
+    }
+    if (!ownMaterials_) {
+        for (auto index : materialIndices_) {
+            materials_->remove(index);
+        }
+    }
+}
+
+bool StreamingModel::isOpen() const { return file_.has_value(); }
+
+void StreamingModel::setBudgets(const StreamingBudgets& budgets) { options_.budgets = budgets; }
+
+const StreamingBudgets& StreamingModel::budgets() const { return options_.budgets; }
+
+void StreamingModel::loadMaterials_() {
+    std::unordered_set<std::filesystem::path> uniqueImages;
+    for (const auto& images : file_->materials()) {
+        for (const auto& image : images | std::views::values) {
+            uniqueImages.insert(image);
+        }
+    }
+    textures_.addImages(uniqueImages, 0, options_.compressTextures);
+    for (const auto& images : file_->materials()) {
+        Material material;
+        material.textureData = textures_.makeTextureData(images);
+        if (!material.textureData) {
+            material.color = defaultColor;
+        }
+        materialIndices_.push_back(materials_->add(material));
+    }
+}
+
+void StreamingModel::update(const glm::vec3& viewPosition, const Frustum& frustum, double budgetMs) {
+    if (!file_) {
+        return;
+    }
+    ++frame_;
+    auto evictedChunksCount = stats_.evictedChunksCount;
+    takeFinishedReads_();
+    orderChunks_(viewPosition, frustum);
+
+    // the chunks are wanted in their order while they fit the budgets. A chunk on GPU needs no page, the
+    // others are read ahead
+    const auto& budgets = options_.budgets;
+    size_t gpuWantedBytes = 0;
+    size_t cpuWantedBytes = 0;
+    for (const auto& [isHidden, distance, chunkIdx] : chunkOrder_) {
+        auto& chunk = chunks_[chunkIdx];
+        const auto& info = file_->chunks()[chunkIdx];
+        if (chunk.isBroken) {
+            continue;
+        }
+        if (gpuWantedBytes + info.geometryBytes <= budgets.gpuBytes) {
+            gpuWantedBytes += info.geometryBytes;
+            chunk.gpuWantedFrame = frame_;
+        } else {
+            // later chunks are farther, none of them is kept before this one
+            gpuWantedBytes = budgets.gpuBytes + 1;
+        }
+        if (!chunk.meshes.empty()) {
+            if (chunk.gpuWantedFrame == frame_) {
+                gpuLru_.splice(gpuLru_.begin(), gpuLru_, chunk.gpuLruIt);
+            }
+            continue;
+        }
+        if (cpuWantedBytes + info.pageBytes <= budgets.cpuBytes) {
+            cpuWantedBytes += info.pageBytes;
+            chunk.cpuWantedFrame = frame_;
+            if (chunk.page) {
+                cpuLru_.splice(cpuLru_.begin(), cpuLru_, chunk.cpuLruIt);
+            }
+        } else {
+            cpuWantedBytes = budgets.cpuBytes + 1;
+        }
+    }
+    // lowered budgets are met by evicting unwanted chunks
+    makeGpuRoom_(0);
+    makeCpuRoom_(0);
+
+    // wanted chunks are uploaded and read in the order, nearest first
+    for (const auto& [isHidden, distance, chunkIdx] : chunkOrder_) {
+        auto& chunk = chunks_[chunkIdx];
+        const auto& info = file_->chunks()[chunkIdx];
+        auto isGpuWanted = chunk.gpuWantedFrame == frame_ && chunk.meshes.empty();
+        if (isGpuWanted && chunk.page && uploadingChunks_.size() < cMaxUploadingChunks &&
+            makeGpuRoom_(info.geometryBytes)) {
+            startUpload_(chunkIdx);
+        } else if (chunk.cpuWantedFrame == frame_ && !chunk.page && !chunk.isReading &&
+                   readingChunks_.size() < cMaxReadsInFlight && makeCpuRoom_(info.pageBytes)) {
+            startRead_(chunkIdx);
+        }
+    }
+    if (stats_.evictedChunksCount != evictedChunksCount) {
+        compactArena_();
+    }
+    uploadSteps_(budgetMs);
+
+    stats_.uploadingChunksCount = uploadingChunks_.size();
+    stats_.gpuChunksCount = gpuLru_.size() - uploadingChunks_.size();
+    stats_.cpuPagesCount = cpuLru_.size();
+    stats_.readsInFlightCount = readingChunks_.size();
+    stats_.gpuBytes = gpuBytes_;
+    stats_.cpuBytes = cpuBytes_;
+}
+
+void StreamingModel::takeFinishedReads_() {
+    std::erase_if(readingChunks_, [this](size_t chunkIdx) {
+        auto& chunk = chunks_[chunkIdx];
+        if (chunk.read.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return false;
+        }
+        chunk.isReading = false;
+        auto page = chunk.read.get();
+        const auto& info = file_->chunks()[chunkIdx];
+        if (!page) {
+            chunk.isBroken = true;
+            cpuBytes_ -= info.pageBytes;
+            return true;
+        }
+        // the bytes were reserved by startRead_
+        chunk.page = std::move(page);
+        chunk.cpuLruIt = cpuLru_.insert(cpuLru_.begin(), chunkIdx);
+        stats_.readBytes += info.pageBytes;
+        return true;
+    });
+}
+
+void StreamingModel::orderChunks_(const glm::vec3& viewPosition, const Frustum& frustum) {
+    chunkOrder_.clear();
+    stats_.visibleChunksCount = 0;
+    const auto& chunks = file_->chunks();
+    for (size_t chunkIdx = 0; chunkIdx < chunks.size(); ++chunkIdx) {
+        auto isVisible = frustum.isVisible(chunks[chunkIdx].bounds);
+        stats_.visibleChunksCount += isVisible ? 1 : 0;
+        chunkOrder_.emplace_back(!isVisible, sDistance(chunks[chunkIdx].bounds, viewPosition), chunkIdx);
+    }
+    std::ranges::sort(chunkOrder_);
+}
+
+bool StreamingModel::makeGpuRoom_(size_t bytes) {
+    while (gpuBytes_ + bytes > options_.budgets.gpuBytes) {
+        // the wanted chunks were moved to the front
+        if (gpuLru_.empty() || chunks_[gpuLru_.back()].gpuWantedFrame == frame_) {
+            return false;
+        }
+        evictChunk_(gpuLru_.back());
+    }
+    return true;
+}
+
+bool StreamingModel::makeCpuRoom_(size_t bytes) {
+    while (cpuBytes_ + bytes > options_.budgets.cpuBytes) {
+        if (cpuLru_.empty() || chunks_[cpuLru_.back()].cpuWantedFrame == frame_) {
+            return false;
+        }
+        evictPage_(cpuLru_.back());
+    }
+    return true;
+}
+
+void StreamingModel::compactArena_() {
+    auto stats = arena_->stats();
+    auto usage = stats.capacityBytes > 0
+                     ? static_cast<float>(stats.usedBytes) / static_cast<float>(stats.capacityBytes)
+                     : 1.0f;
+    if (usage < cArenaCompactionUsage) {
+        // allocations keep their ids, meshes being uploaded continue at the moved ranges
+        arena_->compact();
+    }
+}
+
+void StreamingModel::startUpload_(size_t chunkIdx) {
+    auto& chunk = chunks_[chunkIdx];
+    // the page moves to the meshes, they free it once it is uploaded
+    for (auto& pagedMesh : *chunk.page) {
+        chunk.meshes.push_back(std::make_unique<Mesh>(std::move(pagedMesh.geometry),
+                                                      materialIndices_[pagedMesh.material], *arena_,
+                                                      DeferredUpload{}));
+    }
+    cpuLru_.erase(chunk.cpuLruIt);
+    cpuBytes_ -= file_->chunks()[chunkIdx].pageBytes;
+    chunk.page.reset();
+    if (chunk.meshes.empty()) {
+        chunk.isBroken = true;
+        return;
+    }
+    chunk.nextUploadMesh = 0;
+    chunk.gpuLruIt = gpuLru_.insert(gpuLru_.begin(), chunkIdx);
+    gpuBytes_ += file_->chunks()[chunkIdx].geometryBytes;
+    uploadingChunks_.push_back(chunkIdx);
+}
+
+void StreamingModel::startRead_(size_t chunkIdx) {
+    auto& chunk = chunks_[chunkIdx];
+    // reserved until the read finishes, so that reads in flight count against the budget
+    cpuBytes_ += file_->chunks()[chunkIdx].pageBytes;
+    chunk.isReading = true;
+    chunk.read = ioWorkers_.submit([this, chunkIdx]() { return file_->readPage(chunkIdx); });
+    readingChunks_.push_back(chunkIdx);
+}
+
+void StreamingModel::evictChunk_(size_t chunkIdx) {
+    auto& chunk = chunks_[chunkIdx];
+    chunk.meshes.clear();
+    chunk.nextUploadMesh = 0;
+    gpuLru_.erase(chunk.gpuLruIt);
+    gpuBytes_ -= file_->chunks()[chunkIdx].geometryBytes;
+    std::erase(uploadingChunks_, chunkIdx);
+    ++stats_.evictedChunksCount;
+}
+
+void StreamingModel::evictPage_(size_t chunkIdx) {
+    auto& chunk = chunks_[chunkIdx];
+    chunk.page.reset();
+    cpuLru_.erase(chunk.cpuLruIt);
+    cpuBytes_ -= file_->chunks()[chunkIdx].pageBytes;
+    ++stats_.evictedPagesCount;
+}
+
+void StreamingModel::uploadSteps_(double budgetMs) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double, std::milli>(budgetMs);
+    // at least one step is done per call, so the uploads always progress
+    while (!uploadingChunks_.empty()) {
+        auto& chunk = chunks_[uploadingChunks_.front()];
+        auto& mesh = *chunk.meshes[chunk.nextUploadMesh];
+        mesh.uploadStep(cUploadChunkBytes);
+        if (mesh.isUploaded()) {
+            mesh.releaseGeometryData();
+            ++chunk.nextUploadMesh;
+        }
+        if (chunk.isUploaded()) {
+            uploadingChunks_.erase(uploadingChunks_.begin());
+        }
+        if (std::chrono::steady_clock::now() >= deadline) {
+            break;
+        }
+    }
+}
+
+void StreamingModel::submit(RenderQueue& queue, ShaderProgram& shader) const {
+    submit_(queue, [&shader](MaterialIndex) -> ShaderProgram& { return shader; });
+}
+
+void StreamingModel::submit(RenderQueue& queue, ShaderVariants& shaders) const {
+    submit_(queue, [this, &shaders](MaterialIndex material) -> ShaderProgram& {
+        return shaders.program(*materials_, material);
+    });
+}
+
+void StreamingModel::submit_(RenderQueue& queue,
+                             const std::function<ShaderProgram&(MaterialIndex)>& selectShader) const {
+    for (auto chunkIdx : gpuLru_) {
+        const auto& chunk = chunks_[chunkIdx];
+        if (!chunk.isUploaded()) {
+            continue;
+        }
+        // every mesh of a chunk has a material of its own
+        for (const auto& mesh : chunk.meshes) {
+            queue.submit(selectShader(mesh->material()), *materials_, *mesh);
+        }
+    }
+}
+
+BoundingBox StreamingModel::bounds() const { return file_ ? file_->bounds() : BoundingBox{}; }
+
+const StreamingModel::Stats& StreamingModel::stats() const { return stats_; }
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <list>
+#include <memory>
+#include <optional>
+#include <tuple>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Frustum.h"
+#include "GeometryArena.h"
+#include "MaterialTable.h"
+#include "Mesh.h"
+#include "PagedModel.h"
+#include "RenderQueue.h"
+#include "ShaderVariants.h"
+#include "TextureArrayManager.h"
+#include "ThreadPool.h"
+
+struct StreamingBudgets {
+    // pages read from disk and kept in memory, including the reads in flight
+    size_t cpuBytes = size_t{256} << 20;
+    // geometry of the chunks in the arena, including the chunks being uploaded. The arena is compacted when
+    // evictions leave it half empty, so its capacity stays within about twice the budget
+    size_t gpuBytes = size_t{512} << 20;
+};
+
+struct StreamingModelOptions {
+    StreamingBudgets budgets;
+    // see ModelLoadOptions
+    bool compressTextures = false;
+    GeometryArena* geometryArena = nullptr;
+    MaterialTable* materialTable = nullptr;
+};
+
+// draws a model written by buildPagedModel without holding all of it. Every frame the chunks are ordered
+// by visibility and then by distance from the camera, the first ones fitting the GPU budget are kept on GPU
+// and the next ones fitting the CPU budget are prefetched to memory. Pages are read by I/O workers and
+// uploaded a bit each frame, chunks and pages not wanted in this frame are evicted least recently used
+// first when the room is needed. Textures of all materials are loaded on open
+class StreamingModel {
+   public:
+    // counters of the last update, evictions and reads since open
+    struct Stats {
+        size_t chunksCount = 0;
+        size_t visibleChunksCount = 0;
+        size_t gpuChunksCount = 0;
+        size_t uploadingChunksCount = 0;
+        size_t cpuPagesCount = 0;
+        size_t readsInFlightCount = 0;
+        size_t gpuBytes = 0;
+        size_t cpuBytes = 0;
+        size_t evictedChunksCount = 0;
+        size_t evictedPagesCount = 0;
+        size_t readBytes = 0;
+    };
+
+    StreamingModel(const std::filesystem::path& pagedFile, const StreamingModelOptions& options = {});
+    ~StreamingModel();
+    StreamingModel(const StreamingModel&) = delete;
+    StreamingModel& operator=(const StreamingModel&) = delete;
+
+    // false if the file can't be read, nothing is drawn then
+    bool isOpen() const;
+    void setBudgets(const StreamingBudgets& budgets);
+    const StreamingBudgets& budgets() const;
+    // takes finished reads, picks the chunks to keep for the view, starts reads and evictions and spends
+    // about budgetMs on GPU uploads. Call once per frame before submit
+    void update(const glm::vec3& viewPosition, const Frustum& frustum, double budgetMs);
+    // submits the meshes of the chunks on GPU, the queue culls them and selects their levels
+    void submit(RenderQueue& queue, ShaderProgram& shader) const;
+    void submit(RenderQueue& queue, ShaderVariants& shaders) const;
+    BoundingBox bounds() const;
+    const Stats& stats() const;
+
+   private:
+    struct Chunk {
+        // meshes of the chunk in the arena, the chunk is drawn once all of them are uploaded
+        std::vector<std::unique_ptr<Mesh>> meshes;
+        size_t nextUploadMesh = 0;
+        // read ahead, it moves to the meshes when the chunk goes to GPU
+        std::optional<std::vector<PagedMesh>> page;
+        std::future<std::optional<std::vector<PagedMesh>>> read;
+        bool isReading = false;
+        // an unreadable page is not read again
+        bool isBroken = false;
+        // positions in the LRU lists, valid while the chunk is on GPU or its page is in memory
+        std::list<size_t>::iterator gpuLruIt;
+        std::list<size_t>::iterator cpuLruIt;
+        // the last frames the chunk was wanted on GPU and in memory, chunks wanted in the current frame are
+        // never evicted
+        size_t gpuWantedFrame = 0;
+        size_t cpuWantedFrame = 0;
+
+        bool isUploaded() const;
+    };
+
+    StreamingModelOptions options_;
+    std::optional<PagedModelFile> file_;
+    std::unique_ptr<GeometryArena> ownArena_;
+    GeometryArena* arena_;
+    std::unique_ptr<MaterialTable> ownMaterials_;
+    MaterialTable* materials_;
+    // one per material of the file
+    std::vector<MaterialIndex> materialIndices_;
+    TextureArrayManager textures_;
+    // declared after the materials, chunk meshes free their ranges on destruction
+    std::vector<Chunk> chunks_;
+    // most recently wanted first
+    std::list<size_t> gpuLru_;
+    std::list<size_t> cpuLru_;
+    std::vector<size_t> readingChunks_;
+    std::vector<size_t> uploadingChunks_;
+    // (hidden, distance, chunk) sorted, so visible chunks come first and nearer ones before farther ones
+    std::vector<std::tuple<bool, float, size_t>> chunkOrder_;
+    size_t gpuBytes_{0};
+    size_t cpuBytes_{0};
+    size_t frame_{1};
+    Stats stats_;
+    // reads pages, apart from the global pool so that they don't wait behind texture decoding
+    ThreadPool ioWorkers_;
+
+    void loadMaterials_();
+    void takeFinishedReads_();
+    void orderChunks_(const glm::vec3& viewPosition, const Frustum& frustum);
+    // evicts unwanted chunks until bytes fit the budget, false if the wanted ones don't leave the room
+    bool makeGpuRoom_(size_t bytes);
+    bool makeCpuRoom_(size_t bytes);
+    void startUpload_(size_t chunkIdx);
+    void startRead_(size_t chunkIdx);
+    void evictChunk_(size_t chunkIdx);
+    void evictPage_(size_t chunkIdx);
+    // frees the ranges left by evicted chunks in the arena once they make up most of it
+    void compactArena_();
+    void uploadSteps_(double budgetMs);
+    void submit_(RenderQueue& queue, const std::function<ShaderProgram&(MaterialIndex)>& selectShader) const;
+};
@@ -0,0 +1,66 @@
+#include "TextureArrayManager.h"
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <iostream>
+
+TextureArrayManager::~TextureArrayManager() { clear(); }
+
+void TextureArrayManager::addImages(const std::unordered_set<std::filesystem::path>& uniqueImages,
+                                    size_t workersCount, bool compress) {
+    std::unordered_set<std::filesystem::path> newImages;
+    for (const auto& image : uniqueImages) {
+        if (!textureSet_.locations.contains(image)) {
+            newImages.insert(image);
+        }
+    }
+    adopt(Utils::createTextureFromImages(newImages, workersCount, compress));
+}
+
+void TextureArrayManager::adopt(Utils::TextureSet&& textureSet) {
+    textureSet_.arrays.insert(textureSet_.arrays.end(), textureSet.arrays.begin(), textureSet.arrays.end());
+    textureSet_.locations.merge(textureSet.locations);
+}
+
+void TextureArrayManager::clear() {
+    for (const auto& array : textureSet_.arrays) {
+        glDeleteTextures(1, &array.id);
+    }
+    textureSet_ = {};
+}
+
+std::optional<Utils::TextureLocation> TextureArrayManager::find(const std::filesystem::path& image) const {
+    if (auto locationIt = textureSet_.locations.find(image); locationIt != textureSet_.locations.end()) {
+        return locationIt->second;
+    }
+    return {};
+}
+
+std::optional<TextureData> TextureArrayManager::makeTextureData(const ImagesInfo& images) const {
+    TextureData textureData;
+    for (const auto& [textureType, imagePath] : images) {
+        auto location = find(imagePath);
+        if (!location) {
+            continue;
+        }
+        // material binds only the arrays it samples from
+        auto arrayIt = std::find(textureData.arrays.begin(), textureData.arrays.end(), location->array);
+        if (arrayIt == textureData.arrays.end()) {
+            if (textureData.arrays.size() == cMaxMaterialTextureArrays) {
+                std::cout << "Too many texture arrays for one material, image skipped: " << imagePath
+                          << std::endl;
+                continue;
+            }
+            arrayIt = textureData.arrays.insert(textureData.arrays.end(), location->array);
+        }
+        auto arrayIdx = static_cast<int>(arrayIt - textureData.arrays.begin());
+        textureData.textures[textureType].push_back(
+            TextureLayerRef{.arrayIdx = arrayIdx, .layer = location->layer});
+    }
+    if (textureData.textures.empty()) {
+        return {};
+    }
+    return textureData;
+}
+
+size_t TextureArrayManager::memoryUsage() const { return Utils::textureArraysMemory(textureSet_.arrays); }
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "ShaderProgram.h"
+#include "Utils.h"
+
+// owns texture arrays created from images and addresses images by (array, layer)
+class TextureArrayManager {
+   public:
+    using ImagesInfo = std::vector<std::pair<TextureType, std::filesystem::path>>;
+
+    TextureArrayManager() = default;
+    ~TextureArrayManager();
+    TextureArrayManager(const TextureArrayManager&) = delete;
+    TextureArrayManager& operator=(const TextureArrayManager&) = delete;
+
+    // with compress images are stored block compressed, see Utils::planTextureSet
+    void addImages(const std::unordered_set<std::filesystem::path>& uniqueImages, size_t workersCount = 0,
+                   bool compress = false);
+    // takes ownership of arrays built outside, e.g. streamed by an asynchronous load
+    void adopt(Utils::TextureSet&& textureSet);
+    // deletes all arrays, images are added again by the next addImages
+    void clear();
+    std::optional<Utils::TextureLocation> find(const std::filesystem::path& image) const;
+    // texture arrays used by the images and layers of every image, empty if none of images is loaded
+    std::optional<TextureData> makeTextureData(const ImagesInfo& images) const;
+    // GPU memory of all arrays including mip levels
+    size_t memoryUsage() const;
+
+   private:
+    Utils::TextureSet textureSet_;
+};
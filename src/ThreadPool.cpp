@@ -0,0 +1,48 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t workersCount) {
+    if (workersCount == 0) {
+        workersCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    workers_.reserve(workersCount);
+    for (size_t i = 0; i < workersCount; ++i) {
+        workers_.emplace_back([this]() { workerLoop_(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(mutex_);
+        stopping_ = true;
+    }
+    condition_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+size_t ThreadPool::size() const { return workers_.size(); }
+
+ThreadPool& ThreadPool::global() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::workerLoop_() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock lock(mutex_);
+            condition_.wait(lock, [this]() { return stopping_ || !tasks_.empty(); });
+            // drain the queue before stopping so no future is left without a value
+            if (tasks_.empty()) {
+                return;
+            }
+            task = std::move(tasks_.front());
+            tasks_.pop();
+        }
+        task();
+    }
+}
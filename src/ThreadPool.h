@@ -0,0 +1,50 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+class ThreadPool {
+   public:
+    // 0 means one worker per hardware thread
+    explicit ThreadPool(size_t workersCount = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    template <typename Task>
+    auto submit(Task&& task) -> std::future<std::invoke_result_t<Task>>;
+    size_t size() const;
+
+    // shared pool for loaders, created on first use
+    static ThreadPool& global();
+
+   private:
+    std::vector<std::thread> workers_;
+    std::queue<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    bool stopping_{false};
+
+    void workerLoop_();
+};
+
+template <typename Task>
+auto ThreadPool::submit(Task&& task) -> std::future<std::invoke_result_t<Task>> {
+    using Result = std::invoke_result_t<Task>;
+    // packaged_task is move-only while std::function requires copyable callables
+    auto packagedTask = std::make_shared<std::packaged_task<Result()>>(std::forward<Task>(task));
+    auto future = packagedTask->get_future();
+    {
+        std::lock_guard lock(mutex_);
+        tasks_.emplace([packagedTask]() { (*packagedTask)(); });
+    }
+    condition_.notify_one();
+    return future;
+}
@@ -0,0 +1,55 @@
+#include "UniformBlocks.h"
+
+#include <glad/glad.h>
+#include <cstddef>
+
+namespace {
+// offsets as std140 lays the blocks out, see FrameData and LightsData in shader.fs
+static_assert(sizeof(FrameBlockData) == 144 && offsetof(FrameBlockData, viewPosition) == 128);
+static_assert(sizeof(GlobalLightStd140) == 48 && offsetof(GlobalLightStd140, specularIntence) == 32);
+
+unsigned int sCreateBlockBuffer(unsigned int binding, size_t size) {
+    unsigned int buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferData(GL_UNIFORM_BUFFER, static_cast<GLsizeiptr>(size), nullptr, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer);
+    return buffer;
+}
+
+// respecifying the whole store lets the driver hand out fresh memory instead of waiting for the previous
+// frame to stop reading it
+template <typename T>
+void sUpdateBlockBuffer(unsigned int buffer, const T& data) {
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(T), &data, GL_DYNAMIC_DRAW);
+}
+
+GlobalLightStd140 sToStd140(const GlobalLight& light) {
+    return GlobalLightStd140{.color = light.color,
+                             .ambientIntence = light.ambientIntence,
+                             .position = light.position,
+                             .diffuseIntence = light.diffuseIntence,
+                             .specularIntence = light.specularIntence,
+                             .padding = {}};
+}
+
+}  // namespace
+
+UniformBlocks::UniformBlocks()
+    : frameBuffer_{sCreateBlockBuffer(cFrameBlockBinding, sizeof(FrameBlockData))},
+      lightsBuffer_{sCreateBlockBuffer(cLightsBlockBinding, sizeof(LightsBlockData))} {}
+
+UniformBlocks::~UniformBlocks() {
+    glDeleteBuffers(1, &frameBuffer_);
+    glDeleteBuffers(1, &lightsBuffer_);
+}
+
+void UniformBlocks::setFrame(const glm::mat4& viewTr, const glm::mat4& projectionTr,
+                             const glm::vec3& viewPosition, float time) {
+    sUpdateBlockBuffer(frameBuffer_, FrameBlockData{viewTr, projectionTr, viewPosition, time});
+}
+
+void UniformBlocks::setLights(const GlobalLight& globalLight) {
+    sUpdateBlockBuffer(lightsBuffer_, LightsBlockData{sToStd140(globalLight)});
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "ShaderProgram.h"
+
+// std140 mirrors of the uniform blocks in the shaders, vec3 members are paired with a float to fill the
+// 16 bytes a vec3 takes in std140
+
+struct FrameBlockData {
+    glm::mat4 viewTr;
+    glm::mat4 projectionTr;
+    glm::vec3 viewPosition;
+    float time;
+};
+
+struct GlobalLightStd140 {
+    glm::vec3 color;
+    float ambientIntence;
+    glm::vec3 position;
+    float diffuseIntence;
+    float specularIntence;
+    float padding[3];
+};
+
+// point and spot lights are in the buffers of LightClusters
+struct LightsBlockData {
+    GlobalLightStd140 globalLight;
+};
+
+// buffers behind the FrameData and LightsData blocks. They stay bound to their binding points, every program
+// created by ShaderProgram reads them, so each block costs one buffer update per frame whatever the number
+// of programs
+class UniformBlocks {
+   public:
+    UniformBlocks();
+    ~UniformBlocks();
+    UniformBlocks(const UniformBlocks&) = delete;
+    UniformBlocks& operator=(const UniformBlocks&) = delete;
+
+    void setFrame(const glm::mat4& viewTr, const glm::mat4& projectionTr, const glm::vec3& viewPosition,
+                  float time);
+    void setLights(const GlobalLight& globalLight);
+
+   private:
+    unsigned int frameBuffer_;
+    unsigned int lightsBuffer_;
+};
@@ -1,10 +1,20 @@
 #include "Utils.h"
 #include "ShaderProgram.h"
+#include "ShaderVariants.h"
+#include "ProgramCache.h"
+#include "ThreadPool.h"
 
 #include <glad/glad.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <tuple>
 #include <vector>
-#include <ranges>
 
 namespace {
 struct ImageData {
@@ -14,6 +24,12 @@ struct ImageData {
     int nrComponents;
 };
 
+struct ImageHeader {
+    int width;
+    int height;
+    int nrComponents;
+};
+
 std::optional<ImageData> sLoadImage(const std::filesystem::path& path) {
     int width;
     int height;
@@ -33,98 +49,669 @@ std::optional<ImageData> sLoadImage(const std::filesystem::path& path) {
     return imgData;
 }
 
+// reads dimensions without decoding pixels
+std::optional<ImageHeader> sProbeImage(const std::filesystem::path& path) {
+    ImageHeader header;
+    if (!stbi_info(path.c_str(), &header.width, &header.height, &header.nrComponents)) {
+        return {};
+    }
+    return header;
+}
+
+// decodes the image and brings it to the layer size and channels of the texture array
+std::optional<std::vector<unsigned char>> sPrepareLayer(const std::filesystem::path& path, int baseWidth,
+                                                        int baseHeight, int baseChannels) {
+    auto maybeImgData = sLoadImage(path);
+    if (!maybeImgData.has_value()) {
+        return {};
+    }
+    auto& width = maybeImgData->width;
+    auto& height = maybeImgData->height;
+    auto& channels = maybeImgData->nrComponents;
+    auto& data = maybeImgData->data;
+
+    // convert to baseChannels if needed
+    if (channels != baseChannels) {
+        std::vector<unsigned char> converted(width * height * baseChannels, 255);
+        for (int pos = 0; pos < width * height; ++pos)
+            for (int ch = 0; ch < std::min(channels, baseChannels); ++ch)
+                converted[pos * baseChannels + ch] = data[pos * channels + ch];
+        data = std::move(converted);
+    }
+
+    if (width == baseWidth && height == baseHeight) {
+        return std::move(data);
+    }
+
+    // Resize to the largest dimensions
+    std::vector<unsigned char> resized(baseWidth * baseHeight * baseChannels);
+    stbir_resize_uint8_linear(data.data(), width, height, 0, resized.data(), baseWidth, baseHeight, 0,
+                              static_cast<stbir_pixel_layout>(baseChannels));
+    return resized;
+}
+
+GLenum sFormatFromChannels(int channels) {
+    switch (channels) {
+        case 1:
+            return GL_RED;
+        case 2:
+            return GL_RG;
+        case 3:
+            return GL_RGB;
+        default:
+            return GL_RGBA;
+    }
+}
+
+// images of the same class are resized to the largest of them, which is at most 2x upscale per axis
+int sResolutionClass(int size) {
+    int resolutionClass = 1;
+    while (resolutionClass < size) {
+        resolutionClass <<= 1;
+    }
+    return resolutionClass;
+}
+
+size_t sTextureMemory(int width, int height, int channels, size_t layersCount) {
+    // full mip chain adds one third
+    return static_cast<size_t>(width) * height * channels * layersCount * 4 / 3;
+}
+
+int sChannelsOfFormat(BlockFormat format) {
+    switch (format) {
+        case BlockFormat::BC4:
+            return 1;
+        case BlockFormat::BC5:
+            return 2;
+        case BlockFormat::BC1:
+            return 3;
+        default:
+            return 4;
+    }
+}
+
+CompressedImageHeader sCompressedHeader(const Utils::TextureArrayInfo& array) {
+    return CompressedImageHeader{.format = array.format,
+                                 .width = array.width,
+                                 .height = array.height,
+                                 .levelsCount = array.levelsCount};
+}
+
+std::optional<std::vector<unsigned char>> sPrepareCompressedLayer(const std::filesystem::path& path,
+                                                                  const Utils::TextureArrayInfo& array) {
+    auto header = sCompressedHeader(array);
+    if (BlockCompression::isCompressedImageFile(path)) {
+        auto image = BlockCompression::loadCompressedImage(path);
+        if (!image.has_value()) {
+            return {};
+        }
+        return std::move(image->data);
+    }
+    if (auto cached = BlockCompression::loadFromCache(path, header)) {
+        return std::move(cached->data);
+    }
+
+    auto pixels = sPrepareLayer(path, array.width, array.height, array.channels);
+    if (!pixels.has_value()) {
+        return {};
+    }
+    auto image = BlockCompression::compress(*pixels, array.width, array.height, array.channels);
+    BlockCompression::storeInCache(path, image);
+    return std::move(image.data);
+}
+
+// all layers of mip level 0 as tightly packed pixels of the array channels
+std::vector<unsigned char> sReadTextureArray(const Utils::TextureArrayInfo& array) {
+    std::vector<unsigned char> pixels(static_cast<size_t>(array.width) * array.height * array.channels *
+                                      array.layersCount);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, array.id);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glGetTexImage(GL_TEXTURE_2D_ARRAY, 0, sFormatFromChannels(array.channels), GL_UNSIGNED_BYTE,
+                  pixels.data());
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    return pixels;
+}
+
 }  // namespace
 
 namespace Utils {
 
-TextureInfo createTextureFromImages(const std::unordered_set<std::filesystem::path>& uniqueImagesPaths) {
-    if (uniqueImagesPaths.empty()) {
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash) {
+    constexpr uint64_t cFnvPrime{1099511628211ull};
+    auto bytes = static_cast<const unsigned char*>(data);
+    size_t pos = 0;
+    for (; pos + sizeof(uint64_t) <= size; pos += sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, bytes + pos, sizeof(word));
+        hash = (hash ^ word) * cFnvPrime;
+    }
+    for (; pos < size; ++pos) {
+        hash = (hash ^ bytes[pos]) * cFnvPrime;
+    }
+    return hash;
+}
+
+size_t textureArraysMemory(const std::vector<TextureArrayInfo>& arrays) {
+    size_t memory = 0;
+    for (const auto& array : arrays) {
+        if (array.format == BlockFormat::None) {
+            memory += sTextureMemory(array.width, array.height, array.channels, array.layersCount);
+        } else {
+            memory += textureLayerSize(array) * array.layersCount;
+        }
+    }
+    return memory;
+}
+
+size_t textureLayerSize(const TextureArrayInfo& array) {
+    if (array.format == BlockFormat::None) {
+        return static_cast<size_t>(array.width) * array.height * array.channels;
+    }
+    return BlockCompression::imageSize(sCompressedHeader(array));
+}
+
+void PreparedLayersQueue::push(PreparedLayer layer) {
+    {
+        std::lock_guard lock(mutex_);
+        layers_.push(std::move(layer));
+    }
+    condition_.notify_one();
+}
+
+PreparedLayer PreparedLayersQueue::pop() {
+    std::unique_lock lock(mutex_);
+    condition_.wait(lock, [this]() { return !layers_.empty(); });
+    auto layer = std::move(layers_.front());
+    layers_.pop();
+    return layer;
+}
+
+std::optional<PreparedLayer> PreparedLayersQueue::tryPop() {
+    std::lock_guard lock(mutex_);
+    if (layers_.empty()) {
         return {};
     }
+    auto layer = std::move(layers_.front());
+    layers_.pop();
+    return layer;
+}
+
+PixelUploadRing::PixelUploadRing(size_t buffersCount) : buffers_(buffersCount) {
+    glGenBuffers(static_cast<GLsizei>(buffers_.size()), buffers_.data());
+}
+
+PixelUploadRing::~PixelUploadRing() {
+    glDeleteBuffers(static_cast<GLsizei>(buffers_.size()), buffers_.data());
+}
 
+void PixelUploadRing::stage(const std::vector<unsigned char>& pixels) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers_[nextBuffer_]);
+    nextBuffer_ = (nextBuffer_ + 1) % buffers_.size();
+    // orphan the previous storage so mapping never waits for a transfer still in flight
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(pixels.size()), nullptr, GL_STREAM_DRAW);
+    auto mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, static_cast<GLsizeiptr>(pixels.size()),
+                                   GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    std::memcpy(mapped, pixels.data(), pixels.size());
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+}
+
+void PixelUploadRing::unbind() { glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); }
+
+TextureSetPlan planTextureSet(const std::unordered_set<std::filesystem::path>& uniqueImagesPaths,
+                              bool compress) {
+    // the flag is global in stb_image, set it before any worker starts decoding
     stbi_set_flip_vertically_on_load(true);
 
-    // load images
-    std::unordered_map<std::filesystem::path, ImageData> loadedImagesData;
+    // read image headers and group images by resolution class, channels count and format. pre-compressed
+    // images can't be resized, they are grouped by exact size, format and levels count
+    TextureSetPlan plan;
+    std::map<std::tuple<int, int, int, BlockFormat>, size_t> arrayIdxByClass;
+    std::map<std::tuple<int, int, BlockFormat, int>, size_t> arrayIdxByCompressedHeader;
     for (const auto& imagePath : uniqueImagesPaths) {
-        auto maybeImgData = sLoadImage(imagePath);
-        if (!maybeImgData.has_value()) {
-            std::cout << "Failed to load image from path: " << imagePath << std::endl;
-            continue;
+        size_t arrayIdx;
+        int width;
+        int height;
+        int channels;
+        if (BlockCompression::isCompressedImageFile(imagePath)) {
+            auto maybeHeader = BlockCompression::probeCompressedImage(imagePath);
+            if (!maybeHeader.has_value() || !BlockCompression::isSupported(maybeHeader->format)) {
+                std::cout << "Failed to load compressed image from path: " << imagePath << std::endl;
+                continue;
+            }
+            width = maybeHeader->width;
+            height = maybeHeader->height;
+            channels = sChannelsOfFormat(maybeHeader->format);
+            auto [arrayIdxIt, isNewHeader] = arrayIdxByCompressedHeader.try_emplace(
+                {width, height, maybeHeader->format, maybeHeader->levelsCount}, plan.arrays.size());
+            if (isNewHeader) {
+                plan.arrays.push_back(TextureArrayInfo{.id = 0, .width = width, .height = height,
+                                                       .channels = channels, .layersCount = 0,
+                                                       .format = maybeHeader->format,
+                                                       .levelsCount = maybeHeader->levelsCount});
+            }
+            arrayIdx = arrayIdxIt->second;
+        } else {
+            auto maybeHeader = sProbeImage(imagePath);
+            if (!maybeHeader.has_value()) {
+                std::cout << "Failed to load image from path: " << imagePath << std::endl;
+                continue;
+            }
+            width = maybeHeader->width;
+            height = maybeHeader->height;
+            channels = maybeHeader->nrComponents;
+            auto format = compress ? BlockCompression::formatForChannels(channels) : BlockFormat::None;
+            if (format != BlockFormat::None && !BlockCompression::isSupported(format)) {
+                format = BlockFormat::None;
+            }
+            auto [arrayIdxIt, isNewClass] = arrayIdxByClass.try_emplace(
+                {sResolutionClass(width), sResolutionClass(height), channels, format}, plan.arrays.size());
+            if (isNewClass) {
+                plan.arrays.push_back(TextureArrayInfo{.id = 0, .width = 0, .height = 0, .channels = channels,
+                                                       .layersCount = 0, .format = format});
+            }
+            arrayIdx = arrayIdxIt->second;
+            auto& array = plan.arrays[arrayIdx];
+            // for GL_TEXTURE_2D_ARRAY dimensions of layers should be the same
+            array.width = std::max(array.width, width);
+            array.height = std::max(array.height, height);
+            if (format != BlockFormat::None) {
+                array.levelsCount = BlockCompression::mipLevelsCount(array.width, array.height);
+            }
+        }
+        plan.targets.push_back(TextureLayerTarget{imagePath, arrayIdx, plan.arrays[arrayIdx].layersCount++});
+
+        plan.maxWidth = std::max(plan.maxWidth, width);
+        plan.maxHeight = std::max(plan.maxHeight, height);
+        plan.maxChannels = std::max(plan.maxChannels, channels);
+    }
+    return plan;
+}
+
+std::optional<std::vector<unsigned char>> prepareTextureLayer(const TextureSetPlan& plan, size_t targetIdx) {
+    const auto& target = plan.targets[targetIdx];
+    const auto& array = plan.arrays[target.arrayIdx];
+    if (array.format != BlockFormat::None) {
+        return sPrepareCompressedLayer(target.path, array);
+    }
+    return sPrepareLayer(target.path, array.width, array.height, array.channels);
+}
+
+TextureSet allocateTextureArrays(const TextureSetPlan& plan) {
+    TextureSet textureSet;
+    textureSet.arrays = plan.arrays;
+    for (auto& array : textureSet.arrays) {
+        GLenum format = sFormatFromChannels(array.channels);
+        glGenTextures(1, &array.id);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array.id);
+        if (array.format == BlockFormat::None) {
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, format, array.width, array.height, array.layersCount, 0,
+                         format, GL_UNSIGNED_BYTE, nullptr);
+        } else {
+            // compressed mip levels can't be generated by GL, all of them are allocated and uploaded
+            auto internalFormat = BlockCompression::glInternalFormat(array.format);
+            for (int level = 0; level < array.levelsCount; ++level) {
+                auto width = std::max(1, array.width >> level);
+                auto height = std::max(1, array.height >> level);
+                auto levelSize = BlockCompression::levelSize(array.format, width, height) * array.layersCount;
+                glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, internalFormat, width, height,
+                                       array.layersCount, 0, static_cast<GLsizei>(levelSize), nullptr);
+            }
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, array.levelsCount - 1);
+        }
+        // grayscale maps are sampled as gray, not red
+        if (array.channels <= 2) {
+            GLint swizzle[] = {GL_RED, GL_RED, GL_RED, array.channels == 2 ? GL_GREEN : GL_ONE};
+            glTexParameteriv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+        }
+    }
+    return textureSet;
+}
+
+void uploadTextureLayer(TextureSet& textureSet, const TextureSetPlan& plan, const PreparedLayer& layer,
+                        PixelUploadRing* uploadRing) {
+    const auto& target = plan.targets[layer.targetIdx];
+    if (!layer.pixels.has_value()) {
+        std::cout << "Failed to load image from path: " << target.path << std::endl;
+        return;
+    }
+    const auto& array = textureSet.arrays[target.arrayIdx];
+    if (layer.pixels->size() != textureLayerSize(array)) {
+        std::cout << "Image doesn't match its texture array: " << target.path << std::endl;
+        return;
+    }
+    // with a bound unpack buffer the pointer is an offset into it
+    uintptr_t pixels = uploadRing ? 0 : reinterpret_cast<uintptr_t>(layer.pixels->data());
+    if (uploadRing) {
+        uploadRing->stage(*layer.pixels);
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, array.id);
+    if (array.format == BlockFormat::None) {
+        // rows of 1 and 3 channel images are not 4 bytes aligned in general
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, target.layer, array.width, array.height, 1,
+                        sFormatFromChannels(array.channels), GL_UNSIGNED_BYTE,
+                        reinterpret_cast<const void*>(pixels));
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    } else {
+        auto internalFormat = BlockCompression::glInternalFormat(array.format);
+        for (int level = 0; level < array.levelsCount; ++level) {
+            auto width = std::max(1, array.width >> level);
+            auto height = std::max(1, array.height >> level);
+            auto levelSize = BlockCompression::levelSize(array.format, width, height);
+            glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, target.layer, width, height, 1,
+                                      internalFormat, static_cast<GLsizei>(levelSize),
+                                      reinterpret_cast<const void*>(pixels));
+            pixels += levelSize;
         }
-        std::cout << "Image loaded from path: " << imagePath << std::endl;
-        loadedImagesData[imagePath] = std::move(*maybeImgData);
     }
-    if (loadedImagesData.empty()) {
+    if (uploadRing) {
+        PixelUploadRing::unbind();
+    }
+    std::cout << "Image was uploaded to GPU: " << target.path << std::endl;
+    textureSet.locations[target.path] = TextureLocation{.array = array.id, .layer = target.layer};
+}
+
+void finishTextureArrays(const TextureSet& textureSet) {
+    for (const auto& array : textureSet.arrays) {
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array.id);
+        if (array.format == BlockFormat::None) {
+            glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        }
+
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    }
+}
+
+TextureSet createTextureFromImages(const std::unordered_set<std::filesystem::path>& uniqueImagesPaths,
+                                   size_t workersCount, bool compress) {
+    if (uniqueImagesPaths.empty()) {
         return {};
     }
+    auto startTime = std::chrono::steady_clock::now();
+
+    auto plan = planTextureSet(uniqueImagesPaths, compress);
+    if (plan.targets.empty()) {
+        return {};
+    }
+    auto textureSet = allocateTextureArrays(plan);
+
+    // decode, fill missing channels and resize on workers, upload to GPU here since GL context is bound to
+    // this thread
+    if (workersCount == 1) {
+        for (size_t targetIdx = 0; targetIdx < plan.targets.size(); ++targetIdx) {
+            uploadTextureLayer(textureSet, plan,
+                               PreparedLayer{targetIdx, prepareTextureLayer(plan, targetIdx)});
+        }
+    } else {
+        std::optional<ThreadPool> ownPool;
+        if (workersCount != 0) {
+            ownPool.emplace(workersCount);
+        }
+        auto& pool = ownPool ? *ownPool : ThreadPool::global();
+        workersCount = pool.size();
+
+        PreparedLayersQueue preparedLayers;
+        for (size_t targetIdx = 0; targetIdx < plan.targets.size(); ++targetIdx) {
+            pool.submit([&, targetIdx]() {
+                preparedLayers.push(PreparedLayer{targetIdx, prepareTextureLayer(plan, targetIdx)});
+            });
+        }
+        for (size_t uploadedCount = 0; uploadedCount < plan.targets.size(); ++uploadedCount) {
+            uploadTextureLayer(textureSet, plan, preparedLayers.pop());
+        }
+    }
+
+    finishTextureArrays(textureSet);
+
+    auto elapsedMs =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    constexpr double cMegabyte = 1024.0 * 1024.0;
+    std::cout << plan.targets.size() << " images loaded into " << textureSet.arrays.size()
+              << " texture arrays in " << elapsedMs << " ms using " << workersCount << " thread(s)\n"
+              << "  GPU memory: " << textureArraysMemory(textureSet.arrays) / cMegabyte << " MB, single "
+              << plan.maxWidth << "x" << plan.maxHeight << "x" << plan.maxChannels << " array would take "
+              << sTextureMemory(plan.maxWidth, plan.maxHeight, plan.maxChannels, plan.targets.size()) /
+                     cMegabyte
+              << " MB" << std::endl;
+
+    return textureSet;
+}
+
+void compareTextureLoading(const std::unordered_set<std::filesystem::path>& uniqueImages) {
+    auto measure = [&](size_t workersCount) {
+        auto startTime = std::chrono::steady_clock::now();
+        auto textureSet = createTextureFromImages(uniqueImages, workersCount);
+        // make sure the driver has finished with the uploads before stopping the timer
+        glFinish();
+        auto elapsedMs =
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+        for (const auto& array : textureSet.arrays) {
+            glDeleteTextures(1, &array.id);
+        }
+        return elapsedMs;
+    };
+
+    auto serialMs = measure(1);
+    auto parallelMs = measure(0);
+    std::cout << "Texture loading of " << uniqueImages.size() << " images:\n"
+              << "  serial:   " << serialMs << " ms\n"
+              << "  parallel: " << parallelMs << " ms (" << ThreadPool::global().size() << " threads)\n"
+              << "  speedup:  " << serialMs / parallelMs << "x" << std::endl;
+}
+
+void compareTextureCompression(const std::unordered_set<std::filesystem::path>& uniqueImages) {
+    auto measure = [&](bool compress) {
+        auto startTime = std::chrono::steady_clock::now();
+        auto textureSet = createTextureFromImages(uniqueImages, 0, compress);
+        glFinish();
+        auto elapsedMs =
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+        return std::make_pair(std::move(textureSet), elapsedMs);
+    };
+    auto deleteTextures = [](const TextureSet& textureSet) {
+        for (const auto& array : textureSet.arrays) {
+            glDeleteTextures(1, &array.id);
+        }
+    };
+
+    auto [plainSet, plainMs] = measure(false);
+    // the first compressed load encodes images missing in the texture cache, the second one reads the cache
+    auto [firstCompressedSet, firstCompressedMs] = measure(true);
+    deleteTextures(firstCompressedSet);
+    auto [compressedSet, compressedMs] = measure(true);
+
+    size_t driverMemory = 0;
+    for (const auto& array : compressedSet.arrays) {
+        if (array.format == BlockFormat::None) {
+            driverMemory += sTextureMemory(array.width, array.height, array.channels, array.layersCount);
+            continue;
+        }
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array.id);
+        for (int level = 0; level < array.levelsCount; ++level) {
+            GLint levelSize = 0;
+            glGetTexLevelParameteriv(GL_TEXTURE_2D_ARRAY, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE,
+                                     &levelSize);
+            driverMemory += static_cast<size_t>(levelSize);
+        }
+    }
+
+    // compare compressed layers decoded by the driver with the plain ones
+    std::unordered_map<TextureID, std::vector<unsigned char>> readBackArrays;
+    auto readArray = [&](const TextureArrayInfo& array) -> const std::vector<unsigned char>& {
+        auto pixelsIt = readBackArrays.find(array.id);
+        if (pixelsIt == readBackArrays.end()) {
+            pixelsIt = readBackArrays.emplace(array.id, sReadTextureArray(array)).first;
+        }
+        return pixelsIt->second;
+    };
+    double psnrSum = 0.0;
+    double minPsnr = std::numeric_limits<double>::infinity();
+    size_t comparedCount = 0;
+    for (const auto& [image, compressedLocation] : compressedSet.locations) {
+        auto plainLocationIt = plainSet.locations.find(image);
+        if (plainLocationIt == plainSet.locations.end()) {
+            continue;
+        }
+        const auto& plainLocation = plainLocationIt->second;
+        const auto& compressedArray =
+            *std::ranges::find(compressedSet.arrays, compressedLocation.array, &TextureArrayInfo::id);
+        const auto& plainArray =
+            *std::ranges::find(plainSet.arrays, plainLocation.array, &TextureArrayInfo::id);
+        if (compressedArray.format == BlockFormat::None || compressedArray.width != plainArray.width ||
+            compressedArray.height != plainArray.height || compressedArray.channels != plainArray.channels) {
+            continue;
+        }
+        auto layerSize = static_cast<size_t>(plainArray.width) * plainArray.height * plainArray.channels;
+        const auto* compressedPixels =
+            readArray(compressedArray).data() + compressedLocation.layer * layerSize;
+        const auto* plainPixels = readArray(plainArray).data() + plainLocation.layer * layerSize;
+        double squaredErrorSum = 0.0;
+        for (size_t pos = 0; pos < layerSize; ++pos) {
+            double error = static_cast<double>(compressedPixels[pos]) - plainPixels[pos];
+            squaredErrorSum += error * error;
+        }
+        auto meanSquaredError = squaredErrorSum / static_cast<double>(layerSize);
+        auto psnr = meanSquaredError == 0.0 ? std::numeric_limits<double>::infinity()
+                                            : 10.0 * std::log10(255.0 * 255.0 / meanSquaredError);
+        psnrSum += psnr;
+        minPsnr = std::min(minPsnr, psnr);
+        ++comparedCount;
+    }
+
+    constexpr double cMegabyte = 1024.0 * 1024.0;
+    std::cout << "Texture compression of " << uniqueImages.size() << " images:\n"
+              << "  plain:      " << textureArraysMemory(plainSet.arrays) / cMegabyte << " MB, " << plainMs
+              << " ms\n"
+              << "  compressed: " << textureArraysMemory(compressedSet.arrays) / cMegabyte
+              << " MB (driver reports " << driverMemory / cMegabyte << " MB), " << firstCompressedMs
+              << " ms first load, " << compressedMs << " ms cached load\n"
+              << "  PSNR:       " << (comparedCount ? psnrSum / comparedCount : 0.0) << " dB mean, "
+              << minPsnr << " dB min over " << comparedCount << " compressed images" << std::endl;
+
+    deleteTextures(plainSet);
+    deleteTextures(compressedSet);
+}
+
+void compareUniformBinding(ShaderProgram& shader) {
+    constexpr int cDrawsCount = 100000;
+    const glm::mat4 modelTr(1.0f);
+    const glm::vec3 positionOffset(0.0f);
+    const glm::vec3 positionScale(1.0f);
+
+    auto measure = [&](const auto& setDrawUniforms) {
+        glFinish();
+        auto startTime = std::chrono::steady_clock::now();
+        for (int draw = 0; draw < cDrawsCount; ++draw) {
+            setDrawUniforms();
+        }
+        glFinish();
+        auto elapsedUs =
+            std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - startTime).count();
+        return elapsedUs / cDrawsCount;
+    };
+
+    shader.use();
+    auto programId = shader.programId();
+    auto queriedUs = measure([&]() {
+        auto set = [&](const std::string& name, auto&& apply) {
+            apply(glGetUniformLocation(programId, name.c_str()));
+        };
+        auto setMatrix = [&](const std::string& name, const glm::mat4& value) {
+            set(name, [&](int location) { glUniformMatrix4fv(location, 1, GL_FALSE, &value[0][0]); });
+        };
+        auto setVector = [&](const std::string& name, const glm::vec3& value) {
+            set(name, [&](int location) { glUniform3fv(location, 1, &value[0]); });
+        };
+        auto setInt = [&](const std::string& name, int value) {
+            set(name, [&](int location) { glUniform1i(location, value); });
+        };
+        setMatrix("modelTr", modelTr);
+        setMatrix("localTr", modelTr);
+        setInt("compactVertices", 0);
+        setVector("positionOffset", positionOffset);
+        setVector("positionScale", positionScale);
+        setInt("materialIndex", 0);
+    });
+    auto namedUs = measure([&]() {
+        shader.setUniform("modelTr", modelTr);
+        shader.setUniform("localTr", modelTr);
+        shader.setUniform("compactVertices", false);
+        shader.setUniform("positionOffset", positionOffset);
+        shader.setUniform("positionScale", positionScale);
+        shader.setUniform("materialIndex", 0);
+    });
+    auto resolvedUs = measure([&]() {
+        const auto& uniforms = shader.meshUniforms();
+        shader.setUniform(uniforms.modelTr, modelTr);
+        shader.setUniform(uniforms.localTr, modelTr);
+        shader.setUniform(uniforms.compactVertices, false);
+        shader.setUniform(uniforms.positionOffset, positionOffset);
+        shader.setUniform(uniforms.positionScale, positionScale);
+        shader.setUniform(uniforms.materialIndex, 0);
+    });
+
+    std::cout << "Uniforms of one mesh draw, " << cDrawsCount << " draws:\n"
+              << "  queried from GL:  " << queriedUs << " us per draw\n"
+              << "  looked up names:  " << namedUs << " us per draw\n"
+              << "  resolved handles: " << resolvedUs << " us per draw" << std::endl;
+}
+
+void compareProgramCache(const std::filesystem::path& vShaderPath, const std::filesystem::path& sShaderPath) {
+    // variants a scene with a few kinds of materials asks for under every combination of lights
+    std::vector<ShaderFeatures> variants;
+    for (int diffuseLayersCount = 0; diffuseLayersCount <= 2; ++diffuseLayersCount) {
+        for (int specularLayersCount = 0; specularLayersCount <= 1; ++specularLayersCount) {
+            for (int emissionLayersCount = 0; emissionLayersCount <= 1; ++emissionLayersCount) {
+                for (int lights = 0; lights < 4; ++lights) {
+                    variants.push_back({.diffuseLayersCount = diffuseLayersCount,
+                                        .specularLayersCount = specularLayersCount,
+                                        .emissionLayersCount = emissionLayersCount,
+                                        .globalLight = (lights & 1) != 0,
+                                        .localLights = (lights & 2) != 0});
+                }
+            }
+        }
+    }
+
+    auto createVariants = [&](ProgramCache* cache) {
+        glFinish();
+        auto startTime = std::chrono::steady_clock::now();
+        for (const auto& features : variants) {
+            auto defines = features.defines();
+            if (auto program = ShaderProgram::createShaderProgram(vShaderPath, sShaderPath, defines, cache)) {
+                glDeleteProgram(program->programId());
+            }
+        }
+        glFinish();
+        auto elapsed = std::chrono::steady_clock::now() - startTime;
+        return std::chrono::duration<double, std::milli>(elapsed).count();
+    };
+
+    // a directory of its own, so that the cold run starts empty whatever the viewer cached
+    auto directory = ProgramCache::defaultDirectory().parent_path() / "programcache-report";
+    std::error_code error;
+    std::filesystem::remove_all(directory, error);
+    ProgramCache coldCache(directory);
+    if (!coldCache.isSupported()) {
+        std::cout << "Program binaries are not supported by the driver" << std::endl;
+        return;
+    }
+    auto coldMs = createVariants(&coldCache);
+    ProgramCache warmCache(directory);
+    auto warmMs = createVariants(&warmCache);
+    auto uncachedMs = createVariants(nullptr);
+    std::filesystem::remove_all(directory, error);
 
-    // define base dimensions since for GL_TEXTURE_2D_ARRAY they should be the same
-    int baseWidth = 0;
-    int baseHeight = 0;
-    int baseChannels = 0;
-    for (const auto& imageData : loadedImagesData | std::views::values) {
-        baseWidth = std::max(baseWidth, imageData.width);
-        baseHeight = std::max(baseHeight, imageData.height);
-        baseChannels = std::max(baseChannels, imageData.nrComponents);
-    }
-
-    TextureInfo textureInfo;
-    // allocate GPU storage
-    GLenum format;
-    if (baseChannels == 1)
-        format = GL_RED;
-    else if (baseChannels == 3)
-        format = GL_RGB;
-    else if (baseChannels == 4)
-        format = GL_RGBA;
-    GLuint texArray;
-    glGenTextures(1, &texArray);
-    glBindTexture(GL_TEXTURE_2D_ARRAY, texArray);
-    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, format, baseWidth, baseHeight,
-                 static_cast<GLsizei>(loadedImagesData.size()), 0, format, GL_UNSIGNED_BYTE, nullptr);
-    textureInfo.first = texArray;
-
-    // resize and fill missing channels, upload to GPU
-    int layerIdx{0};
-    for (auto& [path, imageData] : loadedImagesData) {
-        auto& width = imageData.width;
-        auto& height = imageData.height;
-        auto& channels = imageData.nrComponents;
-        auto& data = imageData.data;
-
-        // convert to baseChannels if needed
-        if (channels != baseChannels) {
-            std::vector<unsigned char> converted(width * height * baseChannels, 255);
-            for (int pos = 0; pos < width * height; ++pos)
-                for (int ch = 0; ch < std::min(channels, baseChannels); ++ch)
-                    converted[pos * baseChannels + ch] = data[pos * channels + ch];
-            data = std::move(converted);
-        }
-
-        // Resize to the largest dimensions
-        std::vector<unsigned char> resized(baseWidth * baseHeight * baseChannels);
-        stbir_resize_uint8_linear(data.data(), width, height, 0, resized.data(), baseWidth, baseHeight, 0,
-                                  static_cast<stbir_pixel_layout>(baseChannels));
-
-        // upload to GPU
-        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, static_cast<GLint>(layerIdx), baseWidth, baseHeight, 1,
-                        format, GL_UNSIGNED_BYTE, resized.data());
-
-        std::cout << "Image was uploaded to GPU: " << path << std::endl;
-
-        textureInfo.second[path] = static_cast<TextureLayerIndex>(layerIdx);
-        ++layerIdx;
-    }
-
-    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
-
-    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-    return textureInfo;
+    std::cout << variants.size() << " shader programs:\n"
+              << "  without cache: " << uncachedMs << " ms\n"
+              << "  cold cache:    " << coldMs << " ms (compiled and stored)\n"
+              << "  warm cache:    " << warmMs << " ms (" << warmCache.stats().hitsCount << " loaded, "
+              << warmCache.stats().rejectedCount << " rejected)\n"
+              << "drivers may cache compiled shaders themselves, which speeds up compiles after a first run"
+              << std::endl;
 }
 
 }  // namespace Utils
@@ -1,19 +1,141 @@
 #pragma once
 
+#include <cstdint>
 #include <optional>
 #include <filesystem>
+#include <condition_variable>
+#include <mutex>
+#include <queue>
 #include <unordered_set>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include <stb_image.h>
 #include <stb_image_resize2.h>
 
+#include "BlockCompression.h"
 #include "ShaderProgram.h"
 
 using TextureID = unsigned int;
 namespace Utils {
 
-using TextureInfo = std::pair<TextureID, std::unordered_map<std::filesystem::path, TextureLayerIndex>>;
-TextureInfo createTextureFromImages(const std::unordered_set<std::filesystem::path>& uniqueImages);
-}  // namespace Utils
\ No newline at end of file
+// place of an image inside the texture arrays of a TextureSet
+struct TextureLocation {
+    TextureID array;
+    TextureLayerIndex layer;
+};
+
+struct TextureArrayInfo {
+    TextureID id;
+    int width;
+    int height;
+    int channels;
+    int layersCount;
+    // None for plain pixels, block compressed arrays carry their own mip levels
+    BlockFormat format = BlockFormat::None;
+    int levelsCount = 1;
+};
+
+struct TextureSet {
+    std::vector<TextureArrayInfo> arrays;
+    std::unordered_map<std::filesystem::path, TextureLocation> locations;
+};
+
+// image and the texture array layer it goes to
+struct TextureLayerTarget {
+    std::filesystem::path path;
+    size_t arrayIdx;
+    TextureLayerIndex layer;
+};
+
+// images distributed into texture arrays, GL objects are not created yet
+struct TextureSetPlan {
+    std::vector<TextureArrayInfo> arrays;
+    std::vector<TextureLayerTarget> targets;
+    // size of the single array all images would need without grouping
+    int maxWidth = 0;
+    int maxHeight = 0;
+    int maxChannels = 0;
+};
+
+// layer pixels prepared by a worker, all mip levels for block compressed arrays, empty if the image failed to
+// decode
+struct PreparedLayer {
+    size_t targetIdx;
+    std::optional<std::vector<unsigned char>> pixels;
+};
+
+// hands prepared layers over from the workers to the GL thread in the order they are finished
+class PreparedLayersQueue {
+   public:
+    void push(PreparedLayer layer);
+    PreparedLayer pop();
+    std::optional<PreparedLayer> tryPop();
+
+   private:
+    std::queue<PreparedLayer> layers_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+};
+
+// pixel unpack buffers used round-robin, so the driver copies from one buffer while the next one is filled
+class PixelUploadRing {
+   public:
+    explicit PixelUploadRing(size_t buffersCount = 3);
+    ~PixelUploadRing();
+    PixelUploadRing(const PixelUploadRing&) = delete;
+    PixelUploadRing& operator=(const PixelUploadRing&) = delete;
+
+    // copies pixels to the next buffer and leaves it bound to GL_PIXEL_UNPACK_BUFFER
+    void stage(const std::vector<unsigned char>& pixels);
+    static void unbind();
+
+   private:
+    std::vector<unsigned int> buffers_;
+    size_t nextBuffer_{0};
+};
+
+constexpr uint64_t cHashSeed{14695981039346656037ull};
+// FNV-1a over 64-bit words, stable between runs, used for cache keys
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash = cHashSeed);
+
+// GPU memory of the arrays including mip levels
+size_t textureArraysMemory(const std::vector<TextureArrayInfo>& arrays);
+// bytes of one prepared layer of the array
+size_t textureLayerSize(const TextureArrayInfo& array);
+
+// images are grouped into GL_TEXTURE_2D_ARRAYs by resolution class (power of two of width and height) and
+// channels count, so a small grayscale map is not resized to the largest RGBA image of the set.
+// .dds and .ktx2 images share arrays only with images of the same size, format and levels count. with
+// compress other images are block compressed when the GL context supports the format for their channels.
+// only image headers are read, safe to call from any thread
+TextureSetPlan planTextureSet(const std::unordered_set<std::filesystem::path>& uniqueImages,
+                              bool compress = false);
+// decodes the target image and converts it to the size and channels of its array, block compressed layers are
+// read from the file or the texture cache and encoded only on a cache miss. safe to call from any thread
+std::optional<std::vector<unsigned char>> prepareTextureLayer(const TextureSetPlan& plan, size_t targetIdx);
+// the following need the GL context
+TextureSet allocateTextureArrays(const TextureSetPlan& plan);
+void uploadTextureLayer(TextureSet& textureSet, const TextureSetPlan& plan, const PreparedLayer& layer,
+                        PixelUploadRing* uploadRing = nullptr);
+// generates mip levels and sets sampling parameters once all layers are uploaded
+void finishTextureArrays(const TextureSet& textureSet);
+
+// plans, prepares and uploads images in one go. images are decoded, converted and resized on workersCount
+// threads (0 - all cores, 1 - serial on the calling thread), the calling thread uploads each layer to GPU as
+// soon as it is ready
+TextureSet createTextureFromImages(const std::unordered_set<std::filesystem::path>& uniqueImages,
+                                   size_t workersCount = 0, bool compress = false);
+// loads the same images serially and in parallel and prints timings of both runs
+void compareTextureLoading(const std::unordered_set<std::filesystem::path>& uniqueImages);
+// loads the same images as plain and block compressed arrays and prints GPU memory, load times (the second
+// compressed load is served by the texture cache) and PSNR of the compressed images read back from GPU
+void compareTextureCompression(const std::unordered_set<std::filesystem::path>& uniqueImages);
+// prints the CPU cost of setting the uniforms of one mesh draw by names queried from GL on every set (how it
+// used to work), by names looked up in the reflected uniforms and by pre-resolved locations
+void compareUniformBinding(ShaderProgram& shader);
+// creates a set of shader variants with an empty program cache, with the cache filled by that run and without
+// a cache, and prints the times of the three runs
+void compareProgramCache(const std::filesystem::path& vShaderPath, const std::filesystem::path& sShaderPath);
+}  // namespace Utils
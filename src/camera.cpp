@@ -1,6 +1,7 @@
 #include "camera.h"
 
 #include <algorithm>
+#include <cmath>
 
 namespace {}  // namespace
 Camera::Camera() { update_(); }
@@ -60,6 +61,14 @@ void Camera::resetView() {
     auto camera = Camera();
     swap_(camera);
 }
+void Camera::lookAt(const glm::vec3& position, const glm::vec3& target) {
+    position_ = position;
+    auto direction = glm::normalize(target - position);
+    // the inverse of update_, pitch is kept off the poles as processMouse does
+    pitch_ = std::clamp(glm::degrees(std::asin(static_cast<double>(direction.y))), -89.0, 89.0);
+    yaw_ = glm::degrees(std::atan2(static_cast<double>(direction.z), static_cast<double>(direction.x)));
+    update_();
+}
 void Camera::update_() {
     front_.x = cos(glm::radians(yaw_)) * cos(glm::radians(pitch_));
     front_.y = sin(glm::radians(pitch_));
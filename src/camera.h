@@ -17,6 +17,8 @@ class Camera {
     void processMouse(double xOffset, double yOffset);
     void processScroll(double yOffset);
     void resetView();
+    // places the camera at position looking at target, e.g. for scripted paths
+    void lookAt(const glm::vec3& position, const glm::vec3& target);
 
    private:
     glm::vec3 position_{glm::vec3{0.0, 0.0, 3.0}};
@@ -13,14 +13,31 @@
 
 #include "ShaderProgram.h"
 #include "Mesh.h"
+#include "InstanceBuffer.h"
+#include "RenderQueue.h"
 #include "camera.h"
 #include "Utils.h"
 #include "Model.h"
+#include "TextureArrayManager.h"
+#include "UniformBlocks.h"
+#include "LightClusters.h"
+#include "ShaderVariants.h"
+#include "ProgramCache.h"
+#include "Benchmark.h"
+#include "FrameProfiler.h"
+#include "PagedModel.h"
+#include "StreamingModel.h"
+#include <chrono>
 #include <cmath>
 #include <iostream>
 #include <algorithm>
+#include <cfloat>
 #include <functional>
+#include <cstdlib>
 #include <math.h>
+#include <optional>
+#include <string>
+#include <vector>
 
 // set GLViewport if user changes screen size
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
@@ -32,14 +49,27 @@ void lightsInputkeyCallback(GLFWwindow* window, int key, int scancode, int actio
 void mouseCallback(GLFWwindow* window, double xPos, double yPos);
 void scrollCallback(GLFWwindow* window, double xOffset, double yOffset);
 
+// scene setup and render loop, scene GL objects are released before the context is destroyed. A paged model
+// is streamed in besides the scene when its path is given
+void runViewer(GLFWwindow* window, const std::filesystem::path& streamedModelPath);
+
+// --benchmark [model] [--frames N] [--size WxH] [--output file] [--headless] [--depth-prepass]
+// [--occlusion-culling], empty for other modes
+std::optional<BenchmarkOptions> parseBenchmarkOptions(int argc, char* argv[]);
+
 // Initialize ImGui
 void SetupImGui(GLFWwindow* window);
 
 // Cleanup ImGui
 void CleanupImGui();
 
+// the first lights hang above the containers, the others are spread around the scene with short ranges
+PointLight makePointLight(int lightIdx);
+
 // Draw ImGui frame
-void RenderImGui();
+void RenderImGui(const Model& model, const RenderQueue::Stats& renderStats,
+                 const LightClusters::Stats& lightStats, size_t shaderProgramsCount,
+                 FrameProfiler& profiler, StreamingModel* streamedModel);
 
 // ToDo remove global variables
 Camera camera;
@@ -52,24 +82,68 @@ float lastYPos = 600 / 2;
 bool globalLightOn{true};
 glm::vec3 defaultGlobalLightColor = glm::vec3(1.0f, 0.925f, 0.5568f);
 bool pointLightOn{true};
-// point light is the same color as global because light cubes shares one shader
 glm::vec3 defualtPointLightColor = defaultGlobalLightColor;  // glm::vec3(0.8906f, 0.4375f, 0.144531f);
 bool spotLightOn{true};
 glm::vec3 defualtSpotLightColor = glm::vec3(1.0f, 1.0f, 1.f);
 
 bool interactiveMode{false};
 
-const int cPointLightsNumber{4};
-
-int main() {
+const int cDefaultPointLightsCount{4};
+const int cMaxPointLightsCount{1024};
+int pointLightsCount{cDefaultPointLightsCount};
+// fragments evaluate only the lights of their cluster, otherwise all of them
+bool clusteredLighting{true};
+// time per frame spent on streaming models to GPU
+const double cModelUploadBudgetMs{4.0};
+// simplified levels of meshes are drawn while their error covers at most this many pixels
+float lodMaxScreenError{1.0f};
+// opaque draws fill the depth buffer first, then only the visible fragments are shaded
+bool depthPrepass{false};
+// every pixel shows how many times it is shaded instead of the lit scene
+bool overdrawView{false};
+// meshes of models whose bounds were hidden behind the depth of the last frames are not drawn
+bool occlusionCulling{false};
+
+int main(int argc, char* argv[]) {
+    // --build-pages <model> <output> [--chunk-triangles N] writes a paged model for --stream and exits, no
+    // window is needed
+    if (argc > 1 && std::string(argv[1]) == "--build-pages") {
+        if (argc < 4) {
+            std::cout << "Usage: --build-pages <model> <output> [--chunk-triangles N]" << std::endl;
+            return -1;
+        }
+        PagedModelBuildOptions options;
+        if (argc > 5 && std::string(argv[4]) == "--chunk-triangles") {
+            options.maxChunkTriangles = std::max(std::atoi(argv[5]), 1);
+        }
+        return buildPagedModel(argv[2], argv[3], options) ? 0 : -1;
+    }
+    auto benchmarkOptions = parseBenchmarkOptions(argc, argv);
+    auto isHeadless = benchmarkOptions && benchmarkOptions->headless;
+    if (isHeadless) {
+        // no display is needed, the context renders only to framebuffer objects
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+    }
     // GLFW initialization -- addon to OpenGL to manages windows
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    if (benchmarkOptions) {
+        // the benchmark draws offscreen at its own size, the window only holds the context
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    }
+    if (isHeadless) {
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+    }
 
     // window creation
     GLFWwindow* window = glfwCreateWindow(1600, 1200, "LearnOpenGL", NULL, NULL);
+    if (window == NULL && isHeadless) {
+        // without EGL, e.g. a Mesa build with OSMesa only
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+        window = glfwCreateWindow(1600, 1200, "LearnOpenGL", NULL, NULL);
+    }
 
     if (window == NULL) {
         std::cout << "Failed to create GLFW window" << std::endl;
@@ -85,49 +159,210 @@ int main() {
         return -1;
     }
 
+    if (benchmarkOptions) {
+        auto isDone = runBenchmark(*benchmarkOptions);
+        glfwTerminate();
+        return isDone ? 0 : -1;
+    }
+
+    // --texture-load-report [images...] compares serial and parallel texture loading and exits
+    if (argc > 1 && std::string(argv[1]) == "--texture-load-report") {
+        std::unordered_set<std::filesystem::path> images(argv + 2, argv + argc);
+        if (images.empty()) {
+            images = {"samples/container.png", "samples/containerMetalBorder.png", "samples/matrix.jpg"};
+        }
+        Utils::compareTextureLoading(images);
+        glfwTerminate();
+        return 0;
+    }
+    // --texture-compression-report [images...] compares plain and block compressed textures and exits
+    if (argc > 1 && std::string(argv[1]) == "--texture-compression-report") {
+        std::unordered_set<std::filesystem::path> images(argv + 2, argv + argc);
+        if (images.empty()) {
+            images = {"samples/container.png", "samples/containerMetalBorder.png", "samples/matrix.jpg"};
+        }
+        Utils::compareTextureCompression(images);
+        glfwTerminate();
+        return 0;
+    }
+
+    // --uniform-benchmark measures the CPU cost of setting the uniforms of a draw and exits
+    if (argc > 1 && std::string(argv[1]) == "--uniform-benchmark") {
+        auto shaderProgram = ShaderProgram::createShaderProgram("shaders/shader.vs", "shaders/shader.fs");
+        if (shaderProgram) {
+            Utils::compareUniformBinding(*shaderProgram);
+        }
+        glfwTerminate();
+        return 0;
+    }
+
+    // --shader-cache-report creates shader variants with a cold, a warm and no program cache and exits
+    if (argc > 1 && std::string(argv[1]) == "--shader-cache-report") {
+        Utils::compareProgramCache("shaders/shader.vs", "shaders/shader.fs");
+        glfwTerminate();
+        return 0;
+    }
+
+    // --stream <file> draws the paged model written by --build-pages next to the scene
+    std::filesystem::path streamedModelPath;
+    if (argc > 2 && std::string(argv[1]) == "--stream") {
+        streamedModelPath = argv[2];
+    }
+    runViewer(window, streamedModelPath);
+
+    // glfw: terminate, clearing all previously allocated GLFW resources.
+    glfwTerminate();
+    return 0;
+}
+
+std::optional<BenchmarkOptions> parseBenchmarkOptions(int argc, char* argv[]) {
+    if (argc < 2 || std::string(argv[1]) != "--benchmark") {
+        return {};
+    }
+    BenchmarkOptions options;
+    for (int argIdx = 2; argIdx < argc; ++argIdx) {
+        std::string arg = argv[argIdx];
+        auto hasValue = argIdx + 1 < argc;
+        if (arg == "--headless") {
+            options.headless = true;
+        } else if (arg == "--depth-prepass") {
+            options.depthPrepass = true;
+        } else if (arg == "--occlusion-culling") {
+            options.occlusionCulling = true;
+        } else if (arg == "--frames" && hasValue) {
+            options.framesCount = std::atoi(argv[++argIdx]);
+        } else if (arg == "--size" && hasValue) {
+            // WxH, a malformed size is caught by runBenchmark
+            std::string size = argv[++argIdx];
+            auto separator = size.find('x');
+            options.width = std::atoi(size.substr(0, separator).c_str());
+            options.height =
+                separator != std::string::npos ? std::atoi(size.substr(separator + 1).c_str()) : 0;
+        } else if (arg == "--output" && hasValue) {
+            options.outputPath = argv[++argIdx];
+        } else if (arg.starts_with("--")) {
+            std::cout << "Unknown benchmark option ignored: " << arg << std::endl;
+        } else {
+            options.modelPath = arg;
+        }
+    }
+    return options;
+}
+
+void runViewer(GLFWwindow* window, const std::filesystem::path& streamedModelPath) {
     GlobalLight globalLight;
     globalLight.color = defaultGlobalLightColor;
     globalLight.position = glm::vec3(10.0, 10.0, 10.0);
 
-    std::vector<PointLight> pointLights(cPointLightsNumber);
-    const glm::vec3 pointLightShift{glm::vec3(0.0, 2.0, 0.0)};
-    for (int i = 0; i < cPointLightsNumber; ++i) {
-        auto& pointLight = pointLights[i];
-        pointLight.color = defualtPointLightColor;
-        pointLight.position = glm::vec3(0.0, 2.0, 0.0) + pointLightShift * static_cast<float>(i);
-    }
+    // placed when their count changes, pointLightColors keeps the colors while the lights are switched off
+    std::vector<PointLight> pointLights;
+    std::vector<glm::vec3> pointLightColors;
 
     SpotLight spotLight;
 
+    TextureArrayManager containerTextures;
     Material containerMaterial;
     {
-        std::unordered_set<std::filesystem::path> containerImages{
+        containerTextures.addImages({
             "samples/container.png",
             "samples/containerMetalBorder.png",
             "samples/matrix.jpg",
-        };
-        auto containerTextureInfo = Utils::createTextureFromImages(containerImages);
-        TextureData textureData;
-        textureData.id = containerTextureInfo.first;
-        textureData.textures = {
-            {TextureType::Diffuse, {containerTextureInfo.second["samples/container.png"]}},
-            {TextureType::Specular, {containerTextureInfo.second["samples/containerMetalBorder.png"]}},
-            {TextureType::Emission, {containerTextureInfo.second["samples/matrix.jpg"]}},
-        };
-        containerMaterial.textureData = std::move(textureData);
+        });
+        containerMaterial.textureData = containerTextures.makeTextureData({
+            {TextureType::Diffuse, "samples/container.png"},
+            {TextureType::Specular, "samples/containerMetalBorder.png"},
+            {TextureType::Emission, "samples/matrix.jpg"},
+        });
         containerMaterial.color = glm::vec3(0, 0, 0);
         containerMaterial.shininess = 1024;
     }
-    Material lightSourceMaterial;
-    { lightSourceMaterial.color = defaultGlobalLightColor; }
-
-    auto shaderProgram = ShaderProgram::createShaderProgram("shaders/shader.vs", "shaders/shader.fs");
-    if (!shaderProgram) {
-        return 0;
+    // linked programs of previous runs, variants compiled later during the run are restored from it as well
+    ProgramCache programCache;
+    auto shadersStartTime = std::chrono::steady_clock::now();
+    // materials are drawn with programs specialized for their layers and the lights of the scene
+    auto sceneShaders =
+        ShaderVariants::createShaderVariants("shaders/shader.vs", "shaders/shader.fs", &programCache);
+    auto lightSourceProgram = ShaderProgram::createShaderProgram(
+        "shaders/shader.vs", "shaders/shaderLightSource.fs", {}, &programCache);
+    auto depthProgram =
+        ShaderProgram::createShaderProgram("shaders/shader.vs", "shaders/depth.fs", {}, &programCache);
+    auto overdrawProgram =
+        ShaderProgram::createShaderProgram("shaders/shader.vs", "shaders/overdraw.fs", {}, &programCache);
+    auto occlusionBoxProgram =
+        ShaderProgram::createShaderProgram("shaders/occlusionBox.vs", "shaders/depth.fs", {}, &programCache);
+    if (!sceneShaders || !lightSourceProgram || !depthProgram || !overdrawProgram || !occlusionBoxProgram) {
+        return;
+    }
+    auto shadersTime = std::chrono::steady_clock::now() - shadersStartTime;
+    auto shadersMs = std::chrono::duration<double, std::milli>(shadersTime).count();
+    std::cout << "Shader programs created in " << shadersMs << " ms, " << programCache.stats().hitsCount
+              << " restored from the program cache" << std::endl;
+    // camera and lights are written once per frame and read by both programs
+    UniformBlocks uniformBlocks;
+    LightClusters lightClusters;
+    // materials of the whole scene, declared before the models since they remove theirs on destruction
+    MaterialTable sceneMaterials;
+    auto containerMaterialIndex = sceneMaterials.add(containerMaterial);
+    auto cubeMesh = createCubeMesh(containerMaterialIndex);
+    // containers don't move, their instances are sent to GPU once
+    InstanceBuffer containerInstances;
+    int cubeNumberXYPlane = 6;
+    double positionRadius = 3;
+    for (int i = 1; i <= cubeNumberXYPlane; i++) {
+        auto modelTr = glm::translate(
+            glm::mat4(1.0f),
+            glm::vec3(positionRadius * cos(2 * double(i) * M_PI / cubeNumberXYPlane),
+                      positionRadius * sin(2 * double(i) * M_PI / cubeNumberXYPlane), double(i) / 2));
+        containerInstances.add({.modelTr = modelTr, .material = containerMaterialIndex});
+    }
+    // light sources are cubes colored by a material per light, the colors are updated when lights toggle
+    InstanceBuffer lightSourceInstances;
+    std::vector<MaterialIndex> lightSourceMaterials;
+    auto addLightSource = [&](const glm::vec3& position, float scale, const glm::vec3& color) {
+        auto material = sceneMaterials.add(Material{.color = color});
+        auto modelTr = glm::scale(glm::translate(glm::mat4(1.0f), position), glm::vec3(scale));
+        lightSourceInstances.add({.modelTr = modelTr, .material = material});
+        lightSourceMaterials.push_back(material);
+    };
+    auto placePointLights = [&]() {
+        for (auto material : lightSourceMaterials) {
+            sceneMaterials.remove(material);
+        }
+        lightSourceMaterials.clear();
+        lightSourceInstances.clear();
+        addLightSource(globalLight.position, 1.0f, globalLight.color);
+        pointLights.clear();
+        pointLightColors.clear();
+        for (int i = 0; i < pointLightsCount; ++i) {
+            pointLights.push_back(makePointLight(i));
+            pointLightColors.push_back(pointLights.back().color);
+            addLightSource(pointLights.back().position, i < cDefaultPointLightsCount ? 0.5f : 0.1f,
+                           pointLights.back().color);
+        }
+    };
+    placePointLights();
+    auto setLightSourceColor = [&](size_t lightSourceIdx, const glm::vec3& color) {
+        auto material = lightSourceMaterials[lightSourceIdx];
+        if (sceneMaterials.material(material).color != color) {
+            sceneMaterials.update(material, Material{.color = color});
+        }
+    };
+    RenderQueue renderQueue;
+    OcclusionCuller occlusionCuller(*occlusionBoxProgram);
+
+    // geometry of all models of the scene, declared before them since they free their ranges on destruction
+    GeometryArena sceneGeometry;
+    Model backpackModel("samples/backpack/backpack.obj", {.async = true,
+                                                          .compressTextures = true,
+                                                          .geometryArena = &sceneGeometry,
+                                                          .materialTable = &sceneMaterials});
+    std::unique_ptr<StreamingModel> streamedModel;
+    if (!streamedModelPath.empty()) {
+        streamedModel = std::make_unique<StreamingModel>(
+            streamedModelPath, StreamingModelOptions{.compressTextures = true,
+                                                     .geometryArena = &sceneGeometry,
+                                                     .materialTable = &sceneMaterials});
     }
-    auto cubeMesh = createCubeMesh(Material());
-
-    Model backpackModel("samples/backpack/backpack.obj");
 
     // glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
     glEnable(GL_DEPTH_TEST);
@@ -137,80 +372,106 @@ int main() {
 
     glfwSetKeyCallback(window, lightsInputkeyCallback);
     SetupImGui(window);
+    FrameProfiler profiler;
     while (!glfwWindowShouldClose(window)) {
-        // catch key released callbacks
-        processInput(window);
-
-        if (interactiveMode) {
-            glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
-            glfwSetCursorPosCallback(window, nullptr);
-        } else {
-            glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-            glfwSetCursorPosCallback(window, mouseCallback);
+        profiler.beginFrame();
+        {
+            auto updateScope = profiler.scope("Update");
+            // catch key released callbacks
+            processInput(window);
+
+            if (interactiveMode) {
+                glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
+                glfwSetCursorPosCallback(window, nullptr);
+            } else {
+                glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+                glfwSetCursorPosCallback(window, mouseCallback);
+            }
+            if (static_cast<int>(pointLights.size()) != pointLightsCount) {
+                placePointLights();
+            }
+            globalLight.color = globalLightOn ? defaultGlobalLightColor : glm::vec3(0.0);
+            for (size_t i = 0; i < pointLights.size(); ++i) {
+                pointLights[i].color = pointLightOn ? pointLightColors[i] : glm::vec3(0.0);
+            }
+            spotLight.color = spotLightOn ? defualtSpotLightColor : glm::vec3(0);
+            spotLight.position = camera.position();
+            spotLight.direction = camera.front();
+            setLightSourceColor(0, globalLight.color);
+            for (size_t i = 0; i < pointLights.size(); ++i) {
+                setLightSourceColor(i + 1, pointLights[i].color);
+            }
+            backpackModel.update(cModelUploadBudgetMs);
         }
         // --------------- actual render here
         // set some color. This color will be setted each time we call glClear
         // glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+        // the overdraw is added up from black
+        auto clearColor = overdrawView ? 0.0f : 0.1f;
+        glClearColor(clearColor, clearColor, clearColor, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        shaderProgram->use();
-        globalLight.color = globalLightOn ? defaultGlobalLightColor : glm::vec3(0.0);
-        shaderProgram->setUniform("globalLight", globalLight);
-        for (int i = 0; i < cPointLightsNumber; ++i) {
-            auto& pointLight = pointLights[i];
-
-            pointLight.color = pointLightOn ? defualtPointLightColor : glm::vec3(0.0);
-            auto uniformName = "pointlights[" + std::to_string(i) + "]";
-            shaderProgram->setUniform(uniformName, pointLight);
+        int framebufferWidth, framebufferHeight;
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        auto fieldOfView = glm::radians(camera.fieldOfView());
+        const float aspectRatio = 800.0f / 600.0f;
+        const float nearPlane = 0.1f;
+        const float farPlane = 100.0f;
+        auto projectionTr = glm::perspective(fieldOfView, aspectRatio, nearPlane, farPlane);
+        {
+            auto uploadScope = profiler.scope("Uniform upload");
+            uniformBlocks.setLights(globalLight);
+            uniformBlocks.setFrame(camera.viewMatrix(), projectionTr, camera.position(),
+                                   float(glfwGetTime()));
         }
-        spotLight.color = spotLightOn ? defualtSpotLightColor : glm::vec3(0);
-        spotLight.position = camera.position();
-        spotLight.direction = camera.front();
-        shaderProgram->setUniform("spotLight", spotLight);
-
-        shaderProgram->setUniform("viewPosition", camera.position());
-        shaderProgram->setUniform("viewTr", camera.viewMatrix());
-        shaderProgram->setUniform("projectionTr", glm::perspective(glm::radians(camera.fieldOfView()),
-                                                                   800.0f / 600.0f, 0.1f, 100.0f));
-        shaderProgram->setUniform("time", float(glfwGetTime()));
-
-        // containers
-        cubeMesh->setMaterial(containerMaterial);
-        int cubeNumberXYPlane = 6;
-        double positionRadius = 3;
-        for (int i = 1; i <= cubeNumberXYPlane; i++) {
-            auto modelTr = glm::translate(
-                glm::mat4(1.0f),
-                glm::vec3(positionRadius * cos(2 * double(i) * M_PI / cubeNumberXYPlane),
-                          positionRadius * sin(2 * double(i) * M_PI / cubeNumberXYPlane), double(i) / 2));
-            cubeMesh->setModelTr(modelTr);
-            cubeMesh->draw(*shaderProgram);
+        {
+            auto clustersScope = profiler.scope("Light clusters");
+            lightClusters.setClustered(clusteredLighting);
+            lightClusters.update({.viewTr = camera.viewMatrix(),
+                                  .fieldOfView = fieldOfView,
+                                  .aspectRatio = aspectRatio,
+                                  .near = nearPlane,
+                                  .far = farPlane,
+                                  .viewportSize = glm::vec2(framebufferWidth, framebufferHeight)},
+                                 pointLights, std::span(&spotLight, 1));
         }
-
-        // global light source
-        cubeMesh->resetModelTr();
-        cubeMesh->setModelTr(glm::translate(glm::mat4(1.0f), globalLight.position));
-        lightSourceMaterial.color = globalLight.color;
-        cubeMesh->setMaterial(lightSourceMaterial);
-        cubeMesh->draw(*shaderProgram);
-
-        // point light sources
-        cubeMesh->resetModelTr();
-        cubeMesh->setLocalTr(glm::scale(glm::mat4(1.0f), glm::vec3(0.5f)));
-        for (int i = 0; i < cPointLightsNumber; ++i) {
-            lightSourceMaterial.color = pointLights[i].color;
-            cubeMesh->setMaterial(lightSourceMaterial);
-            cubeMesh->setModelTr(glm::translate(glm::mat4(1.0f), pointLights[i].position));
-            cubeMesh->draw(*shaderProgram);
+        {
+            // meshes are culled and their levels selected as they are submitted
+            auto cullingScope = profiler.scope("Culling");
+            Frustum frustum(projectionTr * camera.viewMatrix());
+            renderQueue.setFrustum(frustum);
+            auto pixelsPerUnit =
+                static_cast<float>(framebufferHeight) / (2.0f * std::tan(fieldOfView / 2.0f));
+            renderQueue.setLodSelection({.viewPosition = camera.position(),
+                                         .pixelsPerUnit = pixelsPerUnit,
+                                         .maxScreenError = lodMaxScreenError});
+            renderQueue.setDepthPrepass(depthPrepass ? &*depthProgram : nullptr);
+            renderQueue.setOverdrawView(overdrawView ? &*overdrawProgram : nullptr);
+            occlusionCuller.setView(camera.position(), nearPlane);
+            renderQueue.setOcclusionCuller(occlusionCulling ? &occlusionCuller : nullptr);
+            sceneShaders->setLights(globalLightOn, lightClusters.stats().lightsCount > 0);
+            // all containers share one material
+            renderQueue.submitInstanced(sceneShaders->program(sceneMaterials, containerMaterialIndex),
+                                        sceneMaterials, *cubeMesh, containerInstances);
+            backpackModel.submit(renderQueue, *sceneShaders);
+            if (streamedModel) {
+                auto streamingScope = profiler.scope("Streaming");
+                streamedModel->update(camera.position(), frustum, cModelUploadBudgetMs);
+                streamedModel->submit(renderQueue, *sceneShaders);
+            }
+            renderQueue.submitInstanced(*lightSourceProgram, sceneMaterials, *cubeMesh, lightSourceInstances);
         }
-
-        cubeMesh->resetLocalTr();
-        cubeMesh->resetModelTr();
-
-        backpackModel.draw(*shaderProgram);
-
-        RenderImGui();
+        {
+            auto drawsScope = profiler.scope("Model draws");
+            renderQueue.flush();
+        }
+        {
+            auto imGuiScope = profiler.scope("ImGui");
+            RenderImGui(backpackModel, renderQueue.stats(), lightClusters.stats(),
+                        sceneShaders->programsCount(), profiler, streamedModel.get());
+        }
+        // waits for vsync in the swap are left out of the frame
+        profiler.endFrame();
 
         // swap front and back buffers
         glfwSwapBuffers(window);
@@ -219,9 +480,6 @@ int main() {
     }
 
     CleanupImGui();
-    // glfw: terminate, clearing all previously allocated GLFW resources.
-    glfwTerminate();
-    return 0;
 }
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height) { glViewport(0, 0, width, height); }
@@ -317,14 +575,159 @@ void CleanupImGui() {
     ImGui::DestroyContext();
 }
 
-void RenderImGui() {
+PointLight makePointLight(int lightIdx) {
+    PointLight light;
+    if (lightIdx < cDefaultPointLightsCount) {
+        light.color = defualtPointLightColor;
+        light.position = glm::vec3(0.0, 2.0, 0.0) * static_cast<float>(lightIdx + 1);
+        return light;
+    }
+    // a golden angle spiral around the containers, hues go round the color wheel
+    auto spiralIdx = static_cast<float>(lightIdx - cDefaultPointLightsCount);
+    auto angle = spiralIdx * 2.39996f;
+    auto radius = 1.0f + 0.5f * std::sqrt(spiralIdx);
+    light.position = glm::vec3(radius * std::cos(angle), radius * std::sin(angle),
+                               std::fmod(spiralIdx, 5.0f) * 0.75f - 0.5f);
+    auto hue = std::fmod(spiralIdx * 0.618034f, 1.0f);
+    light.color = 0.5f + 0.5f * glm::cos(6.28318f * (hue + glm::vec3(0.0f, 1.0f / 3.0f, 2.0f / 3.0f)));
+    light.linear = 0.7f;
+    light.quadratic = 1.8f;
+    light.range = 2.5f;
+    return light;
+}
+
+void RenderImGui(const Model& model, const RenderQueue::Stats& renderStats,
+                 const LightClusters::Stats& lightStats, size_t shaderProgramsCount,
+                 FrameProfiler& profiler, StreamingModel* streamedModel) {
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
     ImGui::NewFrame();
 
-    // Example window
-    ImGui::Begin("Hello, world!");
-    ImGui::Text("This is a simple window!");
+    ImGui::Begin("Profiler");
+    auto isProfilerEnabled = profiler.isEnabled();
+    if (ImGui::Checkbox("Enabled", &isProfilerEnabled)) {
+        profiler.setEnabled(isProfilerEnabled);
+    }
+    const auto& frames = profiler.frames();
+    if (!frames.empty()) {
+        // the frame scope of every kept frame, oldest first
+        std::vector<float> cpuFrameMs;
+        std::vector<float> gpuFrameMs;
+        for (const auto& frame : frames) {
+            cpuFrameMs.push_back(static_cast<float>(frame.scopes.front().cpuMs));
+            gpuFrameMs.push_back(static_cast<float>(std::max(frame.scopes.front().gpuMs, 0.0)));
+        }
+        ImGui::PlotLines("CPU, ms", cpuFrameMs.data(), static_cast<int>(cpuFrameMs.size()), 0, nullptr, 0.0f,
+                         FLT_MAX, ImVec2(0.0f, 60.0f));
+        ImGui::PlotLines("GPU, ms", gpuFrameMs.data(), static_cast<int>(gpuFrameMs.size()), 0, nullptr, 0.0f,
+                         FLT_MAX, ImVec2(0.0f, 60.0f));
+        if (ImGui::BeginTable("Scopes", 3, ImGuiTableFlags_RowBg)) {
+            ImGui::TableSetupColumn("Scope");
+            ImGui::TableSetupColumn("CPU, ms");
+            ImGui::TableSetupColumn("GPU, ms");
+            ImGui::TableHeadersRow();
+            for (const auto& scope : frames.back().scopes) {
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::Text("%*s%s", 2 * scope.depth, "", scope.name);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", scope.cpuMs);
+                ImGui::TableNextColumn();
+                if (scope.gpuMs >= 0.0) {
+                    ImGui::Text("%.3f", scope.gpuMs);
+                } else {
+                    ImGui::Text("-");
+                }
+            }
+            ImGui::EndTable();
+        }
+    }
+    // the last frames, e.g. right after a stutter
+    static std::string traceExportStatus;
+    if (ImGui::Button("Export trace")) {
+        traceExportStatus = profiler.exportChromeTrace("frametrace.json")
+                                ? std::to_string(frames.size()) + " frames written to frametrace.json"
+                                : "Can't write frametrace.json";
+    }
+    ImGui::Text("%s", traceExportStatus.c_str());
+    ImGui::End();
+
+    ImGui::Begin("Model");
+    switch (model.loadState()) {
+        case ModelLoadState::Loading:
+            ImGui::Text("Loading...");
+            ImGui::ProgressBar(model.loadProgress());
+            break;
+        case ModelLoadState::Ready:
+            ImGui::Text("Loaded");
+            ImGui::Text("%zu meshes in %zu draw calls", model.meshesCount(), model.drawBatchesCount());
+            break;
+        case ModelLoadState::Failed:
+            ImGui::Text("Failed to load");
+            break;
+    }
+    ImGui::End();
+
+    if (streamedModel) {
+        ImGui::Begin("Streaming");
+        if (!streamedModel->isOpen()) {
+            ImGui::Text("Failed to open");
+        } else {
+            const auto& stats = streamedModel->stats();
+            auto budgets = streamedModel->budgets();
+            int cpuBudgetMb = static_cast<int>(budgets.cpuBytes >> 20);
+            int gpuBudgetMb = static_cast<int>(budgets.gpuBytes >> 20);
+            auto isCpuBudgetChanged = ImGui::SliderInt("Memory budget, MB", &cpuBudgetMb, 16, 4096);
+            auto isGpuBudgetChanged = ImGui::SliderInt("GPU budget, MB", &gpuBudgetMb, 16, 4096);
+            if (isCpuBudgetChanged || isGpuBudgetChanged) {
+                streamedModel->setBudgets({.cpuBytes = static_cast<size_t>(cpuBudgetMb) << 20,
+                                           .gpuBytes = static_cast<size_t>(gpuBudgetMb) << 20});
+            }
+            ImGui::Text("Chunks: %zu, %zu visible", stats.chunksCount, stats.visibleChunksCount);
+            ImGui::Text("On GPU: %zu chunks, %zu uploading, %.1f MB", stats.gpuChunksCount,
+                        stats.uploadingChunksCount, static_cast<double>(stats.gpuBytes) / (1 << 20));
+            ImGui::Text("In memory: %zu pages, %zu reads, %.1f MB", stats.cpuPagesCount,
+                        stats.readsInFlightCount, static_cast<double>(stats.cpuBytes) / (1 << 20));
+            ImGui::Text("Evicted: %zu chunks, %zu pages", stats.evictedChunksCount, stats.evictedPagesCount);
+            ImGui::Text("Read: %.1f MB", static_cast<double>(stats.readBytes) / (1 << 20));
+        }
+        ImGui::End();
+    }
+
+    ImGui::Begin("Rendering");
+    ImGui::Text("%zu draws, %zu draw calls", renderStats.drawsCount, renderStats.drawCallsCount);
+    ImGui::Text("Binds: %zu programs, %zu material tables, %zu array sets, %zu VAOs",
+                renderStats.programBindsCount, renderStats.materialTableBindsCount,
+                renderStats.arraySetBindsCount, renderStats.vertexArrayBindsCount);
+    ImGui::Text("%zu redundant binds skipped", renderStats.skippedBindsCount);
+    ImGui::Text("Meshes: %zu visible, %zu culled, %zu occluded", renderStats.visibleMeshesCount,
+                renderStats.culledMeshesCount, renderStats.occludedMeshesCount);
+    ImGui::Text("%zu triangles, %zu meshes simplified", renderStats.trianglesCount,
+                renderStats.simplifiedMeshesCount);
+    ImGui::Text("%zu shader programs", shaderProgramsCount);
+    ImGui::SliderFloat("LOD error, px", &lodMaxScreenError, 0.0f, 16.0f);
+    ImGui::Checkbox("Depth pre-pass", &depthPrepass);
+    ImGui::Checkbox("Overdraw view", &overdrawView);
+    ImGui::Checkbox("Occlusion culling", &occlusionCulling);
+    const auto& io = ImGui::GetIO();
+    auto pixelsCount = io.DisplaySize.x * io.DisplayFramebufferScale.x * io.DisplaySize.y *
+                       io.DisplayFramebufferScale.y;
+    if (pixelsCount > 0.0f) {
+        ImGui::Text("Overdraw: %.2f shaded fragments per pixel",
+                    static_cast<float>(renderStats.shadedSamplesCount) / pixelsCount);
+    }
+    if (renderStats.prepassDrawCallsCount > 0) {
+        ImGui::Text("%zu depth pre-pass draw calls", renderStats.prepassDrawCallsCount);
+    }
+    ImGui::End();
+
+    ImGui::Begin("Lights");
+    ImGui::SliderInt("Point lights", &pointLightsCount, 0, cMaxPointLightsCount);
+    ImGui::Checkbox("Clustered", &clusteredLighting);
+    ImGui::Text("%zu lights, %zu visible", lightStats.lightsCount, lightStats.visibleLightsCount);
+    ImGui::Text("%zu cluster lights, at most %zu in a cluster", lightStats.lightIndicesCount,
+                lightStats.maxClusterLightsCount);
+    ImGui::Text("Assignment: %.2f ms", lightStats.assignmentMs);
     ImGui::End();
     ImGui::Render();
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
@@ -2,4 +2,6 @@
 #include "stb_image.h"
 #define STB_IMAGE_RESIZE_IMPLEMENTATION
 #define STB_IMAGE_RESIZE2_IMPLEMENTATION
-#include "stb_image_resize2.h"
\ No newline at end of file
+#include "stb_image_resize2.h"
+#define STB_DXT_IMPLEMENTATION
+#include "stb_dxt.h"